@@ -0,0 +1,1894 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * HDF5R benchmarks. Run with the name of a benchmark, or with no arguments to
+ * run them all. Build with CMAKE_BUILD_TYPE=Release for meaningful numbers.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <hdf5r/aggregate.h>
+#include <hdf5r/catalog.h>
+#include <hdf5r/export.h>
+#include <hdf5r/hdf5r.h>
+#include <hdf5r/logd.h>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <malloc.h>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+
+
+static char const* const BENCH_FILE = "benchmark.hdf5r";
+
+
+// Heap usage through malloc, including allocator overhead. Counting at the
+// malloc level catches the HDF5 library's allocations as well as our own.
+// The counters are not thread safe; none of the benchmarks allocate from more
+// than one thread at a time.
+static size_t heap_bytes = 0;
+static size_t heap_allocs = 0;
+// Keeps the results of timed loops from being optimised away
+static volatile uint64_t sink = 0;
+
+
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* p, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* p);
+
+
+    static void* count_alloc(void* p)
+    {
+        if (p != 0)
+        {
+            heap_bytes += malloc_usable_size(p);
+            ++heap_allocs;
+        }
+        return p;
+    }
+
+
+    void* malloc(size_t size)
+    {
+        return count_alloc(__libc_malloc(size));
+    }
+
+
+    void* calloc(size_t count, size_t size)
+    {
+        return count_alloc(__libc_calloc(count, size));
+    }
+
+
+    void* realloc(void* p, size_t size)
+    {
+        if (p != 0)
+        {
+            heap_bytes -= malloc_usable_size(p);
+        }
+        void* result = __libc_realloc(p, size);
+        if (result == 0 && p != 0 && size != 0)
+        {
+            // The original block is untouched on failure
+            heap_bytes += malloc_usable_size(p);
+            return 0;
+        }
+        return count_alloc(result);
+    }
+
+
+    int posix_memalign(void** p, size_t alignment, size_t size)
+    {
+        *p = count_alloc(__libc_memalign(alignment, size));
+        return *p == 0 ? ENOMEM : 0;
+    }
+
+
+    void free(void* p)
+    {
+        if (p != 0)
+        {
+            heap_bytes -= malloc_usable_size(p);
+            __libc_free(p);
+        }
+    }
+}
+
+
+uint64_t get_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+struct Pose
+{
+    double x, y, z;
+    double roll, pitch, yaw;
+};
+
+
+hid_t make_pose_type(bool native)
+{
+    hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(Pose));
+    hid_t field = native ? H5T_NATIVE_DOUBLE : H5T_IEEE_F64LE;
+    H5Tinsert(type, "x", HOFFSET(Pose, x), field);
+    H5Tinsert(type, "y", HOFFSET(Pose, y), field);
+    H5Tinsert(type, "z", HOFFSET(Pose, z), field);
+    H5Tinsert(type, "roll", HOFFSET(Pose, roll), field);
+    H5Tinsert(type, "pitch", HOFFSET(Pose, pitch), field);
+    H5Tinsert(type, "yaw", HOFFSET(Pose, yaw), field);
+    return type;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Checkpoint interval
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Write a fixed number of records under a durability policy and return the
+// achieved rate in records per second
+double write_with_durability(hdf5r::Durability const& policy, size_t records)
+{
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+    f.durability(policy);
+    hid_t mtype = make_pose_type(true);
+    hid_t ftype = make_pose_type(false);
+    hdf5r::ChannelID chan = f.add_channel("pose", "Pose", "benchmark", mtype,
+            ftype);
+    Pose pose = {0, 0, 0, 0, 0, 0};
+    uint64_t start(get_ns());
+    for (size_t ii(0); ii < records; ++ii)
+    {
+        pose.x = ii;
+        f.add_entry(chan, ii, &pose);
+    }
+    f.checkpoint();
+    uint64_t elapsed(get_ns() - start);
+    H5Tclose(ftype);
+    H5Tclose(mtype);
+    return records / (elapsed / 1e9);
+}
+
+
+void print_rate(std::string const& label, double rate, double base)
+{
+    std::cout << std::setw(24) << std::left << label <<
+        std::setw(16) << std::right << std::fixed << std::setprecision(0) <<
+        rate << std::setw(12) << std::setprecision(2) << rate / base << '\n';
+}
+
+
+void bench_checkpoint()
+{
+    size_t const records(50000);
+    std::cout << "Checkpoint interval (" << records << " pose records)\n";
+    std::cout << std::setw(24) << std::left << "Policy" <<
+        std::setw(16) << std::right << "Records/s" <<
+        std::setw(12) << "Relative" << '\n';
+
+    double base(write_with_durability(hdf5r::Durability(), records));
+    print_rate("close only", base, base);
+    size_t const counts[] = {10000, 1000, 100, 10};
+    for (size_t ii(0); ii < sizeof(counts) / sizeof(counts[0]); ++ii)
+    {
+        std::ostringstream label;
+        label << "every " << counts[ii] << " records";
+        print_rate(label.str(), write_with_durability(
+                    hdf5r::Durability(counts[ii]), records), base);
+    }
+    uint64_t const intervals[] = {100, 10, 1};
+    for (size_t ii(0); ii < sizeof(intervals) / sizeof(intervals[0]); ++ii)
+    {
+        std::ostringstream label;
+        label << "every " << intervals[ii] << " ms";
+        print_rate(label.str(), write_with_durability(
+                    hdf5r::Durability(0, intervals[ii]), records), base);
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Index representation
+///////////////////////////////////////////////////////////////////////////////
+
+
+// The index representation used before the flat index
+typedef std::map<uint64_t, hdf5r::IndexPointerList> MapIndex;
+
+
+// Cheap deterministic pseudo-random numbers
+uint64_t next_random(uint64_t& state)
+{
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 17;
+}
+
+
+void print_index_row(std::string const& label, size_t bytes,
+        uint64_t build_ns, uint64_t lookup_ns, size_t records, size_t lookups)
+{
+    std::cout << std::setw(12) << std::left << label <<
+        std::setw(16) << std::right << std::fixed << std::setprecision(1) <<
+        static_cast<double>(bytes) / records <<
+        std::setw(16) << static_cast<double>(build_ns) / records <<
+        std::setw(16) << static_cast<double>(lookup_ns) / lookups << '\n';
+}
+
+
+void bench_index()
+{
+    size_t const records(2000000);
+    size_t const lookups(1000000);
+    size_t const channels(4);
+    // Records arrive at roughly 1 kHz, a few of them sharing time stamps
+    std::vector<uint64_t> timestamps(records);
+    uint64_t state(1);
+    for (size_t ii(0); ii < records; ++ii)
+    {
+        timestamps[ii] = ii * 1000000 + (next_random(state) % 4 == 0 ?
+                0 : next_random(state) % 1000);
+    }
+    std::vector<uint64_t> queries(lookups);
+    for (size_t ii(0); ii < lookups; ++ii)
+    {
+        queries[ii] = next_random(state) % (records * 1000000);
+    }
+
+    std::cout << "Index representation (" << records << " records, " <<
+        lookups << " lookups)\n";
+    std::cout << std::setw(12) << std::left << "Index" <<
+        std::setw(16) << std::right << "Bytes/record" <<
+        std::setw(16) << "Build ns/rec" << std::setw(16) << "Lookup ns" <<
+        '\n';
+
+    {
+        size_t before(heap_bytes);
+        uint64_t start(get_ns());
+        MapIndex index;
+        for (size_t ii(0); ii < records; ++ii)
+        {
+            index[timestamps[ii]].push_back(
+                    hdf5r::IndexPointer(ii % channels, ii / channels));
+        }
+        uint64_t built(get_ns());
+        size_t bytes(heap_bytes - before);
+        uint64_t found(0);
+        for (size_t ii(0); ii < lookups; ++ii)
+        {
+            MapIndex::const_iterator entry(index.lower_bound(queries[ii]));
+            if (entry != index.end())
+            {
+                found += entry->second[0].second;
+            }
+        }
+        uint64_t looked(get_ns());
+        sink = found;
+        print_index_row("std::map", bytes, built - start, looked - built,
+                records, lookups);
+    }
+    {
+        size_t before(heap_bytes);
+        uint64_t start(get_ns());
+        hdf5r::Index index;
+        for (size_t ii(0); ii < records; ++ii)
+        {
+            index.append(timestamps[ii], ii % channels, ii / channels);
+        }
+        uint64_t built(get_ns());
+        size_t bytes(heap_bytes - before);
+        hdf5r::IndexView view(index.view());
+        uint64_t found(0);
+        for (size_t ii(0); ii < lookups; ++ii)
+        {
+            size_t pos(view.lower_bound(queries[ii]));
+            if (pos != view.size())
+            {
+                found += view.record(pos);
+            }
+        }
+        uint64_t looked(get_ns());
+        sink = found;
+        print_index_row("flat", bytes, built - start, looked - built,
+                records, lookups);
+    }
+    std::cout << '\n';
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// File profiles
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Write records round-robin over a number of channels and return the achieved
+// rate in records per second
+double append_with_profile(hdf5r::FileProfile const& profile, size_t channels,
+        size_t records)
+{
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE, profile);
+    hid_t mtype = make_pose_type(true);
+    hid_t ftype = make_pose_type(false);
+    std::vector<hdf5r::ChannelID> chans;
+    for (size_t ii(0); ii < channels; ++ii)
+    {
+        std::ostringstream name;
+        name << "pose" << ii;
+        chans.push_back(f.add_channel(name.str(), "Pose", "benchmark", mtype,
+                    ftype));
+    }
+    H5Tclose(ftype);
+    H5Tclose(mtype);
+    Pose pose = {0, 0, 0, 0, 0, 0};
+    uint64_t start(get_ns());
+    for (size_t ii(0); ii < records; ++ii)
+    {
+        pose.x = ii;
+        f.add_entry(chans[ii % channels], ii, &pose);
+    }
+    f.flush();
+    return records / ((get_ns() - start) / 1e9);
+}
+
+
+// Open the benchmark file repeatedly and return the mean time in milliseconds
+double open_with_profile(hdf5r::FileProfile const& profile, size_t opens)
+{
+    uint64_t start(get_ns());
+    for (size_t ii(0); ii < opens; ++ii)
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY, profile);
+        sink = f.index().size();
+    }
+    return (get_ns() - start) / 1e6 / opens;
+}
+
+
+size_t file_size(char const* const name)
+{
+    FILE* f = std::fopen(name, "rb");
+    if (f == 0)
+    {
+        return 0;
+    }
+    std::fseek(f, 0, SEEK_END);
+    size_t result(std::ftell(f));
+    std::fclose(f);
+    return result;
+}
+
+
+void bench_profile()
+{
+    size_t const channels(64);
+    size_t const records(500000);
+    size_t const opens(20);
+    std::cout << "File profiles (" << records << " pose records over " <<
+        channels << " channels)\n";
+    std::cout << std::setw(24) << std::left << "Profile" <<
+        std::setw(16) << std::right << "Records/s" <<
+        std::setw(12) << "Open ms" << std::setw(12) << "MiB" << '\n';
+
+    char const* const presets[] = {"default", "write-heavy logger", "archive"};
+    for (size_t ii(0); ii < sizeof(presets) / sizeof(presets[0]); ++ii)
+    {
+        hdf5r::FileProfile profile(hdf5r::FileProfile::preset(presets[ii]));
+        double rate(append_with_profile(profile, channels, records));
+        double open_ms(open_with_profile(profile, opens));
+        std::cout << std::setw(24) << std::left << presets[ii] <<
+            std::setw(16) << std::right << std::fixed <<
+            std::setprecision(0) << rate <<
+            std::setw(12) << std::setprecision(2) << open_ms <<
+            std::setw(12) << file_size(BENCH_FILE) / 1048576.0 << '\n';
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Random reads
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Read records at random from every channel and return the achieved rate in
+// records per second
+double random_reads(hdf5r::FileProfile const& profile, size_t reads)
+{
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY, profile);
+    std::vector<hdf5r::ChannelID> chans(f.channels());
+    std::vector<size_t> sizes;
+    for (size_t ii(0); ii < chans.size(); ++ii)
+    {
+        sizes.push_back(f.get_channel_info(chans[ii]).size());
+    }
+    uint64_t state(1);
+    Pose pose;
+    uint64_t start(get_ns());
+    for (size_t ii(0); ii < reads; ++ii)
+    {
+        size_t chan(next_random(state) % chans.size());
+        sink = f.get_entry(chans[chan], next_random(state) % sizes[chan],
+                &pose);
+    }
+    return reads / ((get_ns() - start) / 1e9);
+}
+
+
+void bench_random()
+{
+    size_t const channels(8);
+    size_t const records(2000000);
+    size_t const reads(500000);
+    append_with_profile(hdf5r::FileProfile(), channels, records);
+    std::cout << "Random reads (" << reads << " reads from " << records <<
+        " pose records over " << channels << " channels)\n";
+    std::cout << std::setw(24) << std::left << "Caches" <<
+        std::setw(16) << std::right << "Reads/s" <<
+        std::setw(12) << "Relative" << '\n';
+
+    double base(random_reads(hdf5r::FileProfile(), reads));
+    print_rate("default", base, base);
+    char const* const labels[] = {"sequential", "random", "replay"};
+    hdf5r::AccessPattern const patterns[] = {hdf5r::SEQUENTIAL,
+        hdf5r::RANDOM, hdf5r::REPLAY};
+    for (size_t ii(0); ii < sizeof(patterns) / sizeof(patterns[0]); ++ii)
+    {
+        hdf5r::FileProfile profile;
+        profile.access_pattern(patterns[ii]);
+        print_rate(labels[ii], random_reads(profile, reads), base);
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Channel metadata
+///////////////////////////////////////////////////////////////////////////////
+
+
+void print_channel_rate(std::string const& label, size_t channels,
+        uint64_t elapsed)
+{
+    std::cout << std::setw(24) << std::left << label <<
+        std::setw(16) << std::right << std::fixed << std::setprecision(0) <<
+        channels / (elapsed / 1e9) << '\n';
+}
+
+
+void bench_channels()
+{
+    size_t const channels(10000);
+    std::cout << "Channel metadata (" << channels << " channels)\n";
+    std::cout << std::setw(24) << std::left << "Operation" <<
+        std::setw(16) << std::right << "Channels/s" << '\n';
+
+    hid_t mtype = make_pose_type(true);
+    hid_t ftype = make_pose_type(false);
+    uint64_t start(get_ns());
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+        for (size_t ii(0); ii < channels; ++ii)
+        {
+            std::ostringstream name;
+            name << "pose" << ii;
+            f.add_channel(name.str(), "Pose", "benchmark", mtype, ftype);
+        }
+    }
+    print_channel_rate("create", channels, get_ns() - start);
+    H5Tclose(ftype);
+    H5Tclose(mtype);
+
+    start = get_ns();
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY);
+    print_channel_rate("open file", channels, get_ns() - start);
+    std::vector<hdf5r::ChannelID> chans(f.channels());
+    start = get_ns();
+    for (size_t ii(0); ii < chans.size(); ++ii)
+    {
+        sink = f.get_channel_info(chans[ii]).size();
+    }
+    print_channel_rate("first access", channels, get_ns() - start);
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Steady state
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Bytes held by the metadata caches of all open files. The caches grow with
+// the files' metadata up to their configured limits, which is not a leak.
+size_t metadata_cache_bytes()
+{
+    ssize_t count(H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_FILE));
+    if (count <= 0)
+    {
+        return 0;
+    }
+    std::vector<hid_t> files(count);
+    count = H5Fget_obj_ids(H5F_OBJ_ALL, H5F_OBJ_FILE, count, &files[0]);
+    size_t result(0);
+    for (ssize_t ii(0); ii < count; ++ii)
+    {
+        size_t cur_size(0);
+        int num_entries(0);
+        H5Fget_mdc_size(files[ii], 0, 0, &cur_size, &num_entries);
+        result += cur_size;
+    }
+    return result;
+}
+
+
+// Open HDF5 objects of every kind held by the process
+size_t open_ids()
+{
+    H5I_type_t const types[] = {H5I_FILE, H5I_GROUP, H5I_DATATYPE,
+        H5I_DATASPACE, H5I_DATASET, H5I_ATTR, H5I_GENPROP_LST};
+    size_t result(0);
+    for (size_t ii(0); ii < sizeof(types) / sizeof(types[0]); ++ii)
+    {
+        hsize_t count(0);
+        H5Inmembers(types[ii], &count);
+        result += count;
+    }
+    return result;
+}
+
+
+struct SteadyCounts
+{
+    size_t allocs;
+    ptrdiff_t bytes;
+    ptrdiff_t ids;
+};
+
+
+// Run an operation many times after warming it up, and count the heap
+// allocations made and the heap bytes and HDF5 objects left behind
+template<typename Op>
+SteadyCounts run_steady(Op op, size_t warmup, size_t ops)
+{
+    for (size_t ii(0); ii < warmup; ++ii)
+    {
+        op(ii);
+    }
+    size_t mdc(metadata_cache_bytes());
+    size_t allocs(heap_allocs), bytes(heap_bytes), ids(open_ids());
+    for (size_t ii(warmup); ii < warmup + ops; ++ii)
+    {
+        op(ii);
+    }
+    SteadyCounts result = {heap_allocs - allocs,
+        static_cast<ptrdiff_t>(heap_bytes - bytes) -
+            static_cast<ptrdiff_t>(metadata_cache_bytes() - mdc),
+        static_cast<ptrdiff_t>(open_ids() - ids)};
+    return result;
+}
+
+
+struct AddEntryOp
+{
+    AddEntryOp(hdf5r::HDF5R& f, hdf5r::ChannelID chan) : f(f), chan(chan) {}
+    void operator()(size_t ii)
+    {
+        Pose pose = {static_cast<double>(ii), 0, 0, 0, 0, 0};
+        f.add_entry(chan, ii, &pose);
+    }
+    hdf5r::HDF5R& f;
+    hdf5r::ChannelID chan;
+};
+
+
+struct GetEntryOp
+{
+    GetEntryOp(hdf5r::HDF5R& f, hdf5r::ChannelID chan, size_t size)
+        : f(f), chan(chan), size(size)
+    {}
+    void operator()(size_t ii)
+    {
+        Pose pose;
+        sink = f.get_entry(chan, ii % size, &pose);
+    }
+    hdf5r::HDF5R& f;
+    hdf5r::ChannelID chan;
+    size_t size;
+};
+
+
+struct ChannelInfoOp
+{
+    ChannelInfoOp(hdf5r::HDF5R& f, hdf5r::ChannelID chan) : f(f), chan(chan) {}
+    void operator()(size_t ii)
+    {
+        sink = f.get_channel_info(chan).end_time();
+    }
+    hdf5r::HDF5R& f;
+    hdf5r::ChannelID chan;
+};
+
+
+// Report the steady-state behaviour of an operation, returning false if it
+// leaks HDF5 objects or keeps more heap memory than allowed
+bool report_steady(std::string const& label, SteadyCounts const& counts,
+        size_t ops, double max_bytes_per_op=0)
+{
+    std::cout << std::setw(20) << std::left << label <<
+        std::setw(14) << std::right << std::fixed << std::setprecision(3) <<
+        static_cast<double>(counts.allocs) / ops <<
+        std::setw(14) << counts.bytes << std::setw(14) << counts.ids << '\n';
+    return counts.bytes <= max_bytes_per_op * ops && counts.ids <= 0;
+}
+
+
+// Check that the hot paths neither leak HDF5 objects nor hold on to heap
+// memory once warmed up. Returns false on a leak.
+bool bench_steady()
+{
+    // Long enough to fill each data set's chunk cache
+    size_t const warmup(200000);
+    size_t const ops(100000);
+    std::cout << "Steady state (" << ops << " operations after " << warmup <<
+        " warm-up)\n";
+    std::cout << std::setw(20) << std::left << "Operation" <<
+        std::setw(14) << std::right << "Allocs/op" <<
+        std::setw(14) << "Heap growth" << std::setw(14) << "ID growth" <<
+        '\n';
+
+    bool ok(true);
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+        hid_t mtype = make_pose_type(true);
+        hid_t ftype = make_pose_type(false);
+        hdf5r::ChannelID chan = f.add_channel("pose", "Pose", "benchmark",
+                mtype, ftype);
+        H5Tclose(ftype);
+        H5Tclose(mtype);
+        // The in-memory index necessarily grows with the records
+        f.reserve_index(warmup + ops);
+        // Appending grows the file's chunk index, and the cached copy of
+        // it, by a B-tree node every few thousand records
+        ok = report_steady("add_entry", run_steady(AddEntryOp(f, chan),
+                    warmup, ops), ops, 4) && ok;
+        // Warm up with a pass over every record so that the whole chunk
+        // index is cached
+        ok = report_steady("get_entry", run_steady(
+                    GetEntryOp(f, chan, warmup + ops), warmup + ops, ops),
+                ops) && ok;
+        ok = report_steady("get_channel_info", run_steady(
+                    ChannelInfoOp(f, chan), warmup, ops), ops) && ok;
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+    if (!ok)
+    {
+        std::cerr << "Steady state operations leaked\n";
+    }
+    return ok;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// File drivers
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Append pose records round-robin over several channels, checkpointing
+// regularly, and report the sustained write rate and the spread of
+// add_entry latencies
+void write_with_driver(std::string const& label,
+        hdf5r::FileProfile const& profile, size_t channels, size_t records)
+{
+    std::vector<uint64_t> latencies(records);
+    uint64_t start(get_ns());
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE, profile);
+        f.durability(hdf5r::Durability(10000));
+        hid_t mtype = make_pose_type(true);
+        hid_t ftype = make_pose_type(false);
+        std::vector<hdf5r::ChannelID> chans;
+        for (size_t ii(0); ii < channels; ++ii)
+        {
+            std::ostringstream name;
+            name << "pose" << ii;
+            chans.push_back(f.add_channel(name.str(), "Pose", "benchmark",
+                        mtype, ftype));
+        }
+        H5Tclose(ftype);
+        H5Tclose(mtype);
+        Pose pose = {0, 0, 0, 0, 0, 0};
+        for (size_t ii(0); ii < records; ++ii)
+        {
+            pose.x = ii;
+            uint64_t before(get_ns());
+            f.add_entry(chans[ii % channels], ii, &pose);
+            latencies[ii] = get_ns() - before;
+        }
+    }
+    double seconds((get_ns() - start) / 1e9);
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << std::setw(24) << std::left << label <<
+        std::setw(10) << std::right << std::fixed << std::setprecision(1) <<
+        file_size(BENCH_FILE) / 1048576.0 / seconds <<
+        std::setw(10) << latencies[records / 2] / 1e3 <<
+        std::setw(10) << latencies[records * 99 / 100] / 1e3 <<
+        std::setw(10) << latencies[records * 999 / 1000] / 1e3 <<
+        std::setw(10) << latencies.back() / 1e3 << '\n';
+}
+
+
+void bench_driver()
+{
+    size_t const channels(8);
+    size_t const records(2000000);
+    std::cout << "File drivers (" << records << " pose records over " <<
+        channels << " channels, checkpoint every 10000; latencies in us)\n";
+    std::cout << std::setw(24) << std::left << "Driver" <<
+        std::setw(10) << std::right << "MiB/s" << std::setw(10) << "p50" <<
+        std::setw(10) << "p99" << std::setw(10) << "p99.9" <<
+        std::setw(10) << "max" << '\n';
+
+    write_with_driver("sec2", hdf5r::FileProfile(), channels, records);
+    hdf5r::FileProfile profile;
+    profile.write_behind(hdf5r::WriteBehind(4 * 1024 * 1024, 4, 4096, false,
+                false));
+    write_with_driver("write-behind thread", profile, channels, records);
+    if (hdf5r::have_io_uring())
+    {
+        profile.write_behind(hdf5r::WriteBehind(4 * 1024 * 1024, 4, 4096,
+                    false, true));
+        write_with_driver("write-behind io_uring", profile, channels,
+                records);
+        profile.write_behind(hdf5r::WriteBehind(4 * 1024 * 1024, 4, 4096,
+                    true, true));
+        write_with_driver("write-behind direct", profile, channels, records);
+    }
+    else
+    {
+        std::cout << "(io_uring is not available)\n";
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Logging service
+///////////////////////////////////////////////////////////////////////////////
+
+
+static char const* const BENCH_SERVICE = "hdf5r-benchmark";
+
+
+// Send records to the logging daemon as fast as possible, dropping those
+// that find the ring full
+static void log_client(size_t client, size_t records)
+{
+    hdf5r::LogClient log(BENCH_SERVICE);
+    hid_t mtype = make_pose_type(true);
+    hid_t ftype = make_pose_type(false);
+    std::ostringstream name;
+    name << "pose" << client;
+    hdf5r::LogChannel chan(log.add_channel(name.str(), "Pose", "benchmark",
+                mtype, ftype));
+    H5Tclose(ftype);
+    H5Tclose(mtype);
+    for (size_t ii(0); ii < records; ++ii)
+    {
+        Pose* pose(static_cast<Pose*>(log.reserve(chan, get_ns())));
+        if (pose != 0)
+        {
+            pose->x = ii;
+            pose->y = pose->z = pose->roll = pose->pitch = pose->yaw = 0;
+            log.commit();
+        }
+    }
+}
+
+
+// Time a daemon writing the records of several client processes
+static void log_with_clients(size_t clients, size_t records)
+{
+    uint64_t start(get_ns());
+    std::vector<hdf5r::LogClientStats> stats;
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+        f.durability(hdf5r::Durability(0, 1000));
+        hdf5r::LogDaemon daemon(f, BENCH_SERVICE);
+        size_t running(0);
+        for (size_t ii(0); ii < clients; ++ii)
+        {
+            pid_t pid(fork());
+            if (pid == 0)
+            {
+                // Leave the parent's file alone on the way out
+                try
+                {
+                    log_client(ii, records / clients);
+                }
+                catch (std::exception const& e)
+                {
+                    std::cerr << "Client failed: " << e.what() << '\n';
+                    _exit(1);
+                }
+                _exit(0);
+            }
+            else if (pid > 0)
+            {
+                ++running;
+            }
+        }
+        while (running > 0)
+        {
+            if (daemon.drain() == 0)
+            {
+                usleep(100);
+            }
+            while (running > 0 && waitpid(-1, 0, WNOHANG) > 0)
+            {
+                --running;
+            }
+        }
+        while (daemon.drain() > 0)
+        {
+        }
+        stats = daemon.client_stats();
+    }
+    double seconds((get_ns() - start) / 1e9);
+    uint64_t written(0), dropped(0);
+    for (size_t ii(0); ii < stats.size(); ++ii)
+    {
+        written += stats[ii].records;
+        dropped += stats[ii].dropped;
+    }
+    std::cout << std::setw(10) << clients << std::setw(14) << written <<
+        std::setw(14) << dropped << std::setw(14) << std::fixed <<
+        std::setprecision(0) << written / seconds << std::setw(10) <<
+        std::setprecision(1) << file_size(BENCH_FILE) / 1048576.0 / seconds <<
+        '\n';
+}
+
+
+void bench_logd()
+{
+    size_t const records(1000000);
+    std::cout << "Logging service (" << records << " pose records split "
+        "over the clients, sent as fast as possible)\n";
+    std::cout << std::setw(10) << "Clients" << std::setw(14) << "Written" <<
+        std::setw(14) << "Dropped" << std::setw(14) << "Records/s" <<
+        std::setw(10) << "MiB/s" << '\n';
+    for (size_t clients(1); clients <= 16; clients *= 2)
+    {
+        log_with_clients(clients, records);
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Aggregation
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Mean of the pose x field by reading whole records and adding them up
+double mean_by_hand(hdf5r::HDF5R& f, hdf5r::ChannelID chan, size_t records)
+{
+    std::vector<Pose> block(65536);
+    double sum(0);
+    for (size_t ii(0); ii < records; ii += block.size())
+    {
+        size_t got(f.get_entries(chan, ii, block.size(), 0, &block[0]));
+        for (size_t jj(0); jj < got; ++jj)
+        {
+            sum += block[jj].x;
+        }
+    }
+    return sum / records;
+}
+
+
+void print_aggregate_rate(std::string const& label, size_t records,
+        uint64_t elapsed)
+{
+    std::cout << std::setw(24) << label << std::setw(12) << std::fixed <<
+        std::setprecision(1) << elapsed / 1e6 << std::setw(14) <<
+        std::setprecision(0) << records / (elapsed / 1e9) << '\n';
+}
+
+
+void bench_aggregate()
+{
+    size_t const records(4000000);
+    std::cout << "Aggregation of the x field of " << records <<
+        " pose records (best instruction set available: " <<
+        hdf5r::simd_level() << ")\n";
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+        hid_t mtype = make_pose_type(true);
+        hid_t ftype = make_pose_type(false);
+        hdf5r::ChannelID chan = f.add_channel("pose", "Pose", "benchmark",
+                mtype, ftype);
+        std::vector<uint64_t> times(65536);
+        std::vector<Pose> poses(times.size());
+        uint64_t state(1);
+        for (size_t ii(0); ii < records; ii += times.size())
+        {
+            for (size_t jj(0); jj < times.size(); ++jj)
+            {
+                times[jj] = ii + jj;
+                poses[jj].x = next_random(state) % 100000 / 100.0;
+            }
+            f.add_entries(chan, std::min(times.size(), records - ii),
+                    &times[0], &poses[0]);
+        }
+        H5Tclose(ftype);
+        H5Tclose(mtype);
+    }
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY);
+    std::cout << std::setw(24) << "Query" << std::setw(12) << "ms" <<
+        std::setw(14) << "Records/s" << '\n';
+    uint64_t start(get_ns());
+    sink += static_cast<uint64_t>(mean_by_hand(f, 0, records));
+    print_aggregate_rate("mean, whole records", records, get_ns() - start);
+    char const* const levels[] = {"scalar", "avx2", "avx512"};
+    for (int level(hdf5r::SIMD_SCALAR); level <= hdf5r::simd_level();
+            ++level)
+    {
+        start = get_ns();
+        hdf5r::Aggregate agg(hdf5r::aggregate(f, 0, "x", 0, records,
+                    static_cast<hdf5r::SimdLevel>(level)));
+        sink += static_cast<uint64_t>(agg.mean());
+        print_aggregate_rate(std::string("aggregate, ") + levels[level],
+                records, get_ns() - start);
+    }
+    for (int level(hdf5r::SIMD_SCALAR); level <= hdf5r::simd_level();
+            ++level)
+    {
+        start = get_ns();
+        hdf5r::Histogram hist(0, 1000, 100);
+        hdf5r::histogram(f, 0, "x", 0, records, hist,
+                static_cast<hdf5r::SimdLevel>(level));
+        sink += hist.counts[0];
+        print_aggregate_rate(std::string("histogram, ") + levels[level],
+                records, get_ns() - start);
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Aggregation check
+///////////////////////////////////////////////////////////////////////////////
+
+
+// A channel whose records, as doubles, are known, for checking the
+// aggregation kernels against a plain loop over them
+struct CheckChannel
+{
+    std::string name;
+    std::string field;
+    hdf5r::ChannelID id;
+    // Record n's value, and its time stamp is n * CHECK_PERIOD
+    std::vector<double> values;
+};
+
+
+uint64_t const CHECK_PERIOD(10);
+
+
+hdf5r::Aggregate reference_aggregate(std::vector<double> const& values,
+        size_t first, size_t last)
+{
+    hdf5r::Aggregate agg;
+    for (size_t ii(first); ii < last; ++ii)
+    {
+        double x(values[ii]);
+        if (x == x)
+        {
+            ++agg.count;
+            agg.sum += x;
+            agg.min = std::min(agg.min, x);
+            agg.max = std::max(agg.max, x);
+        }
+    }
+    return agg;
+}
+
+
+void reference_histogram(std::vector<double> const& values, size_t first,
+        size_t last, hdf5r::Histogram& hist)
+{
+    size_t bins(hist.counts.size());
+    double scale(bins / (hist.high - hist.low));
+    for (size_t ii(first); ii < last; ++ii)
+    {
+        double x(values[ii]);
+        if (x != x)
+        {
+            continue;
+        }
+        if (x < hist.low)
+        {
+            ++hist.below;
+        }
+        else if (x >= hist.high)
+        {
+            ++hist.above;
+        }
+        else
+        {
+            ++hist.counts[std::min(static_cast<size_t>((x - hist.low) *
+                            scale), bins - 1)];
+        }
+    }
+}
+
+
+// Sums are accumulated in lanes, so may differ from the reference in the
+// last bits
+bool same_aggregate(hdf5r::Aggregate const& lhs, hdf5r::Aggregate const& rhs,
+        double magnitude)
+{
+    return lhs.count == rhs.count && lhs.min == rhs.min &&
+        lhs.max == rhs.max &&
+        std::abs(lhs.sum - rhs.sum) <= 1e-12 * magnitude;
+}
+
+
+// Check every instruction set against the reference over records
+// [first, last) of a channel, or the records with time stamps in the window
+// they span if window is set. Returns the number of mismatches.
+size_t check_range(hdf5r::HDF5R& f, CheckChannel const& chan, size_t first,
+        size_t last, size_t block_records, bool window)
+{
+    hdf5r::Aggregate want(reference_aggregate(chan.values, first, last));
+    double magnitude(0);
+    for (size_t ii(first); ii < last; ++ii)
+    {
+        if (chan.values[ii] == chan.values[ii])
+        {
+            magnitude += std::abs(chan.values[ii]);
+        }
+    }
+    hdf5r::Histogram want_hist(want.min + (want.max - want.min) / 3,
+            want.max - (want.max - want.min) / 4, 17);
+    if (!(want_hist.high > want_hist.low))
+    {
+        want_hist = hdf5r::Histogram(0, 1, 17);
+    }
+    reference_histogram(chan.values, first, last, want_hist);
+
+    // Windows end one tick after the last record's time stamp, and start one
+    // tick after the record before the first
+    uint64_t start(first == 0 ? 0 : (first - 1) * CHECK_PERIOD + 1);
+    uint64_t end(last == first ? start : (last - 1) * CHECK_PERIOD + 1);
+    size_t mismatches(0);
+    for (int level(hdf5r::SIMD_SCALAR); level <= hdf5r::simd_level();
+            ++level)
+    {
+        hdf5r::SimdLevel simd(static_cast<hdf5r::SimdLevel>(level));
+        hdf5r::Aggregate got(window ?
+                hdf5r::aggregate_window(f, chan.id, chan.field, start, end,
+                    simd, block_records) :
+                hdf5r::aggregate(f, chan.id, chan.field, first, last, simd,
+                    block_records));
+        hdf5r::Histogram hist(want_hist.low, want_hist.high,
+                want_hist.counts.size());
+        if (window)
+        {
+            hdf5r::histogram_window(f, chan.id, chan.field, start, end, hist,
+                    simd, block_records);
+        }
+        else
+        {
+            hdf5r::histogram(f, chan.id, chan.field, first, last, hist, simd,
+                    block_records);
+        }
+        bool same_hist(hist.counts == want_hist.counts &&
+                hist.below == want_hist.below &&
+                hist.above == want_hist.above);
+        if (!same_aggregate(got, want, magnitude) || !same_hist)
+        {
+            std::cout << std::setprecision(17) << "Mismatch: " <<
+                chan.name << " level " << level <<
+                (window ? " window " : " records ") << first << '-' << last <<
+                " blocks of " << block_records << ": count " << got.count <<
+                '/' << want.count << " sum " << got.sum << '/' << want.sum <<
+                " min " << got.min << '/' << want.min << " max " << got.max <<
+                '/' << want.max << (same_hist ? "" : ", histogram differs") <<
+                '\n';
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+
+// The value of record n of a check channel: random, with some NaN
+double check_value(uint64_t& state, size_t n)
+{
+    if (n % 17 == 5)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return static_cast<double>(next_random(state) % 200001) / 100.0 - 1000;
+}
+
+
+// Check the aggregation kernels of every instruction set the processor has
+// against a plain loop, over channels whose records are read in different
+// ways. Returns the number of mismatches.
+size_t check_aggregate()
+{
+    size_t const records(10007);
+    size_t const ring_capacity(1000);
+    size_t const ring_records(2503);
+    std::vector<CheckChannel> chans;
+    uint64_t state(7);
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+        hid_t mtype = make_pose_type(true);
+        hid_t ftype = make_pose_type(false);
+        CheckChannel pose = {"pose", "x", f.add_channel("pose", "Pose",
+                "check", mtype, ftype), std::vector<double>()};
+        CheckChannel value = {"double", "", f.add_channel("double",
+                "double", "check", H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE),
+            std::vector<double>()};
+        CheckChannel integer = {"int", "", f.add_channel("int", "int",
+                "check", H5T_NATIVE_INT, H5T_STD_I32LE),
+            std::vector<double>()};
+        CheckChannel ring = {"ring", "", f.add_ring_channel("ring", "double",
+                "check", H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE, ring_capacity),
+            std::vector<double>()};
+        // Columnar channels' fields are read from their own data sets,
+        // straight into the values if the record is a lone double
+        CheckChannel pose_columns = {"pose columns", "x",
+            f.add_columnar_channel("pose columns", "Pose", "check", mtype,
+                    ftype), std::vector<double>()};
+        hid_t single = H5Tcreate(H5T_COMPOUND, sizeof(double));
+        H5Tinsert(single, "x", 0, H5T_NATIVE_DOUBLE);
+        CheckChannel single_column = {"single column", "x",
+            f.add_columnar_channel("single column", "Single", "check",
+                    single, single), std::vector<double>()};
+        H5Tclose(single);
+        for (size_t ii(0); ii < records; ++ii)
+        {
+            Pose p = {check_value(state, ii), 1, 2, 3, 4, 5};
+            f.add_entry(pose.id, ii * CHECK_PERIOD, &p);
+            pose.values.push_back(p.x);
+            double x(check_value(state, ii));
+            f.add_entry(value.id, ii * CHECK_PERIOD, &x);
+            value.values.push_back(x);
+            int n(static_cast<int>(next_random(state) % 2001) - 1000);
+            f.add_entry(integer.id, ii * CHECK_PERIOD, &n);
+            integer.values.push_back(n);
+            p.x = check_value(state, ii);
+            f.add_entry(pose_columns.id, ii * CHECK_PERIOD, &p);
+            pose_columns.values.push_back(p.x);
+            x = check_value(state, ii);
+            f.add_entry(single_column.id, ii * CHECK_PERIOD, &x);
+            single_column.values.push_back(x);
+        }
+        // Only the last records written remain, wrapped around the end of
+        // the data sets
+        for (size_t ii(0); ii < ring_records; ++ii)
+        {
+            double x(check_value(state, ii));
+            f.add_entry(ring.id, ii * CHECK_PERIOD, &x);
+            ring.values.push_back(x);
+        }
+        ring.values.erase(ring.values.begin(),
+                ring.values.end() - ring_capacity);
+        chans.push_back(pose);
+        chans.push_back(value);
+        chans.push_back(integer);
+        chans.push_back(ring);
+        chans.push_back(pose_columns);
+        chans.push_back(single_column);
+        H5Tclose(ftype);
+        H5Tclose(mtype);
+    }
+
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY);
+    size_t const blocks[] = {1, 3, 7, 64, 1000, 65536};
+    size_t const num_blocks(sizeof(blocks) / sizeof(blocks[0]));
+    size_t mismatches(0), checks(0);
+    for (size_t ii(0); ii < chans.size(); ++ii)
+    {
+        CheckChannel const& chan(chans[ii]);
+        size_t size(chan.values.size());
+        for (size_t jj(0); jj < num_blocks; ++jj)
+        {
+            // Whole channels, and short ranges with ragged ends
+            mismatches += check_range(f, chan, 0, size, blocks[jj], false);
+            mismatches += check_range(f, chan, jj, jj + 2 * jj + 1,
+                    blocks[jj], false);
+            checks += 2;
+        }
+        mismatches += check_range(f, chan, 3, 3, 7, false);
+        ++checks;
+        for (size_t jj(0); jj < 20; ++jj)
+        {
+            size_t first(next_random(state) % size);
+            size_t last(first + next_random(state) % (size - first + 1));
+            // A ring channel's time stamps don't start at zero
+            bool window(chan.name != "ring");
+            mismatches += check_range(f, chan, first, last,
+                    blocks[jj % num_blocks], window && jj % 2 == 0);
+            ++checks;
+        }
+    }
+    std::cout << "Aggregation check: " << checks << " ranges of " <<
+        chans.size() << " channels at " << hdf5r::simd_level() + 1 <<
+        " instruction sets, " << mismatches << " mismatches\n";
+    std::remove(BENCH_FILE);
+    return mismatches;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Export check
+///////////////////////////////////////////////////////////////////////////////
+
+
+static char const* const EXPORT_DIR = "benchmark_export";
+
+
+// Records with a field named like the exported time stamps
+struct Stamped
+{
+    uint64_t timestamp;
+    double v;
+};
+
+
+std::string read_export(std::string const& name)
+{
+    std::ifstream in((std::string(EXPORT_DIR) + '/' + name).c_str(),
+            std::ios::binary);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+
+// Compare an exported binary file with the values it should hold
+size_t check_export_file(std::string const& name,
+        std::vector<uint64_t> const& expected)
+{
+    std::string contents(read_export(name));
+    if (contents.size() == expected.size() * sizeof(uint64_t) &&
+            (expected.empty() || memcmp(contents.data(), &expected[0],
+                contents.size()) == 0))
+    {
+        return 0;
+    }
+    std::cout << "  " << name << ": " << contents.size() <<
+        " bytes differ from the " << expected.size() << " values expected\n";
+    return 1;
+}
+
+
+size_t check_export_header(std::string const& name,
+        std::string const& expected)
+{
+    std::string contents(read_export(name));
+    std::string header(contents.substr(0, contents.find('\n')));
+    if (header == expected)
+    {
+        return 0;
+    }
+    std::cout << "  " << name << ": header " << header << ", expected " <<
+        expected << '\n';
+    return 1;
+}
+
+
+// Check that channels with fields named like the time stamps export them
+// to files and columns of their own. Returns the number of mismatches.
+size_t check_export()
+{
+    size_t const records(1000);
+    std::vector<uint64_t> times, fields, values;
+    {
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+        hid_t stamped = H5Tcreate(H5T_COMPOUND, sizeof(Stamped));
+        H5Tinsert(stamped, "timestamp", HOFFSET(Stamped, timestamp),
+                H5T_NATIVE_UINT64);
+        H5Tinsert(stamped, "v", HOFFSET(Stamped, v), H5T_NATIVE_DOUBLE);
+        hdf5r::ChannelID imu(f.add_channel("imu", "Stamped", "check",
+                    stamped, stamped));
+        H5Tclose(stamped);
+        // Both names taken, so the time stamps go to a third
+        hid_t both = H5Tcreate(H5T_COMPOUND, 2 * sizeof(uint64_t));
+        H5Tinsert(both, "timestamp", 0, H5T_NATIVE_UINT64);
+        H5Tinsert(both, "_timestamp", sizeof(uint64_t), H5T_NATIVE_UINT64);
+        hdf5r::ChannelID twice(f.add_channel("twice", "Twice", "check",
+                    both, both));
+        H5Tclose(both);
+        for (size_t ii(0); ii < records; ++ii)
+        {
+            Stamped rec = {1000000 + ii, ii * 0.5};
+            uint64_t time(ii * CHECK_PERIOD + 3);
+            f.add_entry(imu, time, &rec);
+            uint64_t pair[2] = {rec.timestamp, ii};
+            f.add_entry(twice, time, pair);
+            times.push_back(time);
+            fields.push_back(rec.timestamp);
+            uint64_t bits;
+            memcpy(&bits, &rec.v, sizeof(bits));
+            values.push_back(bits);
+        }
+    }
+
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY);
+    hdf5r::ExportStats stats(hdf5r::export_channels(f, EXPORT_DIR));
+    std::vector<uint64_t> counts;
+    for (size_t ii(0); ii < records; ++ii)
+    {
+        counts.push_back(ii);
+    }
+    size_t mismatches(0);
+    mismatches += check_export_file("imu._timestamp.bin", times);
+    mismatches += check_export_file("imu.timestamp.bin", fields);
+    mismatches += check_export_file("imu.v.bin", values);
+    mismatches += check_export_file("twice.__timestamp.bin", times);
+    mismatches += check_export_file("twice.timestamp.bin", fields);
+    mismatches += check_export_file("twice._timestamp.bin", counts);
+    if (stats.bytes_written != 6 * records * sizeof(uint64_t))
+    {
+        std::cout << "  " << stats.bytes_written << " bytes written\n";
+        ++mismatches;
+    }
+    if (read_export("schema.json").find("\"imu._timestamp.bin\"") ==
+            std::string::npos)
+    {
+        std::cout << "  schema.json doesn't list imu._timestamp.bin\n";
+        ++mismatches;
+    }
+    hdf5r::ExportOptions csv;
+    csv.format(hdf5r::EXPORT_CSV);
+    hdf5r::export_channels(f, EXPORT_DIR, csv);
+    mismatches += check_export_header("imu.csv", "_timestamp,timestamp,v");
+    mismatches += check_export_header("twice.csv",
+            "__timestamp,timestamp,_timestamp");
+    std::cout << "Export check: 2 channels in binary and CSV, " <<
+        mismatches << " mismatches\n";
+
+    char const* const outputs[] = {"imu._timestamp.bin", "imu.timestamp.bin",
+        "imu.v.bin", "twice.__timestamp.bin", "twice.timestamp.bin",
+        "twice._timestamp.bin", "schema.json", "imu.csv", "twice.csv"};
+    for (size_t ii(0); ii < sizeof(outputs) / sizeof(outputs[0]); ++ii)
+    {
+        std::remove((std::string(EXPORT_DIR) + '/' + outputs[ii]).c_str());
+    }
+    rmdir(EXPORT_DIR);
+    std::remove(BENCH_FILE);
+    return mismatches;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Columnar channels
+///////////////////////////////////////////////////////////////////////////////
+
+
+size_t const WIDE_FIELDS(40);
+
+// A wide message type, such as a robot's joint state
+struct Wide
+{
+    double values[WIDE_FIELDS];
+};
+
+
+hid_t make_wide_type()
+{
+    hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(Wide));
+    for (size_t ii(0); ii < WIDE_FIELDS; ++ii)
+    {
+        std::ostringstream name;
+        name << 'v' << ii;
+        H5Tinsert(type, name.str().c_str(), HOFFSET(Wide, values) +
+                ii * sizeof(double), H5T_NATIVE_DOUBLE);
+    }
+    return type;
+}
+
+
+// Bytes this process has read from files, including from the page cache
+uint64_t bytes_read()
+{
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value(0);
+    while (io >> key >> value)
+    {
+        if (key == "rchar:")
+        {
+            return value;
+        }
+    }
+    return 0;
+}
+
+
+void print_columnar_row(std::string const& label, size_t records,
+        uint64_t elapsed, uint64_t bytes)
+{
+    std::cout << std::setw(28) << std::left << label << std::right <<
+        std::setw(14) << std::fixed << std::setprecision(0) <<
+        records / (elapsed / 1e9) << std::setw(12) <<
+        std::setprecision(1) << bytes / 1048576.0 << '\n';
+}
+
+
+void bench_columnar()
+{
+    size_t const records(500000);
+    size_t const block(4096);
+    std::cout << "Row and columnar channels (" << records << " records of " <<
+        WIDE_FIELDS << " doubles)\n";
+    std::cout << std::setw(28) << std::left << "Operation" << std::right <<
+        std::setw(14) << "Records/s" << std::setw(12) << "MiB read" << '\n';
+    hid_t type = make_wide_type();
+    std::vector<Wide> recs(block);
+    std::vector<uint64_t> times(block);
+    std::vector<std::string> field(1, "v7");
+    for (int columnar(0); columnar < 2; ++columnar)
+    {
+        std::string kind(columnar ? "columnar" : "row");
+        uint64_t start(get_ns());
+        {
+            hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+            hdf5r::ChannelID chan = columnar ?
+                f.add_columnar_channel("wide", "Wide", "benchmark", type,
+                        type) :
+                f.add_channel("wide", "Wide", "benchmark", type, type);
+            for (size_t ii(0); ii < records; ii += block)
+            {
+                for (size_t jj(0); jj < block; ++jj)
+                {
+                    times[jj] = ii + jj;
+                    for (size_t kk(0); kk < WIDE_FIELDS; ++kk)
+                    {
+                        recs[jj].values[kk] = ii + jj + kk;
+                    }
+                }
+                f.add_entries(chan, std::min(block, records - ii), &times[0],
+                        &recs[0]);
+            }
+        }
+        print_columnar_row(kind + ", write", records, get_ns() - start, 0);
+
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY);
+        uint64_t bytes(bytes_read());
+        start = get_ns();
+        for (size_t ii(0); ii < records; ii += block)
+        {
+            sink += f.get_entries(0, ii, block, &times[0], &recs[0]);
+        }
+        print_columnar_row(kind + ", whole records", records,
+                get_ns() - start, bytes_read() - bytes);
+
+        bytes = bytes_read();
+        start = get_ns();
+        for (size_t ii(0); ii < records; ii += block)
+        {
+            sink += f.get_fields(0, ii, block, field, 0, &recs[0]);
+        }
+        print_columnar_row(kind + ", one field", records, get_ns() - start,
+                bytes_read() - bytes);
+
+        bytes = bytes_read();
+        start = get_ns();
+        sink += static_cast<uint64_t>(hdf5r::aggregate(f, 0, "v7", 0,
+                    records).mean());
+        print_columnar_row(kind + ", aggregate one field", records,
+                get_ns() - start, bytes_read() - bytes);
+    }
+    H5Tclose(type);
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Catalog
+///////////////////////////////////////////////////////////////////////////////
+
+
+static char const* const CATALOG_DIR = "benchmark_logs";
+static char const* const CATALOG_FILE = "benchmark.catalog";
+
+
+std::string catalog_log_name(size_t log)
+{
+    std::ostringstream name;
+    name << CATALOG_DIR << "/log" << log << ".h5";
+    return name.str();
+}
+
+
+// Count the logs with records of a channel in [start, end) by opening each
+size_t find_by_opening(size_t logs, std::string const& channel,
+        uint64_t start, uint64_t end)
+{
+    size_t found(0);
+    for (size_t ii(0); ii < logs; ++ii)
+    {
+        hdf5r::HDF5R f(catalog_log_name(ii), hdf5r::RDONLY);
+        if (!f.have_channel(channel))
+        {
+            continue;
+        }
+        hdf5r::ChannelInfo info(f.get_channel_info(
+                    f.get_channel_id(channel)));
+        if (info.size() > 0 && info.start_time() < end &&
+                info.end_time() >= start)
+        {
+            ++found;
+        }
+    }
+    return found;
+}
+
+
+void bench_catalog()
+{
+    size_t const logs(1000);
+    size_t const channels(8);
+    size_t const records(100);
+    std::cout << "Catalog of " << logs << " files of " << channels <<
+        " channels\n";
+    mkdir(CATALOG_DIR, 0755);
+    hid_t mtype = make_pose_type(true);
+    hid_t ftype = make_pose_type(false);
+    std::vector<Pose> poses(records);
+    std::vector<uint64_t> times(records);
+    for (size_t ii(0); ii < logs; ++ii)
+    {
+        hdf5r::HDF5R f(catalog_log_name(ii), hdf5r::TRUNCATE);
+        for (size_t jj(0); jj < channels; ++jj)
+        {
+            std::ostringstream name;
+            name << "pose" << jj;
+            hdf5r::ChannelID chan = f.add_channel(name.str(), "Pose",
+                    "benchmark", mtype, ftype);
+            for (size_t kk(0); kk < records; ++kk)
+            {
+                times[kk] = ii * 1000 + kk;
+            }
+            f.add_entries(chan, records, &times[0], &poses[0]);
+        }
+        f.set_text_tag("robot", ii % 2 ? "a" : "b");
+    }
+    H5Tclose(ftype);
+    H5Tclose(mtype);
+
+    std::cout << std::setw(32) << std::left << "Operation" << std::right <<
+        std::setw(12) << "ms" << '\n';
+    {
+        hdf5r::Catalog catalog;
+        uint64_t start(get_ns());
+        catalog.update(CATALOG_DIR);
+        catalog.save(CATALOG_FILE);
+        std::cout << std::setw(32) << std::left << "build" << std::right <<
+            std::setw(12) << std::fixed << std::setprecision(1) <<
+            (get_ns() - start) / 1e6 << '\n';
+        start = get_ns();
+        catalog.update(CATALOG_DIR);
+        catalog.save(CATALOG_FILE);
+        std::cout << std::setw(32) << std::left << "update, none changed" <<
+            std::right << std::setw(12) << (get_ns() - start) / 1e6 <<
+            '\n';
+    }
+    uint64_t start(get_ns());
+    hdf5r::Catalog catalog;
+    catalog.load(CATALOG_FILE);
+    sink += catalog.find("pose3", 500000, 600000).size();
+    std::cout << std::setw(32) << std::left << "query, catalog" <<
+        std::right << std::setw(12) << (get_ns() - start) / 1e6 << '\n';
+    start = get_ns();
+    sink += find_by_opening(logs, "pose3", 500000, 600000);
+    std::cout << std::setw(32) << std::left << "query, opening each file" <<
+        std::right << std::setw(12) << (get_ns() - start) / 1e6 << '\n';
+    std::cout << "Catalog is " << file_size(CATALOG_FILE) << " bytes\n\n";
+
+    for (size_t ii(0); ii < logs; ++ii)
+    {
+        std::remove(catalog_log_name(ii).c_str());
+    }
+    rmdir(CATALOG_DIR);
+    std::remove(CATALOG_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixed-rate channels
+///////////////////////////////////////////////////////////////////////////////
+
+
+void bench_fixed_rate()
+{
+    size_t const records(2000000);
+    size_t const seeks(100000);
+    uint64_t const period(1000);
+    std::cout << "Time stamped and fixed-rate channels (" << records <<
+        " double records, one sample in 1000 dropped)\n";
+    std::cout << std::setw(12) << std::left << "Channel" << std::right <<
+        std::setw(14) << "add_entry/s" << std::setw(14) << "Seeks/s" <<
+        std::setw(14) << "Reads/s" << std::setw(10) << "MiB" << '\n';
+    for (int fixed(0); fixed < 2; ++fixed)
+    {
+        uint64_t state(1);
+        uint64_t start(get_ns());
+        uint64_t last(0);
+        {
+            hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+            hdf5r::ChannelID chan = fixed ?
+                f.add_fixed_rate_channel("imu", "double", "benchmark",
+                        H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE, period) :
+                f.add_channel("imu", "double", "benchmark",
+                        H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE);
+            uint64_t time(0);
+            for (size_t ii(0); ii < records; ++ii)
+            {
+                if (next_random(state) % 1000 == 0)
+                {
+                    time += period;
+                }
+                double value(ii);
+                f.add_entry(chan, time, &value);
+                last = time;
+                time += period;
+            }
+        }
+        double write_rate(records / ((get_ns() - start) / 1e9));
+
+        hdf5r::HDF5R f(BENCH_FILE, hdf5r::RDONLY);
+        start = get_ns();
+        for (size_t ii(0); ii < seeks; ++ii)
+        {
+            sink += f.find_entry(0, next_random(state) % last);
+        }
+        double seek_rate(seeks / ((get_ns() - start) / 1e9));
+        std::vector<uint64_t> times(65536);
+        std::vector<double> values(times.size());
+        start = get_ns();
+        for (size_t ii(0); ii < records; ii += times.size())
+        {
+            sink += f.get_entries(0, ii, times.size(), &times[0], &values[0]);
+        }
+        double read_rate(records / ((get_ns() - start) / 1e9));
+        std::cout << std::setw(12) << std::left <<
+            (fixed ? "fixed-rate" : "time stamped") << std::right <<
+            std::fixed << std::setprecision(0) << std::setw(14) <<
+            write_rate << std::setw(14) << seek_rate << std::setw(14) <<
+            read_rate << std::setw(10) << std::setprecision(1) <<
+            file_size(BENCH_FILE) / 1048576.0 << '\n';
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Multi-channel frames
+///////////////////////////////////////////////////////////////////////////////
+
+
+size_t const IMAGE_BYTES(4096);
+
+
+// Write a stereo pair and a pose per frame, as separate records or as frames,
+// and return the achieved rate in frames per second
+double write_frames(bool as_frames, hdf5r::Durability const& policy,
+        size_t frames)
+{
+    hdf5r::HDF5R f(BENCH_FILE, hdf5r::TRUNCATE);
+    f.durability(policy);
+    hsize_t dims[1] = {IMAGE_BYTES};
+    hid_t image = H5Tarray_create(H5T_NATIVE_UINT8, 1, dims);
+    hid_t mtype = make_pose_type(true);
+    hid_t ftype = make_pose_type(false);
+    hdf5r::ChannelID left = f.add_channel("left", "Image", "benchmark",
+            image, image);
+    hdf5r::ChannelID right = f.add_channel("right", "Image", "benchmark",
+            image, image);
+    hdf5r::ChannelID imu = f.add_channel("imu", "Pose", "benchmark", mtype,
+            ftype);
+    std::vector<unsigned char> pixels(IMAGE_BYTES, 0);
+    Pose pose = {0, 0, 0, 0, 0, 0};
+    hdf5r::Frame frame;
+    frame.push_back(std::make_pair(left, (void const*)&pixels[0]));
+    frame.push_back(std::make_pair(right, (void const*)&pixels[0]));
+    frame.push_back(std::make_pair(imu, (void const*)&pose));
+    uint64_t start(get_ns());
+    for (size_t ii(0); ii < frames; ++ii)
+    {
+        pose.x = ii;
+        if (as_frames)
+        {
+            f.add_frame(ii, frame);
+        }
+        else
+        {
+            f.add_entry(left, ii, &pixels[0]);
+            f.add_entry(right, ii, &pixels[0]);
+            f.add_entry(imu, ii, &pose);
+        }
+    }
+    f.checkpoint();
+    uint64_t elapsed(get_ns() - start);
+    sink += f.index().entry(frames / 2).size();
+    H5Tclose(ftype);
+    H5Tclose(mtype);
+    H5Tclose(image);
+    return frames / (elapsed / 1e9);
+}
+
+
+void bench_frame()
+{
+    size_t const frames(20000);
+    std::cout << "Frames of three channels (" << frames << " frames of two " <<
+        IMAGE_BYTES << " byte images and a pose)\n";
+    std::cout << std::setw(24) << std::left << "Policy" <<
+        std::setw(16) << std::right << "add_entry/s" <<
+        std::setw(16) << "add_frame/s" << std::setw(12) << "Relative" <<
+        '\n';
+    size_t const counts[] = {0, 1000, 100};
+    for (size_t ii(0); ii < sizeof(counts) / sizeof(counts[0]); ++ii)
+    {
+        std::ostringstream label;
+        if (counts[ii] == 0)
+        {
+            label << "close only";
+        }
+        else
+        {
+            label << "every " << counts[ii] << " records";
+        }
+        // Best of several interleaved runs, as the first write of a file
+        // is slowed by the file system reclaiming the last one
+        hdf5r::Durability policy(counts[ii]);
+        double entries(0), whole(0);
+        for (int run(0); run < 3; ++run)
+        {
+            entries = std::max(entries, write_frames(false, policy, frames));
+            whole = std::max(whole, write_frames(true, policy, frames));
+        }
+        std::cout << std::setw(24) << std::left << label.str() <<
+            std::right << std::fixed << std::setprecision(0) <<
+            std::setw(16) << entries << std::setw(16) << whole <<
+            std::setw(12) << std::setprecision(2) << whole / entries << '\n';
+    }
+    std::cout << '\n';
+    std::remove(BENCH_FILE);
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string which(argc > 1 ? argv[1] : "all");
+    // The library probes for optional objects; don't report those misses
+    H5Eset_auto(H5E_DEFAULT, 0, 0);
+    bool ran(false);
+    if (which == "all" || which == "checkpoint")
+    {
+        bench_checkpoint();
+        ran = true;
+    }
+    if (which == "all" || which == "index")
+    {
+        bench_index();
+        ran = true;
+    }
+    if (which == "all" || which == "profile")
+    {
+        bench_profile();
+        ran = true;
+    }
+    if (which == "all" || which == "random")
+    {
+        bench_random();
+        ran = true;
+    }
+    if (which == "all" || which == "channels")
+    {
+        bench_channels();
+        ran = true;
+    }
+    if (which == "all" || which == "steady")
+    {
+        if (!bench_steady())
+        {
+            return 1;
+        }
+        ran = true;
+    }
+    if (which == "all" || which == "driver")
+    {
+        bench_driver();
+        ran = true;
+    }
+    if (which == "all" || which == "logd")
+    {
+        bench_logd();
+        ran = true;
+    }
+    if (which == "all" || which == "aggregate")
+    {
+        bench_aggregate();
+        ran = true;
+    }
+    if (which == "all" || which == "columnar")
+    {
+        bench_columnar();
+        ran = true;
+    }
+    if (which == "all" || which == "catalog")
+    {
+        bench_catalog();
+        ran = true;
+    }
+    if (which == "all" || which == "fixed")
+    {
+        bench_fixed_rate();
+        ran = true;
+    }
+    if (which == "all" || which == "frame")
+    {
+        bench_frame();
+        ran = true;
+    }
+    // Not a benchmark, so not part of all of them
+    if (which == "check")
+    {
+        size_t mismatches(check_aggregate());
+        mismatches += check_export();
+        return mismatches == 0 ? 0 : 1;
+    }
+    if (!ran)
+    {
+        std::cerr << "Unknown benchmark: " << which << '\n';
+        return 1;
+    }
+    return 0;
+}
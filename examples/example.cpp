@@ -98,19 +98,19 @@ struct print_chan_data_fun
 };
 
 
-struct print_index_fun
+void print_index(hdf5r::IndexView const& index)
 {
-    void operator()(std::pair<const uint64_t, hdf5r::IndexPointerList>& entry)
+    for (size_t ii(0); ii < index.size(); ++ii)
     {
-        hdf5r::IndexPointerList list = entry.second;
-        std::cout << entry.first << "ns: ";
-        for (hdf5r::IndexPointerList::const_iterator ii(list.begin());
-                ii != list.end(); ++ii)
+        // Records sharing a time stamp are adjacent
+        if (ii == 0 || index.timestamp(ii) != index.timestamp(ii - 1))
         {
-            std::cout << '\t' << ii->first << '[' << ii->second << "]\n";
+            std::cout << index.timestamp(ii) << "ns: ";
         }
+        std::cout << '\t' << index.channel(ii) << '[' << index.record(ii) <<
+            "]\n";
     }
-};
+}
 
 
 uint64_t get_ts()
@@ -204,8 +204,7 @@ void round_two()
 
     // Print out the index
     std::cout << "Index:\n";
-    hdf5r::Index index = f.index();
-    std::for_each(index.begin(), index.end(), print_index_fun());
+    print_index(f.index());
 }
 
 
@@ -0,0 +1,101 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Aggregates of numeric fields over ranges of a channel's records.
+ */
+
+
+#if !defined(HDF5R_AGGREGATE_H__)
+#define HDF5R_AGGREGATE_H__
+
+
+#include <hdf5r/hdf5r.h>
+#include <string>
+#include <vector>
+
+
+namespace hdf5r
+{
+    // Instruction sets the aggregation kernels may use
+    typedef enum { SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512 } SimdLevel;
+
+    // The best instruction set the processor supports
+    SimdLevel simd_level();
+
+
+    // Count, sum, minimum and maximum of a field's values. NaN values are
+    // left out. The sum is accumulated in several lanes at once, so it may
+    // differ in the last bits from adding the values in order.
+    class Aggregate
+    {
+        public:
+            Aggregate();
+
+            double mean() const;
+
+            uint64_t count;
+            double sum;
+            double min;
+            double max;
+    };
+
+
+    // Counts of a field's values in bins of equal width over [low, high).
+    // Values below low or at or above high are counted separately, and NaN
+    // values are left out.
+    class Histogram
+    {
+        public:
+            Histogram(double low=0, double high=1, size_t bins=10);
+
+            double bin_width() const
+                { return (high - low) / counts.size(); }
+
+            double low;
+            double high;
+            std::vector<uint64_t> counts;
+            uint64_t below;
+            uint64_t above;
+    };
+
+
+    // The field is given as a path of member names separated by dots, such
+    // as "pose.x", and must be an integer or floating point value; an empty
+    // field means the channel's records themselves. Values are converted to
+    // double as they are read, block_records records at a time, so the range
+    // is never held in memory whole. max_level limits the instruction set
+    // used, below what the processor supports.
+
+    // Aggregate a field over the records [first, last)
+    Aggregate aggregate(HDF5R& file, ChannelID chan, std::string const& field,
+            hsize_t first, hsize_t last, SimdLevel max_level=SIMD_AVX512,
+            size_t block_records=65536);
+    // Aggregate a field over the records with time stamps in [start, end).
+    // The channel's records must be in time order.
+    Aggregate aggregate_window(HDF5R& file, ChannelID chan,
+            std::string const& field, uint64_t start, uint64_t end,
+            SimdLevel max_level=SIMD_AVX512, size_t block_records=65536);
+
+    // Add the values of a field over the records [first, last) to hist
+    void histogram(HDF5R& file, ChannelID chan, std::string const& field,
+            hsize_t first, hsize_t last, Histogram& hist,
+            SimdLevel max_level=SIMD_AVX512, size_t block_records=65536);
+    // Add the values of a field over the records with time stamps in
+    // [start, end) to hist
+    void histogram_window(HDF5R& file, ChannelID chan,
+            std::string const& field, uint64_t start, uint64_t end,
+            Histogram& hist, SimdLevel max_level=SIMD_AVX512,
+            size_t block_records=65536);
+};
+
+#endif // !defined(HDF5R_AGGREGATE_H__)
+
@@ -0,0 +1,96 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Alignment of several channels to a common timeline.
+ */
+
+
+#if !defined(HDF5R_ALIGN_H__)
+#define HDF5R_ALIGN_H__
+
+
+#include <hdf5r/hdf5r.h>
+#include <vector>
+
+
+namespace hdf5r
+{
+    // SAMPLE_AND_HOLD gives each channel's latest record at or before each
+    // time. LINEAR interpolates the integer and floating point fields of
+    // records between the records either side of each time, and holds the
+    // other fields; after a channel's last record it holds that record.
+    typedef enum { SAMPLE_AND_HOLD, LINEAR } Interpolation;
+
+
+    // Records of several channels at common times, one column per channel.
+    // Column ii holds a record of channel ii in its memory type for each
+    // time. Where a channel had no record yet, the record is zero-filled and
+    // valid is zero.
+    class AlignedRecords
+    {
+        public:
+            void const* record(size_t column, size_t index) const
+                { return &columns[column][index * record_sizes[column]]; }
+
+            std::vector<uint64_t> times;
+            std::vector<size_t> record_sizes;
+            std::vector<std::vector<char> > columns;
+            std::vector<std::vector<unsigned char> > valid;
+    };
+
+
+    struct AlignCursor;
+
+
+    // Aligns channels to a timeline given a block of times at a time. Each
+    // channel is read forwards in blocks of block_records, so the cost is
+    // in proportion to the records passed over rather than to the number of
+    // times. Gaps in the timeline longer than a block are skipped with a
+    // binary search. The times must not decrease, within a call or from one
+    // call to the next, and each channel's records must be in time order.
+    class Aligner
+    {
+        public:
+            Aligner(HDF5R& file, std::vector<ChannelID> const& channels,
+                    Interpolation interpolation=SAMPLE_AND_HOLD,
+                    size_t block_records=65536);
+            ~Aligner();
+
+            // Align the channels at count times, replacing the contents of
+            // out
+            void align(uint64_t const* times, size_t count,
+                    AlignedRecords& out);
+
+        private:
+            HDF5R& file_;
+            Interpolation interpolation_;
+            size_t block_records_;
+            std::vector<AlignCursor*> cursors_;
+
+            Aligner(Aligner const&);
+            Aligner& operator=(Aligner const&);
+    };
+
+
+    // Align channels to the times start, start + period, ... before end
+    AlignedRecords align_fixed_rate(HDF5R& file,
+            std::vector<ChannelID> const& channels, uint64_t start,
+            uint64_t period, uint64_t end,
+            Interpolation interpolation=SAMPLE_AND_HOLD);
+    // Align channels to the time stamps of another channel's records
+    AlignedRecords align_to_channel(HDF5R& file,
+            std::vector<ChannelID> const& channels, ChannelID timeline,
+            Interpolation interpolation=SAMPLE_AND_HOLD);
+};
+
+#endif // !defined(HDF5R_ALIGN_H__)
+
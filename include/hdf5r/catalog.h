@@ -0,0 +1,169 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Catalog of the contents of many files.
+ */
+
+
+#if !defined(HDF5R_CATALOG_H__)
+#define HDF5R_CATALOG_H__
+
+
+#include <hdf5r/hdf5r.h>
+#include <string>
+#include <vector>
+
+
+namespace hdf5r
+{
+    // Longest text tag value kept in a catalog
+    static size_t const CATALOG_TAG_VALUE_BYTES = 256;
+
+
+    class CatalogChannel
+    {
+        public:
+            CatalogChannel()
+                : size(0), start_time(0), end_time(0)
+            {}
+
+            std::string name;
+            std::string type_name;
+            std::string source_name;
+            uint64_t size;
+            // Time stamps of the first and last records
+            uint64_t start_time;
+            uint64_t end_time;
+    };
+
+
+    // A tag of a catalogued file. Binary values, and text values longer
+    // than CATALOG_TAG_VALUE_BYTES, are left out and only their sizes kept.
+    class CatalogTag
+    {
+        public:
+            CatalogTag()
+                : type(STRING_TAG), size(0)
+            {}
+
+            bool has_value() const
+            {
+                return type == STRING_TAG && value.size() == size;
+            }
+
+            TagType type;
+            // Bytes in the value, not counting a text value's terminator
+            uint64_t size;
+            std::string value;
+    };
+    typedef std::map<std::string, CatalogTag> CatalogTagMap;
+
+
+    class CatalogFile
+    {
+        public:
+            CatalogFile()
+                : bytes(0), mtime(0), start_time(0), end_time(0)
+            {}
+
+            std::string path;
+            // Size and modification time, in nanoseconds since the epoch,
+            // when the file was scanned
+            uint64_t bytes;
+            uint64_t mtime;
+            std::vector<CatalogChannel> channels;
+            CatalogTagMap tags;
+            // Earliest and latest time stamps of the channels with records
+            uint64_t start_time;
+            uint64_t end_time;
+    };
+
+
+    // A channel of a catalogued file that a query found
+    class CatalogMatch
+    {
+        public:
+            CatalogMatch(std::string const& path, CatalogChannel const& chan)
+                : path(path), channel(chan)
+            {}
+
+            std::string path;
+            CatalogChannel channel;
+    };
+
+
+    class CatalogStats
+    {
+        public:
+            CatalogStats()
+                : files(0), scanned(0), unchanged(0), removed(0), failed(0),
+                seconds(0)
+            {}
+
+            // Files found under the root
+            uint64_t files;
+            // Files read because they were new or had changed since they
+            // were last scanned
+            uint64_t scanned;
+            uint64_t unchanged;
+            // Files in the catalog that are no longer under the root
+            uint64_t removed;
+            // Files that could not be read, with the reasons; they are left
+            // out of the catalog
+            uint64_t failed;
+            std::vector<std::string> errors;
+            double seconds;
+    };
+
+
+    // The channels, time bounds, record counts and tags of many files, kept
+    // in a file of its own so that finding which files hold what doesn't
+    // mean opening them all. A channel's time bounds are those of its first
+    // and last records, so queries assume its records are in time order.
+    class Catalog
+    {
+        public:
+            Catalog();
+
+            // Replace the catalog's contents with those saved in a file
+            void load(std::string const& path);
+            // Save the catalog to a file, replacing it whole once written
+            void save(std::string const& path) const;
+
+            // Bring the catalog up to date with the files under root (or
+            // root itself, if it is a file) whose names end in suffix.
+            // Files are read again only if their size or modification time
+            // has changed. They are read by up to workers processes at once,
+            // or one per processor if workers is zero.
+            CatalogStats update(std::string const& root,
+                    std::string const& suffix=".h5", unsigned int workers=0);
+
+            // Catalogued files in order of path
+            std::vector<CatalogFile> const& files() const { return files_; }
+
+            // Channels with records in the time window [start, end), of the
+            // given name or of any name if it is empty
+            std::vector<CatalogMatch> find(std::string const& channel,
+                    uint64_t start=0,
+                    uint64_t end=static_cast<uint64_t>(-1)) const;
+            // Files holding a tag, of the given value if it is not empty.
+            // Only the text values that were kept are matched.
+            std::vector<std::string> find_tag(std::string const& tag,
+                    std::string const& value=std::string()) const;
+
+        private:
+            std::vector<CatalogFile> files_;
+    };
+};
+
+#endif // !defined(HDF5R_CATALOG_H__)
+
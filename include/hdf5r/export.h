@@ -0,0 +1,109 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Export of channels to flat files for other tools.
+ */
+
+
+#if !defined(HDF5R_EXPORT_H__)
+#define HDF5R_EXPORT_H__
+
+
+#include <hdf5r/hdf5r.h>
+#include <string>
+#include <vector>
+
+
+namespace hdf5r
+{
+    // BINARY writes one file per field of each channel, plus one for its time
+    // stamps, holding the values packed one after another in native byte
+    // order, and a schema.json describing them. CSV writes one file per
+    // channel with a header row. The time stamps are named "timestamp", or
+    // "_timestamp" and so on if a field is already named that.
+    typedef enum { EXPORT_BINARY, EXPORT_CSV } ExportFormat;
+
+
+    class ExportOptions
+    {
+        public:
+            ExportOptions()
+                : format_(EXPORT_BINARY), start_(0),
+                end_(static_cast<uint64_t>(-1)), threads_(0),
+                block_records_(65536), max_blocks_(8)
+            {}
+
+            void format(ExportFormat format) { format_ = format; }
+            ExportFormat format() const { return format_; }
+            // The channels to export, by name. Empty to export all of them.
+            void channels(std::vector<std::string> const& channels)
+                { channels_ = channels; }
+            std::vector<std::string> const& channels() const
+                { return channels_; }
+            // Only records with time stamps in [start, end) are exported
+            void window(uint64_t start, uint64_t end)
+                { start_ = start; end_ = end; }
+            uint64_t start() const { return start_; }
+            uint64_t end() const { return end_; }
+            // Threads converting records, zero for one per processor. One
+            // more thread reads the file and another writes the output.
+            void threads(unsigned int threads) { threads_ = threads; }
+            unsigned int threads() const { return threads_; }
+            // Records are read, converted and written in blocks of this many.
+            // At most max_blocks blocks are in memory at once.
+            void block_records(size_t block_records)
+                { block_records_ = block_records; }
+            size_t block_records() const { return block_records_; }
+            void max_blocks(size_t max_blocks) { max_blocks_ = max_blocks; }
+            size_t max_blocks() const { return max_blocks_; }
+
+        private:
+            ExportFormat format_;
+            std::vector<std::string> channels_;
+            uint64_t start_, end_;
+            unsigned int threads_;
+            size_t block_records_;
+            size_t max_blocks_;
+    };
+
+
+    class ExportStats
+    {
+        public:
+            ExportStats()
+                : records(0), bytes_read(0), bytes_written(0), seconds(0)
+            {}
+
+            // Read rate, counting record and time stamp bytes
+            double read_rate() const
+                { return seconds > 0 ? bytes_read / seconds / 1e9 : 0; }
+            double write_rate() const
+                { return seconds > 0 ? bytes_written / seconds / 1e9 : 0; }
+
+            uint64_t records;
+            uint64_t bytes_read;
+            uint64_t bytes_written;
+            double seconds;
+    };
+
+
+    // Export channels of a file into a directory, creating it if necessary.
+    // Compound types are flattened into one field per member, named by the
+    // path to it with dots. Channels with variable-length types can't be
+    // exported. Reading is done by the calling thread; conversion and writing
+    // overlap with it.
+    ExportStats export_channels(HDF5R& file, std::string const& dir,
+            ExportOptions const& options=ExportOptions());
+};
+
+#endif // !defined(HDF5R_EXPORT_H__)
+
@@ -18,7 +18,11 @@
 #define HDF5R_H__
 
 
+#include <algorithm>
 #include <hdf5.h>
+#include <hdf5r/index.h>
+#include <hdf5r/profile.h>
+#include <list>
 #include <map>
 #include <string>
 #include <vector>
@@ -26,27 +30,92 @@
 
 namespace hdf5r
 {
+    // An HDF5 identifier, closed when the last handle holding it goes.
+    // Copies share the identifier through the library's reference count
+    // rather than copying the object behind it.
+    class Handle
+    {
+        public:
+            // Take over id, which the handle will close
+            explicit Handle(hid_t id=-1) : id_(id) {}
+            Handle(Handle const& rhs) : id_(rhs.id_) { hold(); }
+            ~Handle() { drop(); }
+
+            Handle& operator=(Handle const& rhs)
+            {
+                Handle copy(rhs);
+                swap(copy);
+                return *this;
+            }
+#if __cplusplus >= 201103L
+            Handle(Handle&& rhs) : id_(rhs.id_) { rhs.id_ = -1; }
+            Handle& operator=(Handle&& rhs)
+            {
+                swap(rhs);
+                return *this;
+            }
+#endif
+
+            // A handle to an identifier that stays open for its owner
+            static Handle share(hid_t id)
+            {
+                Handle result(id);
+                result.hold();
+                return result;
+            }
+
+            hid_t get() const { return id_; }
+            bool valid() const { return id_ >= 0; }
+            // Close the identifier held, if this is its last handle, and
+            // take over id instead
+            void reset(hid_t id=-1)
+            {
+                drop();
+                id_ = id;
+            }
+            void swap(Handle& rhs) { std::swap(id_, rhs.id_); }
+
+        private:
+            hid_t id_;
+
+            void hold()
+            {
+                if (id_ >= 0)
+                {
+                    H5Iinc_ref(id_);
+                }
+            }
+            void drop()
+            {
+                if (id_ >= 0)
+                {
+                    H5Idec_ref(id_);
+                    id_ = -1;
+                }
+            }
+    };
+
+
     class ChannelInfo
     {
         public:
             ChannelInfo();
-            ChannelInfo(std::string name, std::string type_name,
-                    std::string source_name, hid_t mem_type, size_t size,
-                    uint64_t start_time, uint64_t end_time);
-            ChannelInfo(ChannelInfo const& rhs);
-            ~ChannelInfo();
-
-            ChannelInfo& operator=(ChannelInfo const& rhs);
-
-            void name(std::string name) { name_ = name; }
-            std::string name() const { return name_; }
-            void type_name(std::string type_name) { type_name_ = type_name; }
-            std::string type_name() const { return type_name_; }
-            void source_name(std::string source_name)
+            // The type is shared with its owner rather than copied
+            ChannelInfo(std::string const& name, std::string const& type_name,
+                    std::string const& source_name, hid_t mem_type,
+                    size_t size, uint64_t start_time, uint64_t end_time);
+
+            void name(std::string const& name) { name_ = name; }
+            std::string const& name() const { return name_; }
+            void type_name(std::string const& type_name)
+                { type_name_ = type_name; }
+            std::string const& type_name() const { return type_name_; }
+            void source_name(std::string const& source_name)
                 { source_name_ = source_name; }
-            std::string source_name() const { return source_name_; }
-            void mem_type(hid_t mem_type);
-            hid_t const mem_type() const { return mem_type_; }
+            std::string const& source_name() const { return source_name_; }
+            void mem_type(hid_t mem_type)
+                { mem_type_ = Handle::share(mem_type); }
+            hid_t mem_type() const { return mem_type_.get(); }
             void size(size_t size) { size_ = size; }
             size_t size() const { return size_; }
             void start_time(uint64_t start_time) { start_time_ = start_time; }
@@ -58,7 +127,7 @@ namespace hdf5r
             std::string name_;
             std::string type_name_;
             std::string source_name_;
-            hid_t mem_type_;
+            Handle mem_type_;
             size_t size_;
             uint64_t start_time_, end_time_;
     };
@@ -67,116 +136,570 @@ namespace hdf5r
     class Channel
     {
         public:
-            Channel(std::string name="", hid_t group=-1, hid_t rec_space=-1,
-                    hid_t rec_set=-1, hid_t ts_space=-1, hid_t ts_set=-1,
-                    hid_t mem_type=-1, size_t size=0);
-            Channel(Channel const& rhs);
-            ~Channel();
-
-            std::string name() const { return name_; }
-            hid_t group() const { return group_; }
-            hid_t rec_space() const { return rec_space_; }
-            hid_t rec_set() const { return rec_set_; }
-            hid_t ts_space() const { return ts_space_; }
-            hid_t ts_set() const { return ts_set_; }
-            hid_t mem_type() const { return mem_type_; }
+            // A field of a columnar channel's records, held in a data set
+            // of its own
+            struct Column
+            {
+                std::string name;
+                Handle set;
+                Handle space;
+                // The field's type in memory and its place in a record.
+                // The type is not valid if the channel's memory type lacks
+                // the field.
+                Handle mem_type;
+                size_t offset;
+            };
+            // Fixed-rate channels store no time stamps. Their records fall
+            // in runs, each starting at the time stamp of its first record
+            // and going on a period apart.
+            struct TimelineRun
+            {
+                hsize_t first;
+                uint64_t timestamp;
+            };
+
+            // The channel takes over the identifiers given
+            Channel(std::string const& name="", hid_t group=-1,
+                    hid_t rec_space=-1, hid_t rec_set=-1, hid_t ts_space=-1,
+                    hid_t ts_set=-1, hid_t mem_type=-1, size_t size=0);
+
+            // Channels are opened when first used. Opening one gives it its
+            // data sets, data spaces and type; closing one closes them.
+            void open(hid_t group, hid_t rec_space, hid_t rec_set,
+                    hid_t ts_space, hid_t ts_set, hid_t mem_type);
+            void close();
+            bool is_open() const { return group_.valid(); }
+
+            std::string const& name() const { return name_; }
+            void type_name(std::string const& type_name)
+                { type_name_ = type_name; }
+            std::string const& type_name() const { return type_name_; }
+            void source_name(std::string const& source_name)
+                { source_name_ = source_name; }
+            std::string const& source_name() const { return source_name_; }
+            hid_t group() const { return group_.get(); }
+            hid_t rec_space() const { return rec_space_.get(); }
+            hid_t rec_set() const { return rec_set_.get(); }
+            hid_t ts_space() const { return ts_space_.get(); }
+            hid_t ts_set() const { return ts_set_.get(); }
+            hid_t mem_type() const { return mem_type_.get(); }
+            // Columnar channels have no records data set
+            void columns(std::vector<Column> const& columns)
+                { columns_ = columns; }
+            std::vector<Column> const& columns() const { return columns_; }
+            bool columnar() const { return !columns_.empty(); }
+            // Zero for channels that store their time stamps
+            void period(uint64_t period) { period_ = period; }
+            uint64_t period() const { return period_; }
+            void timeline(hid_t timeline) { timeline_.reset(timeline); }
+            hid_t timeline() const { return timeline_.get(); }
+            std::vector<TimelineRun>& runs() { return runs_; }
+            std::vector<TimelineRun> const& runs() const { return runs_; }
+            // Time stamps of a fixed-rate channel's records [start,
+            // start + count), and the first record with a time stamp not
+            // before the one given, or the size if there is none
+            void timeline_stamps(hsize_t start, hsize_t count,
+                    uint64_t* const buf) const;
+            hsize_t timeline_find(uint64_t timestamp) const;
             void size(size_t size) { size_ = size; }
             size_t size() const { return size_; }
+            void cursor(size_t cursor) { cursor_ = cursor; }
+            size_t cursor() const { return cursor_; }
+            void committed(size_t committed) { committed_ = committed; }
+            size_t committed() const { return committed_; }
+            // Records of a channel of a followed file that are in the index
+            void indexed(size_t indexed) { indexed_ = indexed; }
+            size_t indexed() const { return indexed_; }
+            void last_used(uint64_t last_used) { last_used_ = last_used; }
+            uint64_t last_used() const { return last_used_; }
+            // Ring channels hold at most capacity records in data sets of
+            // that size, overwriting the oldest once full; the oldest is at
+            // head. Other channels have a capacity of zero.
+            void capacity(size_t capacity) { capacity_ = capacity; }
+            size_t capacity() const { return capacity_; }
+            void head(hsize_t head) { head_ = head; }
+            hsize_t head() const { return head_; }
+            void committed_head(hsize_t head) { committed_head_ = head; }
+            hsize_t committed_head() const { return committed_head_; }
+            void frozen(bool frozen) { frozen_ = frozen; }
+            bool frozen() const { return frozen_; }
+            // Where record index is in the data sets
+            hsize_t position(hsize_t index) const
+                { return capacity_ > 0 ? (head_ + index) % capacity_ : index; }
+            // How many of count records from index follow one another in the
+            // data sets before a ring channel's wrap around
+            hsize_t run(hsize_t index, hsize_t count) const
+            {
+                return capacity_ > 0 ?
+                    std::min<hsize_t>(count, capacity_ - position(index)) :
+                    count;
+            }
+            // Whether the file's committed size and head are out of date
+            bool unsaved() const
+                { return size_ != committed_ || head_ != committed_head_; }
 
         private:
             std::string name_;
-            hid_t group_;
-            hid_t rec_space_;
-            hid_t rec_set_;
-            hid_t ts_space_;
-            hid_t ts_set_;
-            hid_t mem_type_;
+            std::string type_name_;
+            std::string source_name_;
+            Handle group_;
+            Handle rec_space_;
+            Handle rec_set_;
+            Handle ts_space_;
+            Handle ts_set_;
+            Handle mem_type_;
+            std::vector<Column> columns_;
+            uint64_t period_;
+            Handle timeline_;
+            std::vector<TimelineRun> runs_;
             size_t size_; // Current number of records
+            size_t cursor_; // Next record to hand out when following
+            size_t committed_; // Records known to be safely in the file
+            size_t indexed_; // Records in the index of a followed file
+            uint64_t last_used_; // When the channel was last accessed
+            size_t capacity_;
+            hsize_t head_;
+            hsize_t committed_head_;
+            bool frozen_;
     };
 
 
-    typedef uint64_t ChannelID;
-    typedef enum { RDONLY, RDWR, NEW, TRUNCATE } Mode;
+    // SWMR_WRITE creates a new file that can be read while it is being
+    // written once start_swmr() is called. SWMR_READ opens such a file for
+    // reading while it is still being written.
+    typedef enum { RDONLY, RDWR, NEW, TRUNCATE, SWMR_WRITE, SWMR_READ } Mode;
     typedef enum { STRING_TAG, BINARY_TAG} TagType;
-    typedef std::pair<ChannelID, uint64_t> IndexPointer;
-    typedef std::vector<IndexPointer> IndexPointerList;
-    typedef std::map<uint64_t, IndexPointerList> Index;
+
+
+    // A tag's type and value. A binary tag's bytes are held in the string.
+    struct Tag
+    {
+        TagType type;
+        std::string value;
+    };
+    typedef std::map<std::string, Tag> TagMap;
+
+
+    // How often buffered data is checkpointed to the file. A checkpoint is
+    // taken when either limit is reached; a limit of zero is never reached.
+    class Durability
+    {
+        public:
+            Durability(size_t records=0, uint64_t interval_ms=0)
+                : records_(records), interval_ms_(interval_ms)
+            {}
+
+            void records(size_t records) { records_ = records; }
+            size_t records() const { return records_; }
+            void interval_ms(uint64_t interval_ms)
+                { interval_ms_ = interval_ms; }
+            uint64_t interval_ms() const { return interval_ms_; }
+
+        private:
+            size_t records_;
+            uint64_t interval_ms_;
+    };
+
+
+    // Where the records of a channel of another file went when they were
+    // copied into this one: source records [first, last) became the records
+    // of channel id from zero
+    struct ChannelMapping
+    {
+        ChannelID id;
+        uint64_t first;
+        uint64_t last;
+    };
+    typedef std::map<ChannelID, ChannelMapping> ChannelMap;
+    // A file whose index is to be merged, and how its channels were copied
+    typedef std::pair<std::string, ChannelMap> IndexSource;
+    // Records of several channels sharing one time stamp, as channel and
+    // record buffer pairs
+    typedef std::vector<std::pair<ChannelID, void const*> > Frame;
+
+
+    class CopyStats
+    {
+        public:
+            CopyStats()
+                : records(0), raw_chunks(0), raw_bytes(0)
+            {}
+
+            uint64_t records;
+            // Chunks copied as stored, without decoding them
+            uint64_t raw_chunks;
+            uint64_t raw_bytes;
+    };
+
+
+    class RecordCacheStats
+    {
+        public:
+            RecordCacheStats()
+                : hits(0), misses(0), evictions(0), bytes(0), blocks(0)
+            {}
+
+            double hit_rate() const
+            {
+                return hits + misses > 0 ?
+                    static_cast<double>(hits) / (hits + misses) : 0;
+            }
+
+            uint64_t hits;
+            uint64_t misses;
+            // Blocks dropped to stay within the cache's size
+            uint64_t evictions;
+            // Held in the cache now
+            size_t bytes;
+            size_t blocks;
+    };
 
 
     class HDF5R
     {
         public:
-            HDF5R(std::string filename, Mode mode);
-            HDF5R(HDF5R const& rhs);
+            HDF5R(std::string const& filename, Mode mode,
+                    FileProfile const& profile=FileProfile());
             virtual ~HDF5R();
 
+            std::string const& filename() const { return fn_; }
             Mode mode() const { return mode_; }
+            FileProfile profile() const { return profile_; }
+
+            // Switch a SWMR_WRITE file into single-writer/multiple-reader
+            // mode. All channels and tags must be added before calling this.
+            void start_swmr();
+            bool swmr() const { return swmr_; }
+            // Flush buffered data to the file, making it visible to readers.
+            void flush();
+
+            void durability(Durability const& policy) { durability_ = policy; }
+            Durability durability() const { return durability_; }
+            // Persist the index and each channel's committed record count,
+            // then flush. A file that is not closed cleanly is recovered up
+            // to the last checkpoint when it is next opened.
+            void checkpoint();
+            size_t committed(ChannelID chan_id);
 
-            ChannelID add_channel(std::string name, std::string type_name,
-                    std::string source_name, hid_t mem_type, hid_t file_type);
+            ChannelID add_channel(std::string const& name,
+                    std::string const& type_name,
+                    std::string const& source_name, hid_t mem_type,
+                    hid_t file_type);
+            // Add a channel that keeps only its latest capacity records, such
+            // as a flight recorder of the last few seconds of data. Once it
+            // is full each record added overwrites the oldest in place. Its
+            // records are read in time order like any other channel's, but
+            // are not in the index. Ring channels cannot be used in SWMR
+            // files.
+            ChannelID add_ring_channel(std::string const& name,
+                    std::string const& type_name,
+                    std::string const& source_name, hid_t mem_type,
+                    hid_t file_type, size_t capacity);
+            // Zero for channels that grow without limit
+            size_t ring_capacity(ChannelID chan_id);
+            // Add a channel of compound records that keeps each top-level
+            // field of the file type in a data set of its own, so that
+            // get_fields() reads only the fields asked for. Every field of
+            // the file type must be in the memory type. Reading or writing
+            // whole records takes a data set access per field. Columnar
+            // channels cannot be ring channels.
+            ChannelID add_columnar_channel(std::string const& name,
+                    std::string const& type_name,
+                    std::string const& source_name, hid_t mem_type,
+                    hid_t file_type);
+            bool columnar(ChannelID chan_id);
+            // Add a channel for a sensor sampled at a fixed rate. Rather
+            // than a time stamp per record, it stores the time stamps at
+            // which the period between records is broken, such as by a
+            // dropped or late sample. Reading time stamps and finding
+            // records by time take no reads of the file. Fixed-rate
+            // channels cannot be ring or columnar channels.
+            ChannelID add_fixed_rate_channel(std::string const& name,
+                    std::string const& type_name,
+                    std::string const& source_name, hid_t mem_type,
+                    hid_t file_type, uint64_t period);
+            // Zero for channels that store their time stamps
+            uint64_t period(ChannelID chan_id);
+            // Stop a ring channel overwriting its records, such as when an
+            // incident happens, and checkpoint the file. Records that would
+            // overwrite one are discarded from then on, including after the
+            // file is reopened.
+            void freeze(ChannelID chan_id);
+            // Freeze every ring channel
+            void freeze();
+            bool frozen(ChannelID chan_id);
             std::vector<ChannelID> channels() const;
             ChannelInfo get_channel_info(ChannelID chan_id);
-            bool have_channel(std::string name) const;
+            bool have_channel(std::string const& name) const;
+            ChannelID get_channel_id(std::string const& name) const;
+            // Copy records [first, last) of a channel of another file into a
+            // new channel of this one with the same types and storage layout.
+            // Whole chunks are copied as stored where the chunks of the two
+            // channels line up, which they do when first is on a chunk
+            // boundary; the rest are copied in large blocks. The copied
+            // records are not indexed; follow with merge_index() or
+            // rebuild_index().
+            ChannelID copy_channel(HDF5R& src, ChannelID src_id,
+                    std::string const& name, hsize_t first, hsize_t last,
+                    CopyStats* stats=0);
+            // The first record of the chunk holding a record of a channel,
+            // or the record itself if the chunk starts before the channel's
+            // first record. Copying from it lines the channel's chunks up
+            // with those of the copy. A columnar channel's chunks are those
+            // of its widest field.
+            hsize_t chunk_start(ChannelID chan_id, hsize_t index);
 
             void add_entry(ChannelID chan_id, uint64_t timestamp,
                     void const* const buf);
+            // Add one record to each of several channels, all with the same
+            // time stamp. The channels are checked before any record is
+            // written, and the durability policy is applied once for the
+            // whole frame, so a checkpoint never commits only part of it.
+            // If writing a record fails, those of the frame already written
+            // are taken back before the error is passed on.
+            void add_frame(uint64_t timestamp, Frame const& records);
+            // Add count consecutive records of a channel at once, with one
+            // write each of records and time stamps
+            void add_entries(ChannelID chan_id, size_t count,
+                    uint64_t const* const timestamps, void const* const buf);
             size_t get_entry_size(ChannelID chan_id, hsize_t index);
             uint64_t get_entry(ChannelID chan_id, hsize_t index,
                     void* const buf);
+            // Statistics of the profile's record cache since the file was
+            // opened or the cache last cleared
+            RecordCacheStats record_cache_stats() const
+                { return record_cache_stats_; }
+            void clear_record_cache();
+            // Read up to count consecutive records of a channel, starting at
+            // record start, and their time stamps. Either buffer may be null
+            // to skip it. Returns the number of records read.
+            size_t get_entries(ChannelID chan_id, hsize_t start, size_t count,
+                    uint64_t* const timestamps, void* const buf);
+            // As get_entries(), but filling in only the named top-level fields
+            // of the records in buf and leaving the rest as they are. Only a
+            // columnar channel's named fields are read from the file; other
+            // channels' records are read whole and the other fields not
+            // converted.
+            size_t get_fields(ChannelID chan_id, hsize_t start, size_t count,
+                    std::vector<std::string> const& fields,
+                    uint64_t* const timestamps, void* const buf);
+            // The first record of a channel with a time stamp not before the
+            // given one, or the channel's size if there is none. Assumes the
+            // channel's records were added in time order.
+            hsize_t find_entry(ChannelID chan_id, uint64_t timestamp);
 
-            Index index() const { return index_; }
+            // Pick up records added to a file opened in SWMR_READ mode since
+            // the last refresh, adding them to index(). Returns the number
+            // of new records.
+            size_t refresh();
+            // Hand out up to max_count records of a channel that have not
+            // yet been followed. Returns the number of records copied.
+            size_t follow(ChannelID chan_id, size_t max_count,
+                    uint64_t* const timestamps, void* const buf);
 
-            std::string get_text_tag(std::string tag);
-            size_t get_binary_tag(std::string tag, void* const buf);
+            // The index of a file opened in SWMR_READ mode is built from its
+            // channels' time stamps, as the writer only saves its index when
+            // it closes the file
+            IndexView index();
+            // Make room in the index for the given total number of records,
+            // so that adding them does not reallocate it
+            void reserve_index(size_t records) { index_.reserve(records); }
+            // Regenerate the index from the time stamps of every channel,
+            // sorting and merging them with the given number of threads
+            // (zero to use one per processor). The time stamps are read by
+            // the calling thread. The rebuilt index replaces the file's index
+            // when it is next written.
+            void rebuild_index(unsigned int threads=0);
+            // Replace the file's index with the indexes of other files merged
+            // together, keeping only the copied records and renumbering them
+            // as given by each source's channel map. Sorted runs are spilled
+            // to a temporary file and merged from there, so memory use does
+            // not grow with the size of the indexes. The result is written
+            // straight to the file and is not in index() until the file is
+            // next opened. Returns the number of records indexed.
+            uint64_t merge_index(std::vector<IndexSource> const& sources);
+
+            std::string get_text_tag(std::string const& tag);
+            size_t get_binary_tag(std::string const& tag, void* const buf);
             std::map<std::string, TagType> get_tags() const;
-            void set_text_tag(std::string tag, std::string value);
-            void set_binary_tag(std::string tag, void const* const buf,
+            // All tags with their types and values
+            TagMap get_all_tags();
+            void set_text_tag(std::string const& tag, std::string const& value);
+            void set_binary_tag(std::string const& tag, void const* const buf,
                     size_t size);
 
         private:
             std::string fn_;
             Mode mode_;
-            hid_t file_;
-            hid_t channels_grp_;
-            hid_t tags_grp_;
+            FileProfile profile_;
+            bool swmr_;
+            Handle file_;
+            Handle channels_grp_;
+            Handle tags_grp_;
 
             std::map<ChannelID, Channel> channels_;
+            std::map<std::string, ChannelID> channel_names_;
+            // Where each tag is stored, read when the file is opened. Small
+            // tags are attributes of the tags group, and the rest are data
+            // sets in it.
+            struct TagInfo
+            {
+                TagType type;
+                // Bytes stored, including a text tag's terminator
+                size_t size;
+                bool attribute;
+            };
+            std::map<std::string, TagInfo> tags_;
             ChannelID next_id_;
+            size_t open_channels_;
+            uint64_t use_clock_;
+            Handle elem_space_;
+            Handle pair_space_;
 
+            // A block of decoded records in the record cache
+            struct CachedBlock
+            {
+                ChannelID chan;
+                hsize_t start;
+                size_t count;
+                std::vector<uint64_t> timestamps;
+                std::vector<char> records;
+            };
+            typedef std::pair<ChannelID, hsize_t> BlockKey;
+            typedef std::list<CachedBlock> BlockList;
+            // Most recently used first
+            BlockList record_cache_;
+            std::map<BlockKey, BlockList::iterator> cached_blocks_;
+            RecordCacheStats record_cache_stats_;
+            CachedBlock const& cached_block(ChannelID chan_id, Channel& chan,
+                    hsize_t index);
+            void forget_cached_blocks(ChannelID chan_id);
+
+            hid_t make_fapl(bool page_buffer) const;
+            hid_t open_file(unsigned int flags) const;
+            hid_t create_file(unsigned int flags) const;
             void prepare();
             void prepare_tags_group();
+            void read_tag_info();
+            TagInfo const& tag_info(std::string const& tag) const;
+            void read_tag(std::string const& tag, TagInfo const& info,
+                    void* const buf) const;
+            void remove_tag(std::string const& tag);
+            void close_objects();
+            void check_not_swmr(char const* const what) const;
+            ChannelID create_channel(std::string const& name,
+                    std::string const& type_name,
+                    std::string const& source_name, hid_t mem_type,
+                    hid_t file_type, hid_t rec_parms, hid_t ts_parms,
+                    size_t capacity=0, bool columnar=false,
+                    uint64_t period=0);
+            void create_columns(hid_t group, std::string const& name,
+                    hid_t mem_type, hid_t file_type,
+                    std::vector<Channel::Column>& columns);
+            bool open_columns(hid_t group, std::string const& name,
+                    hid_t mem_type, std::vector<Channel::Column>& columns);
+            void extend_columns(Channel& chan, hsize_t size);
+            void write_columns(Channel& chan, hsize_t start, hsize_t count,
+                    void const* const buf);
+            void read_columns(Channel const& chan, hsize_t start,
+                    hsize_t count, std::vector<std::string> const* fields,
+                    void* const buf) const;
+            hid_t create_timeline(hid_t group);
+            void load_timeline(Channel& chan);
+            void append_timeline(Channel& chan, hsize_t start, size_t count,
+                    uint64_t const* const timestamps);
+            void write_runs(Channel& chan, size_t first);
+            // add_entry() without applying the durability policy
+            void append_entry(ChannelID chan_id, Channel& chan,
+                    uint64_t timestamp, void const* const buf);
+            void add_ring_entry(ChannelID chan_id, Channel& chan,
+                    uint64_t timestamp, void const* const buf);
+            void write_ring_slot(Channel& chan, hsize_t position,
+                    uint64_t timestamp, void const* const buf);
+            // A channel as it was before add_frame() added to it
+            struct FrameUndo
+            {
+                ChannelID chan;
+                size_t size;
+                size_t runs;
+                hsize_t head;
+                // A ring channel's data set size, and the record a full
+                // one overwrites
+                hsize_t extent;
+                bool overwrites;
+                uint64_t old_timestamp;
+                std::vector<char> old_record;
+            };
+            FrameUndo frame_undo(ChannelID chan_id, Channel& chan);
+            void undo_frame(std::vector<FrameUndo> const& undo,
+                    uint64_t timestamp, size_t indexed, size_t pending);
+            void freeze_channel(Channel& chan);
+            void drop_overwritten(Channel& chan);
+            Channel& channel(ChannelID chan_id);
+            void open_channel(Channel& chan);
+            void close_idle_channels();
             ChannelInfo read_channel_info(Channel const& chan) const;
-            std::string read_string(hid_t group, std::string set) const;
-            hid_t read_type(hid_t group, std::string set) const;
-            unsigned int read_uint(hid_t group, std::string set) const;
-            void write_string(hid_t group, std::string set, std::string str);
-            void write_type(hid_t group, std::string set, hid_t type);
-            void write_uint(hid_t group, std::string set, unsigned int value);
+            std::string read_string(hid_t group, std::string const& set) const;
+            hid_t read_type(hid_t group, std::string const& set) const;
+            uint64_t read_uint(hid_t group, std::string const& set) const;
+            void write_string(hid_t group, std::string const& set,
+                    std::string const& str);
+            uint64_t read_uint_attr(hid_t obj, std::string const& attr) const;
+            void write_uint_attr(hid_t obj, std::string const& attr,
+                    uint64_t value);
+            std::string read_string_attr(hid_t obj,
+                    std::string const& attr) const;
+            void write_string_attr(hid_t obj, std::string const& attr,
+                    std::string const& str);
+            hid_t read_type_attr(hid_t obj, std::string const& attr) const;
+            void write_type_attr(hid_t obj, std::string const& attr,
+                    hid_t type);
+            void read_timestamps(Channel const& chan, hid_t space,
+                    hsize_t start, hsize_t count, uint64_t* const buf) const;
+            void read_records(Channel const& chan, hsize_t start,
+                    hsize_t count, hid_t mem_type, void* const buf) const;
 
             Index index_;
+            bool index_loaded_;
+            // Index entries added since the last checkpoint
+            std::vector<std::pair<uint64_t, IndexPointer> > pending_index_;
+            // Set when the file's index matches index_ apart from the pending
+            // entries, so that it can be appended to rather than replaced
+            bool index_in_file_;
+
+            Durability durability_;
+            size_t uncommitted_;
+            uint64_t last_checkpoint_;
+            void check_durability(size_t records=1);
 
             hid_t make_index_ftype() const;
             hid_t make_index_mtype() const;
             void read_index();
+            void index_followed(ChannelID chan_id, Channel& chan);
+            hid_t create_index_set();
             void write_index();
+            void append_index();
+            void write_committed();
 
             struct close_group_fun
             {
                 void operator()(std::pair<const ChannelID, Channel>& chan)
                 {
-                    H5Dclose(chan.second.rec_set());
-                    H5Sclose(chan.second.rec_space());
-                    H5Dclose(chan.second.ts_set());
-                    H5Sclose(chan.second.ts_space());
-                    H5Gclose(chan.second.group());
+                    chan.second.close();
                 }
             };
 
             static char const* const CHANNELS_GROUP;
             static char const* const TAGS_GROUP;
+            static char const* const COLUMNS_GROUP;
             static char const* const INDEX_SET;
             static char const* const RECORDS_SET;
             static char const* const TIMESTAMPS_SET;
+            static char const* const TIMELINE_SET;
+
+            // A copy would share the open file
+            HDF5R(HDF5R const&);
+            HDF5R& operator=(HDF5R const&);
     };
 };
 
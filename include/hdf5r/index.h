@@ -0,0 +1,123 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Time index over the records of all channels in a file.
+ */
+
+
+#if !defined(HDF5R_INDEX_H__)
+#define HDF5R_INDEX_H__
+
+
+#include <cstddef>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+
+namespace hdf5r
+{
+    typedef uint64_t ChannelID;
+    typedef std::pair<ChannelID, uint64_t> IndexPointer;
+    typedef std::vector<IndexPointer> IndexPointerList;
+
+
+    // Read-only view of an index, or of a contiguous part of one. A view
+    // does not copy the index, and is invalidated when the index changes.
+    // Positions in the view are ordered by time stamp; records sharing a time
+    // stamp occupy adjacent positions.
+    class IndexView
+    {
+        public:
+            IndexView()
+                : timestamps_(0), channels_(0), records_(0), size_(0)
+            {}
+            IndexView(uint64_t const* timestamps, ChannelID const* channels,
+                    uint64_t const* records, size_t size)
+                : timestamps_(timestamps), channels_(channels),
+                records_(records), size_(size)
+            {}
+
+            size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+
+            uint64_t timestamp(size_t pos) const { return timestamps_[pos]; }
+            ChannelID channel(size_t pos) const { return channels_[pos]; }
+            uint64_t record(size_t pos) const { return records_[pos]; }
+            IndexPointer pointer(size_t pos) const
+                { return IndexPointer(channels_[pos], records_[pos]); }
+
+            // The underlying columns, for bulk processing
+            uint64_t const* timestamps() const { return timestamps_; }
+            ChannelID const* channels() const { return channels_; }
+            uint64_t const* records() const { return records_; }
+
+            // First position with a time stamp not before the given one
+            size_t lower_bound(uint64_t timestamp) const;
+            // First position with a time stamp after the given one
+            size_t upper_bound(uint64_t timestamp) const;
+            // All records with the given time stamp
+            IndexPointerList entry(uint64_t timestamp) const;
+            // The positions from first up to but not including last
+            IndexView slice(size_t first, size_t last) const;
+            // The records with time stamps in [start, end)
+            IndexView window(uint64_t start, uint64_t end) const;
+
+        private:
+            uint64_t const* timestamps_;
+            ChannelID const* channels_;
+            uint64_t const* records_;
+            size_t size_;
+
+            size_t search(uint64_t timestamp, bool after) const;
+    };
+
+
+    // Index stored as parallel sorted arrays of time stamps, channels and
+    // record numbers, one element per record.
+    class Index
+    {
+        public:
+            Index();
+
+            // Add a record. Appending in time order is amortised constant
+            // time; a record arriving late is inserted after any others with
+            // the same time stamp.
+            void append(uint64_t timestamp, ChannelID channel,
+                    uint64_t record);
+            // Add count records of a channel, numbered from first_record.
+            // Records arriving late are merged in with one sort of the
+            // part of the index they overlap, rather than one insertion
+            // each.
+            void append(size_t count, uint64_t const* timestamps,
+                    ChannelID channel, uint64_t first_record);
+            // Take back the last count records added with a time stamp
+            void remove_last(uint64_t timestamp, size_t count);
+            void reserve(size_t size);
+            void clear();
+            void swap(Index& rhs);
+
+            size_t size() const { return timestamps_.size(); }
+            bool empty() const { return timestamps_.empty(); }
+            IndexView view() const;
+
+            bool operator==(Index const& rhs) const;
+            bool operator!=(Index const& rhs) const { return !(*this == rhs); }
+
+        private:
+            std::vector<uint64_t> timestamps_;
+            std::vector<ChannelID> channels_;
+            std::vector<uint64_t> records_;
+    };
+};
+
+#endif // !defined(HDF5R_INDEX_H__)
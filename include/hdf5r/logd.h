@@ -0,0 +1,156 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Logging service for several processes writing to one file.
+ */
+
+
+#if !defined(HDF5R_LOGD_H__)
+#define HDF5R_LOGD_H__
+
+
+#include <hdf5r/hdf5r.h>
+#include <map>
+#include <signal.h>
+#include <string>
+#include <vector>
+
+
+namespace hdf5r
+{
+    // A channel of a logging client, numbered from zero in the order the
+    // client added them
+    typedef uint32_t LogChannel;
+
+
+    struct LogRing;
+
+
+    // A process's connection to a logging daemon. Records are put straight
+    // into a ring buffer in shared memory that the daemon drains. When the
+    // ring is full, records are dropped rather than waiting for the daemon,
+    // and counted. A client is for use by one thread.
+    class LogClient
+    {
+        public:
+            // Connect to the daemon serving the named service, with a ring
+            // of ring_bytes bytes (rounded up to a power of two)
+            LogClient(std::string const& service="hdf5r",
+                    size_t ring_bytes=4 * 1024 * 1024);
+            ~LogClient();
+
+            // Add a channel to the daemon's file, or use the one there of
+            // the same name. The types must not hold variable-length data.
+            // Waits for room in the ring if necessary.
+            LogChannel add_channel(std::string const& name,
+                    std::string const& type_name,
+                    std::string const& source_name, hid_t mem_type,
+                    hid_t file_type);
+
+            // Room for a record of a channel in the ring, to be filled in and
+            // then sent with commit(). Returns null if the ring is full, and
+            // counts the record as dropped.
+            void* reserve(LogChannel chan, uint64_t timestamp);
+            void commit();
+            // Copy a record into the ring and send it. Returns false if it
+            // was dropped.
+            bool add_entry(LogChannel chan, uint64_t timestamp,
+                    void const* const buf);
+
+            uint64_t sent() const;
+            uint64_t dropped() const;
+
+        private:
+            std::string segment_;
+            int daemon_pid_;
+            LogRing* ring_;
+            size_t mapped_;
+            // Record size of each channel
+            std::vector<size_t> record_sizes_;
+            uint64_t reserved_head_;
+
+            char* reserve_message(size_t size);
+
+            LogClient(LogClient const&);
+            LogClient& operator=(LogClient const&);
+    };
+
+
+    class LogClientStats
+    {
+        public:
+            LogClientStats()
+                : pid(0), records(0), bytes(0), dropped(0), connected(false)
+            {}
+
+            int pid;
+            // Written to the file
+            uint64_t records;
+            uint64_t bytes;
+            // Dropped by the client because its ring was full
+            uint64_t dropped;
+            bool connected;
+    };
+
+
+    struct LogBatch;
+    struct LogControl;
+    struct LogDaemonClient;
+
+
+    // Owns a file on behalf of the clients of a logging service. Each call
+    // to drain() takes up to batch_records records from every client's
+    // ring and writes each channel's records with a single add_entries().
+    // Only one daemon may serve a service at a time.
+    class LogDaemon
+    {
+        public:
+            LogDaemon(HDF5R& file, std::string const& service="hdf5r",
+                    size_t batch_records=65536);
+            ~LogDaemon();
+
+            // Attach new clients, write what their rings hold, and detach
+            // those that have disconnected or exited. Returns the number of
+            // records written.
+            size_t drain();
+            // Drain until stop is set, sleeping briefly whenever the rings
+            // are empty, then drain what is left
+            void run(volatile sig_atomic_t const& stop);
+
+            // Statistics of every client since the daemon started, including
+            // those that have gone
+            std::vector<LogClientStats> client_stats() const;
+
+        private:
+            HDF5R& file_;
+            std::string name_;
+            LogControl* control_;
+            size_t batch_records_;
+            std::vector<LogDaemonClient*> clients_;
+            std::vector<LogClientStats> departed_;
+            // Records taken from the rings, by channel, kept between drains
+            // to reuse their memory
+            std::map<ChannelID, LogBatch*> batches_;
+
+            void attach_clients();
+            size_t drain_client(LogDaemonClient& client, size_t budget);
+            void add_client_channel(LogDaemonClient& client,
+                    char const* msg, size_t size);
+            void detach(size_t client);
+
+            LogDaemon(LogDaemon const&);
+            LogDaemon& operator=(LogDaemon const&);
+    };
+};
+
+#endif // !defined(HDF5R_LOGD_H__)
+
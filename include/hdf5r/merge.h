@@ -0,0 +1,55 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Merging of several files into one.
+ */
+
+
+#if !defined(HDF5R_MERGE_H__)
+#define HDF5R_MERGE_H__
+
+
+#include <hdf5r/hdf5r.h>
+#include <string>
+#include <vector>
+
+
+namespace hdf5r
+{
+    class MergeStats
+    {
+        public:
+            MergeStats()
+                : channels(0), tags(0), index_records(0), seconds(0)
+            {}
+
+            uint64_t channels;
+            uint64_t tags;
+            CopyStats copied;
+            uint64_t index_records;
+            double seconds;
+    };
+
+
+    // Merge files into a new one, overwriting anything already there. Each
+    // channel and tag keeps its name unless an earlier input already used
+    // it, in which case the number of its input, counting from one, is
+    // appended as "name_N". Channels are given new IDs in the order they are
+    // copied. Inputs are opened one at a time and their indexes are merged
+    // through a temporary file, so memory use does not grow with their size.
+    MergeStats merge_files(std::vector<std::string> const& inputs,
+            std::string const& output,
+            FileProfile const& profile=FileProfile());
+};
+
+#endif // !defined(HDF5R_MERGE_H__)
+
@@ -0,0 +1,260 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * File format and layout properties.
+ */
+
+
+#if !defined(HDF5R_PROFILE_H__)
+#define HDF5R_PROFILE_H__
+
+
+#include <hdf5.h>
+#include <hdf5r/vfd.h>
+#include <map>
+#include <string>
+
+
+namespace hdf5r
+{
+    // Raw data chunk cache of a data set. Slots is the number of hash table
+    // slots, best a prime about a hundred times the number of chunks that
+    // fit in the cache; w0 is the preference, from 0 to 1, for evicting
+    // chunks that have been completely read or written.
+    class ChunkCache
+    {
+        public:
+            // The library's defaults
+            ChunkCache(size_t slots=521, size_t bytes=1024 * 1024,
+                    double w0=0.75)
+                : slots_(slots), bytes_(bytes), w0_(w0)
+            {}
+
+            void slots(size_t slots) { slots_ = slots; }
+            size_t slots() const { return slots_; }
+            void bytes(size_t bytes) { bytes_ = bytes; }
+            size_t bytes() const { return bytes_; }
+            void w0(double w0) { w0_ = w0; }
+            double w0() const { return w0_; }
+
+        private:
+            size_t slots_;
+            size_t bytes_;
+            double w0_;
+    };
+
+
+    // Cache of decoded records, used by get_entry(). Blocks of block_records
+    // consecutive records of a channel are read along with their time
+    // stamps and kept until the cache holds more than bytes bytes, when the
+    // least recently used are dropped. Zero bytes disables the cache.
+    class RecordCache
+    {
+        public:
+            RecordCache(size_t bytes=0, size_t block_records=256)
+                : bytes_(bytes), block_records_(block_records)
+            {}
+
+            void bytes(size_t bytes) { bytes_ = bytes; }
+            size_t bytes() const { return bytes_; }
+            void block_records(size_t count) { block_records_ = count; }
+            size_t block_records() const { return block_records_; }
+
+        private:
+            size_t bytes_;
+            size_t block_records_;
+    };
+
+
+    // Settings of files held in memory by the core driver. The image starts
+    // at size bytes, reserved when the file is first written, and grows by
+    // size bytes whenever it fills. With persist set, the image is written
+    // to the file when it is closed and whenever it is flushed or
+    // checkpointed, so a Durability interval writes it periodically. With
+    // write_page set, those writes only cover the pages of that many bytes
+    // that changed since the last one, rather than the whole image.
+    class CoreImage
+    {
+        public:
+            CoreImage(size_t size=64 * 1024 * 1024, bool persist=true,
+                    size_t write_page=0)
+                : size_(size), persist_(persist), write_page_(write_page)
+            {}
+
+            void size(size_t size) { size_ = size; }
+            size_t size() const { return size_; }
+            void persist(bool persist) { persist_ = persist; }
+            bool persist() const { return persist_; }
+            void write_page(size_t size) { write_page_ = size; }
+            size_t write_page() const { return write_page_; }
+
+        private:
+            size_t size_;
+            bool persist_;
+            size_t write_page_;
+    };
+
+
+    // How a file will mostly be read. SEQUENTIAL reads each channel from
+    // start to end, RANDOM reads records from anywhere, and REPLAY reads all
+    // channels together in time order.
+    typedef enum { SEQUENTIAL, RANDOM, REPLAY } AccessPattern;
+
+
+    // The driver files are accessed through. SEC2 is the library's default
+    // driver; WRITE_BEHIND gathers writes into large buffers that are written
+    // in the background; CORE holds the whole file in memory.
+    typedef enum { SEC2, WRITE_BEHIND, CORE } FileDriver;
+
+
+    // File format and layout properties applied when a file is created or
+    // opened. The default profile leaves everything at the library's
+    // defaults. Creation properties only affect new files; an existing file
+    // keeps the layout it was created with.
+    class FileProfile
+    {
+        public:
+            FileProfile();
+
+            // Tuned for long recordings that are appended to quickly
+            static FileProfile write_heavy_logger();
+            // Tuned for finished recordings that are opened and read often
+            static FileProfile archive();
+            // Look up a preset by name: "default", "write-heavy logger" or
+            // "archive"
+            static FileProfile preset(std::string const& name);
+
+            // Oldest and newest file format versions objects may be written
+            // in. Paged file space needs a newest version of at least V110.
+            void libver_bounds(H5F_libver_t low, H5F_libver_t high)
+                { libver_low_ = low; libver_high_ = high; }
+            H5F_libver_t libver_low() const { return libver_low_; }
+            H5F_libver_t libver_high() const { return libver_high_; }
+
+            // How free space in the file is managed. With the PAGE strategy,
+            // metadata and raw data are aggregated into separate pages of
+            // page_size bytes, and a page buffer of page_buffer_size bytes
+            // (zero for none) caches them.
+            void file_space(H5F_fspace_strategy_t strategy, bool persist,
+                    hsize_t threshold)
+            {
+                fs_strategy_ = strategy;
+                fs_persist_ = persist;
+                fs_threshold_ = threshold;
+            }
+            H5F_fspace_strategy_t fs_strategy() const { return fs_strategy_; }
+            bool fs_persist() const { return fs_persist_; }
+            hsize_t fs_threshold() const { return fs_threshold_; }
+            void page_size(hsize_t page_size) { page_size_ = page_size; }
+            hsize_t page_size() const { return page_size_; }
+            void page_buffer_size(size_t size) { page_buffer_size_ = size; }
+            size_t page_buffer_size() const { return page_buffer_size_; }
+
+            // Objects of at least threshold bytes start on a multiple of
+            // alignment bytes
+            void alignment(hsize_t threshold, hsize_t alignment)
+            {
+                align_threshold_ = threshold;
+                alignment_ = alignment;
+            }
+            hsize_t align_threshold() const { return align_threshold_; }
+            hsize_t alignment() const { return alignment_; }
+
+            // Sizes of the blocks that small metadata and raw data objects
+            // are aggregated into
+            void meta_block_size(hsize_t size) { meta_block_size_ = size; }
+            hsize_t meta_block_size() const { return meta_block_size_; }
+            void small_data_block_size(hsize_t size)
+                { small_data_block_size_ = size; }
+            hsize_t small_data_block_size() const
+                { return small_data_block_size_; }
+
+            // Chunk cache of each channel's records and time stamps, and
+            // caches for particular channels that override it
+            void chunk_cache(ChunkCache const& cache) { chunk_cache_ = cache; }
+            ChunkCache chunk_cache() const { return chunk_cache_; }
+            void chunk_cache(std::string const& channel,
+                    ChunkCache const& cache)
+                { channel_caches_[channel] = cache; }
+            ChunkCache chunk_cache(std::string const& channel) const;
+
+            // Cache of decoded records for random reads
+            void record_cache(RecordCache const& cache)
+                { record_cache_ = cache; }
+            RecordCache record_cache() const { return record_cache_; }
+
+            // Initial and maximum sizes of the metadata cache, which adapts
+            // between them. Zero keeps the library's default.
+            void metadata_cache(size_t initial, size_t max)
+            {
+                mdc_initial_ = initial;
+                mdc_max_ = max;
+            }
+            size_t mdc_initial() const { return mdc_initial_; }
+            size_t mdc_max() const { return mdc_max_; }
+
+            // Most channels to keep open at once. Channels are opened when
+            // first used; beyond this many, the least recently used channel
+            // without unsaved records is closed. Zero for no limit.
+            void max_open_channels(size_t count) { max_open_channels_ = count; }
+            size_t max_open_channels() const { return max_open_channels_; }
+
+            // The file driver and the options of the write-behind and core
+            // drivers. SWMR files always use SEC2.
+            void driver(FileDriver driver) { driver_ = driver; }
+            FileDriver driver() const { return driver_; }
+            void write_behind(WriteBehind const& options)
+            {
+                driver_ = WRITE_BEHIND;
+                write_behind_ = options;
+            }
+            WriteBehind write_behind() const { return write_behind_; }
+            void core_image(CoreImage const& image)
+            {
+                driver_ = CORE;
+                core_image_ = image;
+            }
+            CoreImage core_image() const { return core_image_; }
+
+            // Pick chunk and metadata cache sizes suited to the way the file
+            // will be read. Caches set afterwards override these.
+            void access_pattern(AccessPattern pattern);
+
+            // Make property lists holding this profile. The caller closes
+            // them.
+            hid_t make_fapl() const;
+            hid_t make_fcpl() const;
+            // Data set access properties for a channel's data sets
+            hid_t make_dapl(std::string const& channel) const;
+
+        private:
+            H5F_libver_t libver_low_, libver_high_;
+            H5F_fspace_strategy_t fs_strategy_;
+            bool fs_persist_;
+            hsize_t fs_threshold_;
+            hsize_t page_size_;
+            size_t page_buffer_size_;
+            hsize_t align_threshold_, alignment_;
+            hsize_t meta_block_size_;
+            hsize_t small_data_block_size_;
+            ChunkCache chunk_cache_;
+            std::map<std::string, ChunkCache> channel_caches_;
+            RecordCache record_cache_;
+            size_t mdc_initial_, mdc_max_;
+            size_t max_open_channels_;
+            FileDriver driver_;
+            WriteBehind write_behind_;
+            CoreImage core_image_;
+    };
+};
+
+#endif // !defined(HDF5R_PROFILE_H__)
@@ -0,0 +1,64 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Extraction of a time window of a file into a new file.
+ */
+
+
+#if !defined(HDF5R_SLICE_H__)
+#define HDF5R_SLICE_H__
+
+
+#include <hdf5r/hdf5r.h>
+#include <string>
+#include <vector>
+
+
+namespace hdf5r
+{
+    class SliceStats
+    {
+        public:
+            SliceStats()
+                : channels(0), leading_records(0), index_records(0),
+                seconds(0)
+            {}
+
+            uint64_t channels;
+            CopyStats copied;
+            // Records before the window copied so that channels start on a
+            // chunk boundary
+            uint64_t leading_records;
+            uint64_t index_records;
+            double seconds;
+    };
+
+
+    // Copy the records of a file with time stamps in [start, end) into a new
+    // file, overwriting anything already there, along with the file's tags.
+    // Only the named channels are copied, or all of them if none are named.
+    // Each channel's records are found by searching its time stamps, so they
+    // must have been added in time order. Chunks inside the window are copied
+    // as stored when they line up with the new file's; others are copied in
+    // blocks. A window rarely starts on a chunk boundary, so unless
+    // align_chunks is false each channel is copied from the start of the
+    // chunk holding its first record in the window, which lines up every
+    // following chunk at the cost of up to a chunk of earlier records.
+    SliceStats slice_file(HDF5R& input, std::string const& output,
+            uint64_t start, uint64_t end,
+            std::vector<std::string> const& channels=std::vector<std::string>(),
+            FileProfile const& profile=FileProfile(),
+            bool align_chunks=true);
+};
+
+#endif // !defined(HDF5R_SLICE_H__)
+
@@ -0,0 +1,73 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Write-behind file driver.
+ */
+
+
+#if !defined(HDF5R_VFD_H__)
+#define HDF5R_VFD_H__
+
+
+#include <hdf5.h>
+
+
+namespace hdf5r
+{
+    // Options of the write-behind file driver. Writes are gathered into
+    // buffers of buffer_size bytes, and a full buffer is written in the
+    // background while the next fills. Up to buffers buffers are in use at
+    // once; when all are being written, writing waits for one to finish.
+    // With direct set, the parts of each buffer that are aligned to
+    // alignment bytes bypass the page cache using O_DIRECT. Background
+    // writes are submitted with io_uring where the kernel allows it, and by
+    // a writer thread otherwise.
+    class WriteBehind
+    {
+        public:
+            WriteBehind(size_t buffer_size=4 * 1024 * 1024, size_t buffers=4,
+                    size_t alignment=4096, bool direct=false,
+                    bool io_uring=true)
+                : buffer_size_(buffer_size), buffers_(buffers),
+                alignment_(alignment), direct_(direct), io_uring_(io_uring)
+            {}
+
+            void buffer_size(size_t size) { buffer_size_ = size; }
+            size_t buffer_size() const { return buffer_size_; }
+            void buffers(size_t buffers) { buffers_ = buffers; }
+            size_t buffers() const { return buffers_; }
+            void alignment(size_t alignment) { alignment_ = alignment; }
+            size_t alignment() const { return alignment_; }
+            void direct(bool direct) { direct_ = direct; }
+            bool direct() const { return direct_; }
+            void io_uring(bool io_uring) { io_uring_ = io_uring; }
+            bool io_uring() const { return io_uring_; }
+
+        private:
+            size_t buffer_size_;
+            size_t buffers_;
+            size_t alignment_;
+            bool direct_;
+            bool io_uring_;
+    };
+
+
+    // The driver's ID, registering it with the library if necessary
+    hid_t write_behind_driver();
+    // Make a file access property list use the driver
+    void set_fapl_write_behind(hid_t fapl, WriteBehind const& options);
+    // Whether this build and the running kernel can use io_uring
+    bool have_io_uring();
+};
+
+#endif // !defined(HDF5R_VFD_H__)
+
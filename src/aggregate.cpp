@@ -0,0 +1,594 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Aggregates of numeric fields over ranges of a channel's records.
+ */
+
+#include <hdf5r/aggregate.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// The vector kernels are compiled for their instruction sets function by
+// function, and picked at run time, so the library needs no special flags
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HDF5R_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace hdf5r;
+
+
+Aggregate::Aggregate()
+    : count(0), sum(0), min(std::numeric_limits<double>::infinity()),
+    max(-std::numeric_limits<double>::infinity())
+{
+}
+
+
+double Aggregate::mean() const
+{
+    if (count == 0)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return sum / count;
+}
+
+
+Histogram::Histogram(double low, double high, size_t bins)
+    : low(low), high(high), counts(bins, 0), below(0), above(0)
+{
+}
+
+
+SimdLevel hdf5r::simd_level()
+{
+#if defined(HDF5R_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SIMD_AVX2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+
+static SimdLevel use_level(SimdLevel max_level)
+{
+    return std::min(max_level, simd_level());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels
+///////////////////////////////////////////////////////////////////////////////
+
+// Bins of a histogram. Values below, above and NaN get the three indices
+// after the last bin.
+struct Bins
+{
+    double low;
+    double high;
+    double scale;
+    double last;
+    size_t below;
+    size_t above;
+    size_t nan;
+};
+
+
+typedef void (*SummariseFun)(double const*, size_t, Aggregate&);
+typedef void (*BinFun)(double const*, size_t, Bins const&, uint64_t*);
+
+
+static void summarise_scalar(double const* values, size_t count,
+        Aggregate& agg)
+{
+    for (size_t ii(0); ii < count; ++ii)
+    {
+        double x(values[ii]);
+        if (x != x)
+        {
+            continue;
+        }
+        ++agg.count;
+        agg.sum += x;
+        if (x < agg.min)
+        {
+            agg.min = x;
+        }
+        if (x > agg.max)
+        {
+            agg.max = x;
+        }
+    }
+}
+
+
+static size_t bin_of(double x, Bins const& bins)
+{
+    if (x != x)
+    {
+        return bins.nan;
+    }
+    if (x < bins.low)
+    {
+        return bins.below;
+    }
+    if (x >= bins.high)
+    {
+        return bins.above;
+    }
+    return static_cast<size_t>(std::min((x - bins.low) * bins.scale,
+                bins.last));
+}
+
+
+static void bin_scalar(double const* values, size_t count, Bins const& bins,
+        uint64_t* counts)
+{
+    for (size_t ii(0); ii < count; ++ii)
+    {
+        ++counts[bin_of(values[ii], bins)];
+    }
+}
+
+
+#if defined(HDF5R_X86_SIMD)
+// min and max give their second operand when either is NaN, so NaN values
+// leave the running minimum and maximum alone without a mask
+
+__attribute__((target("avx2")))
+static void summarise_avx2(double const* values, size_t count,
+        Aggregate& agg)
+{
+    __m256d sum(_mm256_setzero_pd());
+    __m256d min(_mm256_set1_pd(agg.min));
+    __m256d max(_mm256_set1_pd(agg.max));
+    uint64_t n(0);
+    size_t ii(0);
+    for (; ii + 4 <= count; ii += 4)
+    {
+        __m256d x(_mm256_loadu_pd(values + ii));
+        __m256d ordered(_mm256_cmp_pd(x, x, _CMP_ORD_Q));
+        sum = _mm256_add_pd(sum, _mm256_and_pd(x, ordered));
+        min = _mm256_min_pd(x, min);
+        max = _mm256_max_pd(x, max);
+        n += __builtin_popcount(_mm256_movemask_pd(ordered));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    agg.sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm256_storeu_pd(lanes, min);
+    agg.min = std::min(std::min(lanes[0], lanes[1]),
+            std::min(lanes[2], lanes[3]));
+    _mm256_storeu_pd(lanes, max);
+    agg.max = std::max(std::max(lanes[0], lanes[1]),
+            std::max(lanes[2], lanes[3]));
+    agg.count += n;
+    summarise_scalar(values + ii, count - ii, agg);
+}
+
+
+__attribute__((target("avx512f")))
+static void summarise_avx512(double const* values, size_t count,
+        Aggregate& agg)
+{
+    __m512d sum(_mm512_setzero_pd());
+    __m512d min(_mm512_set1_pd(agg.min));
+    __m512d max(_mm512_set1_pd(agg.max));
+    uint64_t n(0);
+    for (size_t ii(0); ii < count; ii += 8)
+    {
+        __mmask8 load(count - ii >= 8 ? 0xFF : (1u << (count - ii)) - 1);
+        __m512d x(_mm512_maskz_loadu_pd(load, values + ii));
+        __mmask8 ordered(_mm512_mask_cmp_pd_mask(load, x, x, _CMP_ORD_Q));
+        sum = _mm512_mask_add_pd(sum, ordered, sum, x);
+        min = _mm512_mask_min_pd(min, ordered, x, min);
+        max = _mm512_mask_max_pd(max, ordered, x, max);
+        n += __builtin_popcount(ordered);
+    }
+    agg.sum += _mm512_reduce_add_pd(sum);
+    agg.min = _mm512_reduce_min_pd(min);
+    agg.max = _mm512_reduce_max_pd(max);
+    agg.count += n;
+}
+
+
+__attribute__((target("avx2")))
+static void bin_avx2(double const* values, size_t count, Bins const& bins,
+        uint64_t* counts)
+{
+    __m256d low(_mm256_set1_pd(bins.low));
+    __m256d high(_mm256_set1_pd(bins.high));
+    __m256d scale(_mm256_set1_pd(bins.scale));
+    __m256d last(_mm256_set1_pd(bins.last));
+    __m256d below(_mm256_set1_pd(static_cast<double>(bins.below)));
+    __m256d above(_mm256_set1_pd(static_cast<double>(bins.above)));
+    __m256d nan(_mm256_set1_pd(static_cast<double>(bins.nan)));
+    int32_t index[4];
+    size_t ii(0);
+    for (; ii + 4 <= count; ii += 4)
+    {
+        __m256d x(_mm256_loadu_pd(values + ii));
+        __m256d bin(_mm256_min_pd(
+                    _mm256_mul_pd(_mm256_sub_pd(x, low), scale), last));
+        bin = _mm256_blendv_pd(bin, below,
+                _mm256_cmp_pd(x, low, _CMP_LT_OQ));
+        bin = _mm256_blendv_pd(bin, above,
+                _mm256_cmp_pd(x, high, _CMP_GE_OQ));
+        bin = _mm256_blendv_pd(bin, nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(index),
+                _mm256_cvttpd_epi32(bin));
+        ++counts[index[0]];
+        ++counts[index[1]];
+        ++counts[index[2]];
+        ++counts[index[3]];
+    }
+    bin_scalar(values + ii, count - ii, bins, counts);
+}
+
+
+__attribute__((target("avx512f")))
+static void bin_avx512(double const* values, size_t count, Bins const& bins,
+        uint64_t* counts)
+{
+    __m512d low(_mm512_set1_pd(bins.low));
+    __m512d high(_mm512_set1_pd(bins.high));
+    __m512d scale(_mm512_set1_pd(bins.scale));
+    __m512d last(_mm512_set1_pd(bins.last));
+    __m512d below(_mm512_set1_pd(static_cast<double>(bins.below)));
+    __m512d above(_mm512_set1_pd(static_cast<double>(bins.above)));
+    __m512d nan(_mm512_set1_pd(static_cast<double>(bins.nan)));
+    int32_t index[8];
+    size_t ii(0);
+    for (; ii + 8 <= count; ii += 8)
+    {
+        __m512d x(_mm512_loadu_pd(values + ii));
+        __m512d bin(_mm512_min_pd(
+                    _mm512_mul_pd(_mm512_sub_pd(x, low), scale), last));
+        bin = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, low, _CMP_LT_OQ),
+                bin, below);
+        bin = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, high, _CMP_GE_OQ),
+                bin, above);
+        bin = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q),
+                bin, nan);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(index),
+                _mm512_cvttpd_epi32(bin));
+        for (int jj(0); jj < 8; ++jj)
+        {
+            ++counts[index[jj]];
+        }
+    }
+    bin_scalar(values + ii, count - ii, bins, counts);
+}
+#endif // defined(HDF5R_X86_SIMD)
+
+
+static SummariseFun summarise_fun(SimdLevel level)
+{
+#if defined(HDF5R_X86_SIMD)
+    switch (level)
+    {
+        case SIMD_AVX512:
+            return summarise_avx512;
+        case SIMD_AVX2:
+            return summarise_avx2;
+        case SIMD_SCALAR:
+            break;
+    }
+#endif
+    return summarise_scalar;
+}
+
+
+static BinFun bin_fun(SimdLevel level)
+{
+#if defined(HDF5R_X86_SIMD)
+    switch (level)
+    {
+        case SIMD_AVX512:
+            return bin_avx512;
+        case SIMD_AVX2:
+            return bin_avx2;
+        case SIMD_SCALAR:
+            break;
+    }
+#endif
+    return bin_scalar;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Reading
+///////////////////////////////////////////////////////////////////////////////
+
+typedef enum { NUM_INT, NUM_UINT, NUM_FLOAT } NumericKind;
+
+
+// Where a field is in a channel's records in memory
+struct Field
+{
+    NumericKind kind;
+    size_t offset;
+    size_t size;
+};
+
+
+static Field find_field(ChannelInfo const& info, std::string const& field)
+{
+    std::vector<std::string> path;
+    std::string::size_type start(0);
+    while (!field.empty())
+    {
+        std::string::size_type dot(field.find('.', start));
+        path.push_back(field.substr(start, dot == std::string::npos ?
+                    std::string::npos : dot - start));
+        if (dot == std::string::npos)
+        {
+            break;
+        }
+        start = dot + 1;
+    }
+
+    Handle type(Handle::share(info.mem_type()));
+    size_t offset(0);
+    for (size_t ii(0); ii < path.size(); ++ii)
+    {
+        int member(H5Tget_class(type.get()) == H5T_COMPOUND ?
+                H5Tget_member_index(type.get(), path[ii].c_str()) : -1);
+        if (member < 0)
+        {
+            throw std::runtime_error("Channel " + info.name() +
+                    " has no field " + field);
+        }
+        offset += H5Tget_member_offset(type.get(), member);
+        type.reset(H5Tget_member_type(type.get(), member));
+    }
+    H5T_class_t type_class(H5Tget_class(type.get()));
+    Field result = {NUM_FLOAT, offset, H5Tget_size(type.get())};
+    if (type_class == H5T_INTEGER)
+    {
+        result.kind = H5Tget_sign(type.get()) == H5T_SGN_NONE ? NUM_UINT :
+            NUM_INT;
+    }
+    if (!(type_class == H5T_INTEGER && (result.size == 1 ||
+                    result.size == 2 || result.size == 4 ||
+                    result.size == 8)) &&
+            !(type_class == H5T_FLOAT && (result.size == sizeof(float) ||
+                    result.size == sizeof(double))))
+    {
+        throw std::runtime_error(field.empty() ? "Channel " + info.name() +
+                " is not numeric" : "Field " + field + " of channel " +
+                info.name() + " is not numeric");
+    }
+    return result;
+}
+
+
+template<typename T>
+static void gather(char const* records, size_t record_size, size_t count,
+        double* values)
+{
+    for (size_t ii(0); ii < count; ++ii)
+    {
+        T value;
+        memcpy(&value, records + ii * record_size, sizeof(T));
+        values[ii] = static_cast<double>(value);
+    }
+}
+
+
+// Copy a field out of a block of records into an array of doubles
+static void gather_field(Field const& field, char const* records,
+        size_t record_size, size_t count, double* values)
+{
+    records += field.offset;
+    switch (field.kind)
+    {
+        case NUM_INT:
+            switch (field.size)
+            {
+                case 1: gather<int8_t>(records, record_size, count, values);
+                    break;
+                case 2: gather<int16_t>(records, record_size, count, values);
+                    break;
+                case 4: gather<int32_t>(records, record_size, count, values);
+                    break;
+                case 8: gather<int64_t>(records, record_size, count, values);
+                    break;
+            }
+            break;
+        case NUM_UINT:
+            switch (field.size)
+            {
+                case 1: gather<uint8_t>(records, record_size, count, values);
+                    break;
+                case 2: gather<uint16_t>(records, record_size, count, values);
+                    break;
+                case 4: gather<uint32_t>(records, record_size, count, values);
+                    break;
+                case 8: gather<uint64_t>(records, record_size, count, values);
+                    break;
+            }
+            break;
+        case NUM_FLOAT:
+            if (field.size == sizeof(float))
+            {
+                gather<float>(records, record_size, count, values);
+            }
+            else
+            {
+                gather<double>(records, record_size, count, values);
+            }
+            break;
+    }
+}
+
+
+// Read a field over the records [first, last) a block at a time, giving
+// each block to fun as doubles. The records are read whole in the channel's
+// memory type, which the library reads without converting, and the field is
+// taken from them here. Of a columnar channel, only the column holding the
+// field is read.
+template<typename Fun>
+static void scan(HDF5R& file, ChannelID chan, std::string const& field,
+        hsize_t first, hsize_t last, size_t block_records, Fun& fun)
+{
+    ChannelInfo info(file.get_channel_info(chan));
+    Field where(find_field(info, field));
+    size_t record_size(H5Tget_size(info.mem_type()));
+    // Records that are just a double are read straight into the values
+    bool direct(where.kind == NUM_FLOAT && where.size == sizeof(double) &&
+            record_size == sizeof(double));
+    size_t block(std::max<hsize_t>(1, std::min<hsize_t>(block_records,
+                    last > first ? last - first : 0)));
+    std::vector<double> values(block);
+    std::vector<char> records(direct ? 0 : block * record_size);
+    std::vector<std::string> column;
+    if (!field.empty() && file.columnar(chan))
+    {
+        column.push_back(field.substr(0, field.find('.')));
+    }
+    while (first < last)
+    {
+        size_t count(std::min<hsize_t>(block, last - first));
+        void* dest(direct ? static_cast<void*>(&values[0]) : &records[0]);
+        size_t got(column.empty() ?
+                file.get_entries(chan, first, count, 0, dest) :
+                file.get_fields(chan, first, count, column, 0, dest));
+        if (got == 0)
+        {
+            break;
+        }
+        if (!direct)
+        {
+            gather_field(where, &records[0], record_size, got, &values[0]);
+        }
+        fun(&values[0], got);
+        first += got;
+    }
+}
+
+
+struct AggregateFun
+{
+    AggregateFun(SummariseFun kernel)
+        : kernel(kernel)
+    {}
+
+    void operator()(double const* values, size_t count)
+    {
+        kernel(values, count, agg);
+    }
+
+    SummariseFun kernel;
+    Aggregate agg;
+};
+
+
+struct HistogramFun
+{
+    HistogramFun(BinFun kernel, Histogram const& hist)
+        : kernel(kernel), counts(hist.counts.size() + 3, 0)
+    {
+        size_t n(hist.counts.size());
+        bins.low = hist.low;
+        bins.high = hist.high;
+        bins.scale = n / (hist.high - hist.low);
+        bins.last = static_cast<double>(n - 1);
+        bins.below = n;
+        bins.above = n + 1;
+        bins.nan = n + 2;
+    }
+
+    void operator()(double const* values, size_t count)
+    {
+        kernel(values, count, bins, &counts[0]);
+    }
+
+    BinFun kernel;
+    Bins bins;
+    std::vector<uint64_t> counts;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Queries
+///////////////////////////////////////////////////////////////////////////////
+
+Aggregate hdf5r::aggregate(HDF5R& file, ChannelID chan,
+        std::string const& field, hsize_t first, hsize_t last,
+        SimdLevel max_level, size_t block_records)
+{
+    AggregateFun fun(summarise_fun(use_level(max_level)));
+    scan(file, chan, field, first, last, block_records, fun);
+    return fun.agg;
+}
+
+
+Aggregate hdf5r::aggregate_window(HDF5R& file, ChannelID chan,
+        std::string const& field, uint64_t start, uint64_t end,
+        SimdLevel max_level, size_t block_records)
+{
+    hsize_t first(file.find_entry(chan, start));
+    hsize_t last(end > start ? file.find_entry(chan, end) : first);
+    return aggregate(file, chan, field, first, last, max_level,
+            block_records);
+}
+
+
+void hdf5r::histogram(HDF5R& file, ChannelID chan, std::string const& field,
+        hsize_t first, hsize_t last, Histogram& hist, SimdLevel max_level,
+        size_t block_records)
+{
+    // Bin indices go through 32-bit integers in the vector kernels
+    if (hist.counts.empty() ||
+            hist.counts.size() > static_cast<size_t>(
+                std::numeric_limits<int32_t>::max() - 3))
+    {
+        throw std::runtime_error("Bad number of histogram bins");
+    }
+    if (!(hist.high > hist.low))
+    {
+        throw std::runtime_error("Histogram high must be above low");
+    }
+    HistogramFun fun(bin_fun(use_level(max_level)), hist);
+    scan(file, chan, field, first, last, block_records, fun);
+    size_t n(hist.counts.size());
+    for (size_t ii(0); ii < n; ++ii)
+    {
+        hist.counts[ii] += fun.counts[ii];
+    }
+    hist.below += fun.counts[fun.bins.below];
+    hist.above += fun.counts[fun.bins.above];
+}
+
+
+void hdf5r::histogram_window(HDF5R& file, ChannelID chan,
+        std::string const& field, uint64_t start, uint64_t end,
+        Histogram& hist, SimdLevel max_level, size_t block_records)
+{
+    hsize_t first(file.find_entry(chan, start));
+    hsize_t last(end > start ? file.find_entry(chan, end) : first);
+    histogram(file, chan, field, first, last, hist, max_level,
+            block_records);
+}
+
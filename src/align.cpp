@@ -0,0 +1,366 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Alignment of several channels to a common timeline.
+ */
+
+#include <hdf5r/align.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace hdf5r;
+
+
+typedef enum { NUM_INT, NUM_UINT, NUM_FLOAT } NumericKind;
+
+
+// A field of a record that linear interpolation applies to
+struct NumericField
+{
+    NumericKind kind;
+    size_t offset;
+    size_t size;
+};
+
+
+// A channel being aligned. The cursor's position is the number of records
+// with time stamps at or before the last time aligned to.
+struct hdf5r::AlignCursor
+{
+    ChannelID id;
+    hsize_t size;
+    size_t record_size;
+    std::vector<NumericField> fields;
+    hsize_t pos;
+    // Blocks of time stamps and records, from ts_start and rec_start
+    std::vector<uint64_t> ts;
+    hsize_t ts_start;
+    size_t ts_count;
+    std::vector<char> recs;
+    hsize_t rec_start;
+    size_t rec_count;
+};
+
+
+static void find_numeric_fields(hid_t type, size_t offset,
+        std::vector<NumericField>& fields)
+{
+    H5T_class_t type_class(H5Tget_class(type));
+    size_t size(H5Tget_size(type));
+    if (type_class == H5T_INTEGER)
+    {
+        NumericField field = {H5Tget_sign(type) == H5T_SGN_NONE ? NUM_UINT :
+            NUM_INT, offset, size};
+        fields.push_back(field);
+    }
+    else if (type_class == H5T_FLOAT &&
+            (size == sizeof(float) || size == sizeof(double)))
+    {
+        NumericField field = {NUM_FLOAT, offset, size};
+        fields.push_back(field);
+    }
+    else if (type_class == H5T_COMPOUND)
+    {
+        int members(H5Tget_nmembers(type));
+        for (int ii(0); ii < members; ++ii)
+        {
+            hid_t member_type(H5Tget_member_type(type, ii));
+            find_numeric_fields(member_type,
+                    offset + H5Tget_member_offset(type, ii), fields);
+            H5Tclose(member_type);
+        }
+    }
+    else if (type_class == H5T_ARRAY)
+    {
+        hid_t base(H5Tget_super(type));
+        size_t base_size(H5Tget_size(base));
+        for (size_t ii(0); ii < size / base_size; ++ii)
+        {
+            find_numeric_fields(base, offset + ii * base_size, fields);
+        }
+        H5Tclose(base);
+    }
+    // Anything else is held
+}
+
+
+template<typename T>
+static void lerp_int(char* dest, char const* a, char const* b, double frac)
+{
+    T va, vb;
+    memcpy(&va, a, sizeof(T));
+    memcpy(&vb, b, sizeof(T));
+    double value(static_cast<double>(va) +
+            (static_cast<double>(vb) - static_cast<double>(va)) * frac);
+    T result(static_cast<T>(std::floor(value + 0.5)));
+    memcpy(dest, &result, sizeof(T));
+}
+
+
+template<typename T>
+static void lerp_float(char* dest, char const* a, char const* b, double frac)
+{
+    T va, vb;
+    memcpy(&va, a, sizeof(T));
+    memcpy(&vb, b, sizeof(T));
+    T result(static_cast<T>(va + (vb - va) * frac));
+    memcpy(dest, &result, sizeof(T));
+}
+
+
+static void lerp_field(NumericField const& field, char* dest, char const* a,
+        char const* b, double frac)
+{
+    dest += field.offset;
+    a += field.offset;
+    b += field.offset;
+    switch (field.kind)
+    {
+        case NUM_INT:
+            switch (field.size)
+            {
+                case 1: lerp_int<int8_t>(dest, a, b, frac); break;
+                case 2: lerp_int<int16_t>(dest, a, b, frac); break;
+                case 4: lerp_int<int32_t>(dest, a, b, frac); break;
+                case 8: lerp_int<int64_t>(dest, a, b, frac); break;
+            }
+            break;
+        case NUM_UINT:
+            switch (field.size)
+            {
+                case 1: lerp_int<uint8_t>(dest, a, b, frac); break;
+                case 2: lerp_int<uint16_t>(dest, a, b, frac); break;
+                case 4: lerp_int<uint32_t>(dest, a, b, frac); break;
+                case 8: lerp_int<uint64_t>(dest, a, b, frac); break;
+            }
+            break;
+        case NUM_FLOAT:
+            if (field.size == sizeof(float))
+            {
+                lerp_float<float>(dest, a, b, frac);
+            }
+            else
+            {
+                lerp_float<double>(dest, a, b, frac);
+            }
+            break;
+    }
+}
+
+
+// Make sure time stamps [first, first + count) are in the cursor's block
+static void load_timestamps(HDF5R& file, AlignCursor& cursor, hsize_t first,
+        size_t count, size_t block_records)
+{
+    if (first >= cursor.ts_start &&
+            first + count <= cursor.ts_start + cursor.ts_count)
+    {
+        return;
+    }
+    cursor.ts.resize(std::max(block_records, count));
+    cursor.ts_start = first;
+    cursor.ts_count = file.get_entries(cursor.id, first, cursor.ts.size(),
+            &cursor.ts[0], 0);
+}
+
+
+// Return record index, reading it along with count - 1 following records
+// if they aren't in the cursor's block
+static char const* load_records(HDF5R& file, AlignCursor& cursor,
+        hsize_t index, size_t count, size_t block_records)
+{
+    if (index < cursor.rec_start ||
+            index + count > cursor.rec_start + cursor.rec_count)
+    {
+        size_t block(std::max(block_records, count));
+        cursor.recs.resize(block * cursor.record_size);
+        cursor.rec_start = index;
+        cursor.rec_count = file.get_entries(cursor.id, index, block, 0,
+                &cursor.recs[0]);
+    }
+    return &cursor.recs[(index - cursor.rec_start) * cursor.record_size];
+}
+
+
+// Move a cursor past the records with time stamps at or before time
+static void advance(HDF5R& file, AlignCursor& cursor, uint64_t time,
+        size_t block_records)
+{
+    while (cursor.pos < cursor.size)
+    {
+        load_timestamps(file, cursor, cursor.pos, 1, block_records);
+        std::vector<uint64_t>::const_iterator begin(cursor.ts.begin() +
+                (cursor.pos - cursor.ts_start));
+        std::vector<uint64_t>::const_iterator end(cursor.ts.begin() +
+                cursor.ts_count);
+        std::vector<uint64_t>::const_iterator next(
+                std::upper_bound(begin, end, time));
+        cursor.pos = cursor.ts_start + (next - cursor.ts.begin());
+        if (next != end)
+        {
+            break;
+        }
+        // The whole block is at or before the time. Rather than read every
+        // block up to it, find the first record after it.
+        if (cursor.pos < cursor.size)
+        {
+            cursor.pos = time == static_cast<uint64_t>(-1) ? cursor.size :
+                std::max(cursor.pos, file.find_entry(cursor.id, time + 1));
+        }
+    }
+}
+
+
+Aligner::Aligner(HDF5R& file, std::vector<ChannelID> const& channels,
+        Interpolation interpolation, size_t block_records)
+    : file_(file), interpolation_(interpolation),
+    block_records_(std::max<size_t>(block_records, 2))
+{
+    try
+    {
+        for (std::vector<ChannelID>::const_iterator ii(channels.begin());
+                ii != channels.end(); ++ii)
+        {
+            ChannelInfo info(file.get_channel_info(*ii));
+            AlignCursor* cursor(new AlignCursor);
+            cursors_.push_back(cursor);
+            cursor->id = *ii;
+            cursor->size = info.size();
+            cursor->record_size = H5Tget_size(info.mem_type());
+            if (interpolation_ == LINEAR)
+            {
+                find_numeric_fields(info.mem_type(), 0, cursor->fields);
+            }
+            cursor->pos = 0;
+            cursor->ts_start = cursor->ts_count = 0;
+            cursor->rec_start = cursor->rec_count = 0;
+        }
+    }
+    catch (...)
+    {
+        for (size_t ii(0); ii < cursors_.size(); ++ii)
+        {
+            delete cursors_[ii];
+        }
+        throw;
+    }
+}
+
+
+Aligner::~Aligner()
+{
+    for (size_t ii(0); ii < cursors_.size(); ++ii)
+    {
+        delete cursors_[ii];
+    }
+}
+
+
+void Aligner::align(uint64_t const* times, size_t count, AlignedRecords& out)
+{
+    out.times.assign(times, times + count);
+    out.record_sizes.resize(cursors_.size());
+    out.columns.resize(cursors_.size());
+    out.valid.resize(cursors_.size());
+    for (size_t ii(0); ii < cursors_.size(); ++ii)
+    {
+        AlignCursor& cursor(*cursors_[ii]);
+        size_t rec_size(cursor.record_size);
+        out.record_sizes[ii] = rec_size;
+        out.columns[ii].assign(count * rec_size, 0);
+        out.valid[ii].assign(count, 0);
+        for (size_t jj(0); jj < count; ++jj)
+        {
+            advance(file_, cursor, times[jj], block_records_);
+            if (cursor.pos == 0)
+            {
+                // No record yet
+                continue;
+            }
+            char* dest(&out.columns[ii][jj * rec_size]);
+            out.valid[ii][jj] = 1;
+            hsize_t prev(cursor.pos - 1);
+            if (interpolation_ == SAMPLE_AND_HOLD ||
+                    cursor.pos == cursor.size || cursor.fields.empty())
+            {
+                memcpy(dest, load_records(file_, cursor, prev, 1,
+                            block_records_), rec_size);
+                continue;
+            }
+            // Times either side of this one
+            load_timestamps(file_, cursor, prev, 2, block_records_);
+            uint64_t t0(cursor.ts[prev - cursor.ts_start]);
+            uint64_t t1(cursor.ts[prev + 1 - cursor.ts_start]);
+            // Records out of time order would put t1 before t0
+            double frac(t1 > t0 ?
+                    static_cast<double>(times[jj] - t0) / (t1 - t0) : 0);
+            char const* a(load_records(file_, cursor, prev, 2,
+                        block_records_));
+            char const* b(a + rec_size);
+            memcpy(dest, a, rec_size);
+            for (std::vector<NumericField>::const_iterator kk(
+                        cursor.fields.begin()); kk != cursor.fields.end();
+                    ++kk)
+            {
+                lerp_field(*kk, dest, a, b, frac);
+            }
+        }
+    }
+}
+
+
+AlignedRecords hdf5r::align_fixed_rate(HDF5R& file,
+        std::vector<ChannelID> const& channels, uint64_t start,
+        uint64_t period, uint64_t end, Interpolation interpolation)
+{
+    if (period == 0)
+    {
+        throw std::runtime_error("Alignment period must not be zero");
+    }
+    std::vector<uint64_t> times;
+    if (end > start)
+    {
+        times.reserve((end - start - 1) / period + 1);
+        for (uint64_t time(start); time < end; time += period)
+        {
+            times.push_back(time);
+            if (end - time <= period)
+            {
+                break;
+            }
+        }
+    }
+    AlignedRecords result;
+    Aligner aligner(file, channels, interpolation);
+    aligner.align(times.empty() ? 0 : &times[0], times.size(), result);
+    return result;
+}
+
+
+AlignedRecords hdf5r::align_to_channel(HDF5R& file,
+        std::vector<ChannelID> const& channels, ChannelID timeline,
+        Interpolation interpolation)
+{
+    std::vector<uint64_t> times(file.get_channel_info(timeline).size());
+    if (!times.empty())
+    {
+        file.get_entries(timeline, 0, times.size(), &times[0], 0);
+    }
+    AlignedRecords result;
+    Aligner aligner(file, channels, interpolation);
+    aligner.align(times.empty() ? 0 : &times[0], times.size(), result);
+    return result;
+}
+
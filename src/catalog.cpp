@@ -0,0 +1,1006 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Catalog of the contents of many files.
+ */
+
+#include <hdf5r/catalog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <map>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace hdf5r;
+
+
+static unsigned int const CATALOG_VERSION(2);
+static hsize_t const TABLE_CHUNK(16384);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Catalog file
+///////////////////////////////////////////////////////////////////////////////
+
+// The catalog is a set of tables of 64-bit values. Strings are kept once
+// each in a pool and referred to by their offsets, as most channel names,
+// types and sources are shared by many files. Each file's channels and tags
+// follow on from the previous file's in their tables.
+
+static char const* const FILE_FIELDS[] = {"path", "bytes", "mtime",
+    "channels", "tags"};
+static char const* const CHANNEL_FIELDS[] = {"name", "type_name",
+    "source_name", "size", "start_time", "end_time"};
+static char const* const TAG_FIELDS[] = {"name", "type", "size", "value",
+    "value_size"};
+
+struct FileRow
+{
+    uint64_t path, bytes, mtime, channels, tags;
+};
+
+struct ChannelRow
+{
+    uint64_t name, type_name, source_name, size, start_time, end_time;
+};
+
+struct TagRow
+{
+    // Kept tag values are in a table of bytes of their own
+    uint64_t name, type, size, value, value_size;
+};
+
+
+// A compound of 64-bit unsigned fields
+static hid_t row_type(char const* const* fields, size_t count, hid_t base)
+{
+    hid_t type(H5Tcreate(H5T_COMPOUND, count * sizeof(uint64_t)));
+    for (size_t ii(0); ii < count; ++ii)
+    {
+        H5Tinsert(type, fields[ii], ii * sizeof(uint64_t), base);
+    }
+    return type;
+}
+
+
+static void write_table(hid_t file, char const* name, hid_t mem_type,
+        hid_t file_type, size_t count, void const* data)
+{
+    hsize_t dims[1] = {count};
+    Handle space(H5Screate_simple(1, dims, 0));
+    Handle props(H5Pcreate(H5P_DATASET_CREATE));
+    if (count > 0)
+    {
+        hsize_t chunk[1] = {std::min<hsize_t>(count, TABLE_CHUNK)};
+        H5Pset_chunk(props.get(), 1, chunk);
+        if (H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0)
+        {
+            H5Pset_shuffle(props.get());
+            H5Pset_deflate(props.get(), 6);
+        }
+    }
+    Handle set(H5Dcreate(file, name, file_type, space.get(), H5P_DEFAULT,
+                props.get(), H5P_DEFAULT));
+    if (!set.valid() || (count > 0 && H5Dwrite(set.get(), mem_type, H5S_ALL,
+                    H5S_ALL, H5P_DEFAULT, data) < 0))
+    {
+        throw std::runtime_error(std::string("Failed to write catalog "
+                    "table ") + name);
+    }
+}
+
+
+template<typename T>
+static void read_table(hid_t file, char const* name, hid_t mem_type,
+        std::vector<T>& rows)
+{
+    Handle set(H5Dopen(file, name, H5P_DEFAULT));
+    if (!set.valid())
+    {
+        throw std::runtime_error(std::string("Catalog has no table ") +
+                name);
+    }
+    Handle space(H5Dget_space(set.get()));
+    hsize_t dims[1] = {0};
+    H5Sget_simple_extent_dims(space.get(), dims, 0);
+    rows.resize(dims[0]);
+    if (dims[0] > 0 && H5Dread(set.get(), mem_type, H5S_ALL, H5S_ALL,
+                H5P_DEFAULT, &rows[0]) < 0)
+    {
+        throw std::runtime_error(std::string("Failed to read catalog table ") +
+                name);
+    }
+}
+
+
+// Offsets of strings in a pool
+class StringPool
+{
+    public:
+        uint64_t add(std::string const& str)
+        {
+            std::map<std::string, uint64_t>::const_iterator found(
+                    offsets_.find(str));
+            if (found != offsets_.end())
+            {
+                return found->second;
+            }
+            uint64_t offset(bytes.size());
+            bytes.insert(bytes.end(), str.begin(), str.end());
+            bytes.push_back(0);
+            offsets_[str] = offset;
+            return offset;
+        }
+
+        std::vector<char> bytes;
+
+    private:
+        std::map<std::string, uint64_t> offsets_;
+};
+
+
+static std::string pool_string(std::vector<char> const& pool,
+        uint64_t offset)
+{
+    if (offset >= pool.size())
+    {
+        throw std::runtime_error("Catalog string out of range");
+    }
+    return std::string(&pool[offset]);
+}
+
+
+// Find the time bounds of a file's channels
+static void file_bounds(CatalogFile& file)
+{
+    file.start_time = file.end_time = 0;
+    bool any(false);
+    for (std::vector<CatalogChannel>::const_iterator ii(
+                file.channels.begin()); ii != file.channels.end(); ++ii)
+    {
+        if (ii->size == 0)
+        {
+            continue;
+        }
+        if (!any || ii->start_time < file.start_time)
+        {
+            file.start_time = ii->start_time;
+        }
+        if (!any || ii->end_time > file.end_time)
+        {
+            file.end_time = ii->end_time;
+        }
+        any = true;
+    }
+}
+
+
+Catalog::Catalog()
+{
+}
+
+
+void Catalog::save(std::string const& path) const
+{
+    StringPool pool;
+    std::vector<FileRow> file_rows;
+    std::vector<ChannelRow> chan_rows;
+    std::vector<TagRow> tag_rows;
+    std::vector<char> values;
+    for (std::vector<CatalogFile>::const_iterator ii(files_.begin());
+            ii != files_.end(); ++ii)
+    {
+        FileRow row = {pool.add(ii->path), ii->bytes, ii->mtime,
+            ii->channels.size(), ii->tags.size()};
+        file_rows.push_back(row);
+        for (std::vector<CatalogChannel>::const_iterator jj(
+                    ii->channels.begin()); jj != ii->channels.end(); ++jj)
+        {
+            ChannelRow chan = {pool.add(jj->name), pool.add(jj->type_name),
+                pool.add(jj->source_name), jj->size, jj->start_time,
+                jj->end_time};
+            chan_rows.push_back(chan);
+        }
+        for (CatalogTagMap::const_iterator jj(ii->tags.begin());
+                jj != ii->tags.end(); ++jj)
+        {
+            TagRow tag = {pool.add(jj->first),
+                static_cast<uint64_t>(jj->second.type), jj->second.size,
+                values.size(), jj->second.value.size()};
+            tag_rows.push_back(tag);
+            values.insert(values.end(), jj->second.value.begin(),
+                    jj->second.value.end());
+        }
+    }
+
+    // Written beside the old catalog and moved over it, so that a failed
+    // save leaves the old one as it was
+    std::string temp(path + ".tmp");
+    try
+    {
+        Handle file(H5Fcreate(temp.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                    H5P_DEFAULT));
+        if (!file.valid())
+        {
+            throw std::runtime_error("Failed to create catalog " + temp);
+        }
+        hsize_t one[1] = {1};
+        Handle scalar(H5Screate_simple(1, one, 0));
+        Handle attr(H5Acreate(file.get(), "catalog_version", H5T_STD_U32LE,
+                    scalar.get(), H5P_DEFAULT, H5P_DEFAULT));
+        if (!attr.valid() || H5Awrite(attr.get(), H5T_NATIVE_UINT,
+                    &CATALOG_VERSION) < 0)
+        {
+            throw std::runtime_error("Failed to write catalog version");
+        }
+
+        size_t const file_fields(sizeof(FILE_FIELDS) / sizeof(char*));
+        size_t const chan_fields(sizeof(CHANNEL_FIELDS) / sizeof(char*));
+        size_t const tag_fields(sizeof(TAG_FIELDS) / sizeof(char*));
+        Handle file_mem(row_type(FILE_FIELDS, file_fields,
+                    H5T_NATIVE_UINT64));
+        Handle file_disk(row_type(FILE_FIELDS, file_fields, H5T_STD_U64LE));
+        Handle chan_mem(row_type(CHANNEL_FIELDS, chan_fields,
+                    H5T_NATIVE_UINT64));
+        Handle chan_disk(row_type(CHANNEL_FIELDS, chan_fields,
+                    H5T_STD_U64LE));
+        Handle tag_mem(row_type(TAG_FIELDS, tag_fields, H5T_NATIVE_UINT64));
+        Handle tag_disk(row_type(TAG_FIELDS, tag_fields, H5T_STD_U64LE));
+        write_table(file.get(), "strings", H5T_NATIVE_CHAR, H5T_STD_I8LE,
+                pool.bytes.size(), pool.bytes.empty() ? 0 : &pool.bytes[0]);
+        write_table(file.get(), "files", file_mem.get(), file_disk.get(),
+                file_rows.size(), file_rows.empty() ? 0 : &file_rows[0]);
+        write_table(file.get(), "channels", chan_mem.get(), chan_disk.get(),
+                chan_rows.size(), chan_rows.empty() ? 0 : &chan_rows[0]);
+        write_table(file.get(), "tags", tag_mem.get(), tag_disk.get(),
+                tag_rows.size(), tag_rows.empty() ? 0 : &tag_rows[0]);
+        write_table(file.get(), "tag_values", H5T_NATIVE_CHAR, H5T_STD_I8LE,
+                values.size(), values.empty() ? 0 : &values[0]);
+        if (H5Fflush(file.get(), H5F_SCOPE_LOCAL) < 0)
+        {
+            throw std::runtime_error("Failed to write catalog " + temp);
+        }
+    }
+    catch (...)
+    {
+        std::remove(temp.c_str());
+        throw;
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temp.c_str());
+        throw std::runtime_error("Failed to replace catalog " + path + ": " +
+                strerror(errno));
+    }
+}
+
+
+void Catalog::load(std::string const& path)
+{
+    Handle file(H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+    if (!file.valid())
+    {
+        throw std::runtime_error("Failed to open catalog " + path);
+    }
+    unsigned int version(0);
+    Handle attr(H5Aopen(file.get(), "catalog_version", H5P_DEFAULT));
+    if (!attr.valid() || H5Aread(attr.get(), H5T_NATIVE_UINT, &version) < 0)
+    {
+        throw std::runtime_error(path + " is not a catalog");
+    }
+    if (version != CATALOG_VERSION)
+    {
+        throw std::runtime_error("Unsupported version of catalog " + path);
+    }
+
+    Handle file_mem(row_type(FILE_FIELDS,
+                sizeof(FILE_FIELDS) / sizeof(char*), H5T_NATIVE_UINT64));
+    Handle chan_mem(row_type(CHANNEL_FIELDS,
+                sizeof(CHANNEL_FIELDS) / sizeof(char*), H5T_NATIVE_UINT64));
+    Handle tag_mem(row_type(TAG_FIELDS,
+                sizeof(TAG_FIELDS) / sizeof(char*), H5T_NATIVE_UINT64));
+    std::vector<char> pool, values;
+    std::vector<FileRow> file_rows;
+    std::vector<ChannelRow> chan_rows;
+    std::vector<TagRow> tag_rows;
+    read_table(file.get(), "strings", H5T_NATIVE_CHAR, pool);
+    read_table(file.get(), "files", file_mem.get(), file_rows);
+    read_table(file.get(), "channels", chan_mem.get(), chan_rows);
+    read_table(file.get(), "tags", tag_mem.get(), tag_rows);
+    read_table(file.get(), "tag_values", H5T_NATIVE_CHAR, values);
+    if (!pool.empty() && pool[pool.size() - 1] != 0)
+    {
+        throw std::runtime_error("Catalog " + path + " is truncated");
+    }
+
+    std::vector<CatalogFile> files(file_rows.size());
+    size_t next_chan(0), next_tag(0);
+    for (size_t ii(0); ii < file_rows.size(); ++ii)
+    {
+        FileRow const& row(file_rows[ii]);
+        if (row.channels > chan_rows.size() - next_chan ||
+                row.tags > tag_rows.size() - next_tag)
+        {
+            throw std::runtime_error("Catalog " + path + " is truncated");
+        }
+        CatalogFile& entry(files[ii]);
+        entry.path = pool_string(pool, row.path);
+        entry.bytes = row.bytes;
+        entry.mtime = row.mtime;
+        entry.channels.resize(row.channels);
+        for (size_t jj(0); jj < row.channels; ++jj, ++next_chan)
+        {
+            ChannelRow const& chan(chan_rows[next_chan]);
+            CatalogChannel& dest(entry.channels[jj]);
+            dest.name = pool_string(pool, chan.name);
+            dest.type_name = pool_string(pool, chan.type_name);
+            dest.source_name = pool_string(pool, chan.source_name);
+            dest.size = chan.size;
+            dest.start_time = chan.start_time;
+            dest.end_time = chan.end_time;
+        }
+        for (size_t jj(0); jj < row.tags; ++jj, ++next_tag)
+        {
+            TagRow const& tag(tag_rows[next_tag]);
+            if (tag.value > values.size() ||
+                    tag.value_size > values.size() - tag.value)
+            {
+                throw std::runtime_error("Catalog tag value out of range");
+            }
+            CatalogTag& dest(entry.tags[pool_string(pool, tag.name)]);
+            dest.type = static_cast<TagType>(tag.type);
+            dest.size = tag.size;
+            dest.value.assign(values.begin() + tag.value,
+                    values.begin() + tag.value + tag.value_size);
+        }
+        file_bounds(entry);
+    }
+    files_.swap(files);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Scanning
+///////////////////////////////////////////////////////////////////////////////
+
+// A file found under the root
+struct FoundFile
+{
+    std::string path;
+    uint64_t bytes;
+    uint64_t mtime;
+};
+
+
+static bool has_suffix(std::string const& name, std::string const& suffix)
+{
+    return name.size() >= suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(),
+                suffix) == 0;
+}
+
+
+static void add_found(std::string const& path, struct stat const& info,
+        std::vector<FoundFile>& found)
+{
+    FoundFile file = {path, static_cast<uint64_t>(info.st_size),
+        static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000ULL +
+            info.st_mtim.tv_nsec};
+    found.push_back(file);
+}
+
+
+// Files with names ending in suffix under a directory. Links to files are
+// followed, but links to directories are not, so that the walk ends.
+static void find_files(std::string const& dir, std::string const& suffix,
+        std::vector<FoundFile>& found)
+{
+    DIR* handle(opendir(dir.c_str()));
+    if (handle == 0)
+    {
+        throw std::runtime_error("Failed to read directory " + dir + ": " +
+                strerror(errno));
+    }
+    std::vector<std::string> subdirs;
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != 0)
+    {
+        std::string name(entry->d_name);
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+        std::string path(dir + '/' + name);
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(info.st_mode))
+        {
+            subdirs.push_back(path);
+        }
+        else if (has_suffix(name, suffix) && (S_ISREG(info.st_mode) ||
+                    (S_ISLNK(info.st_mode) && stat(path.c_str(), &info) == 0 &&
+                     S_ISREG(info.st_mode))))
+        {
+            add_found(path, info, found);
+        }
+    }
+    closedir(handle);
+    for (std::vector<std::string>::const_iterator ii(subdirs.begin());
+            ii != subdirs.end(); ++ii)
+    {
+        find_files(*ii, suffix, found);
+    }
+}
+
+
+static void scan_file(FoundFile const& found, CatalogFile& file)
+{
+    file.path = found.path;
+    file.bytes = found.bytes;
+    file.mtime = found.mtime;
+    HDF5R log(found.path, RDONLY);
+    std::vector<ChannelID> channels(log.channels());
+    for (std::vector<ChannelID>::const_iterator ii(channels.begin());
+            ii != channels.end(); ++ii)
+    {
+        ChannelInfo info(log.get_channel_info(*ii));
+        CatalogChannel chan;
+        chan.name = info.name();
+        chan.type_name = info.type_name();
+        chan.source_name = info.source_name();
+        chan.size = info.size();
+        chan.start_time = info.start_time();
+        chan.end_time = info.end_time();
+        file.channels.push_back(chan);
+    }
+    // Only the sizes of binary and long text tags are wanted, so their
+    // values are not read
+    std::map<std::string, TagType> tags(log.get_tags());
+    for (std::map<std::string, TagType>::const_iterator ii(tags.begin());
+            ii != tags.end(); ++ii)
+    {
+        CatalogTag& tag(file.tags[ii->first]);
+        tag.type = ii->second;
+        tag.size = log.get_binary_tag(ii->first, 0);
+        if (tag.type == STRING_TAG)
+        {
+            // Less the terminator
+            tag.size = tag.size > 0 ? tag.size - 1 : 0;
+            if (tag.size <= CATALOG_TAG_VALUE_BYTES)
+            {
+                tag.value = log.get_text_tag(ii->first);
+                tag.size = tag.value.size();
+            }
+        }
+    }
+    file_bounds(file);
+}
+
+
+// Scan results pass from the worker processes through pipes, as a file's
+// number in the list to scan, whether it was read, and then either its
+// contents or why it could not be read
+
+static void put_uint(std::string& out, uint64_t value)
+{
+    out.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+
+static void put_string(std::string& out, std::string const& str)
+{
+    put_uint(out, str.size());
+    out += str;
+}
+
+
+// Reads values from a worker's results, returning false at their end
+class ResultReader
+{
+    public:
+        ResultReader(std::string const& data)
+            : data_(data), pos_(0)
+        {}
+
+        bool get_uint(uint64_t& value)
+        {
+            if (data_.size() - pos_ < sizeof(value))
+            {
+                return false;
+            }
+            memcpy(&value, data_.data() + pos_, sizeof(value));
+            pos_ += sizeof(value);
+            return true;
+        }
+
+        bool get_string(std::string& str)
+        {
+            uint64_t size;
+            if (!get_uint(size) || data_.size() - pos_ < size)
+            {
+                return false;
+            }
+            str.assign(data_, pos_, size);
+            pos_ += size;
+            return true;
+        }
+
+    private:
+        std::string const& data_;
+        size_t pos_;
+};
+
+
+static void put_result(std::string& out, uint64_t index,
+        CatalogFile const& file)
+{
+    put_uint(out, index);
+    put_uint(out, 1);
+    put_uint(out, file.channels.size());
+    for (std::vector<CatalogChannel>::const_iterator ii(
+                file.channels.begin()); ii != file.channels.end(); ++ii)
+    {
+        put_string(out, ii->name);
+        put_string(out, ii->type_name);
+        put_string(out, ii->source_name);
+        put_uint(out, ii->size);
+        put_uint(out, ii->start_time);
+        put_uint(out, ii->end_time);
+    }
+    put_uint(out, file.tags.size());
+    for (CatalogTagMap::const_iterator ii(file.tags.begin());
+            ii != file.tags.end(); ++ii)
+    {
+        put_string(out, ii->first);
+        put_uint(out, ii->second.type);
+        put_uint(out, ii->second.size);
+        put_string(out, ii->second.value);
+    }
+}
+
+
+static void put_error(std::string& out, uint64_t index,
+        std::string const& error)
+{
+    put_uint(out, index);
+    put_uint(out, 0);
+    put_string(out, error);
+}
+
+
+// Read one result, returning false if the results end part way through it
+static bool get_result(ResultReader& in, uint64_t& index, bool& read,
+        CatalogFile& file, std::string& error)
+{
+    uint64_t ok, channels, tags;
+    if (!in.get_uint(index) || !in.get_uint(ok))
+    {
+        return false;
+    }
+    read = ok != 0;
+    if (!read)
+    {
+        return in.get_string(error);
+    }
+    if (!in.get_uint(channels))
+    {
+        return false;
+    }
+    file.channels.resize(channels);
+    for (uint64_t ii(0); ii < channels; ++ii)
+    {
+        CatalogChannel& chan(file.channels[ii]);
+        if (!in.get_string(chan.name) || !in.get_string(chan.type_name) ||
+                !in.get_string(chan.source_name) || !in.get_uint(chan.size) ||
+                !in.get_uint(chan.start_time) || !in.get_uint(chan.end_time))
+        {
+            return false;
+        }
+    }
+    if (!in.get_uint(tags))
+    {
+        return false;
+    }
+    for (uint64_t ii(0); ii < tags; ++ii)
+    {
+        std::string name;
+        uint64_t type;
+        if (!in.get_string(name) || !in.get_uint(type))
+        {
+            return false;
+        }
+        CatalogTag& tag(file.tags[name]);
+        tag.type = static_cast<TagType>(type);
+        if (!in.get_uint(tag.size) || !in.get_string(tag.value))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool write_all(int fd, std::string const& data)
+{
+    size_t done(0);
+    while (done < data.size())
+    {
+        ssize_t wrote(write(fd, data.data() + done, data.size() - done));
+        if (wrote < 0 && errno != EINTR)
+        {
+            return false;
+        }
+        done += wrote > 0 ? wrote : 0;
+    }
+    return true;
+}
+
+
+// Scan files, taking the next one from the shared counter until none are
+// left, and send the results down a pipe
+static void scan_worker(std::vector<FoundFile> const& todo,
+        uint64_t volatile* next, int fd)
+{
+    std::string out;
+    for (;;)
+    {
+        uint64_t index(__sync_fetch_and_add(next, 1));
+        if (index >= todo.size())
+        {
+            break;
+        }
+        CatalogFile file;
+        try
+        {
+            scan_file(todo[index], file);
+            put_result(out, index, file);
+        }
+        catch (std::exception const& e)
+        {
+            put_error(out, index, e.what());
+        }
+        // Send results as they are made, so the pipe doesn't fill up only
+        // at the end
+        if (out.size() > 65536)
+        {
+            if (!write_all(fd, out))
+            {
+                return;
+            }
+            out.clear();
+        }
+    }
+    write_all(fd, out);
+}
+
+
+// Scan files in worker processes, as the HDF5 library can only be used by
+// one thread of a process at a time. Each worker's results are collected
+// whole before any are looked at.
+static void scan_in_workers(std::vector<FoundFile> const& todo,
+        unsigned int workers, std::vector<std::string>& results)
+{
+    uint64_t volatile* next(static_cast<uint64_t volatile*>(mmap(0,
+                    sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0)));
+    if (next == MAP_FAILED)
+    {
+        throw std::runtime_error(std::string("Failed to map scan counter: ") +
+                strerror(errno));
+    }
+    *next = 0;
+    std::vector<pid_t> pids;
+    std::vector<int> fds;
+    for (unsigned int ii(0); ii < workers; ++ii)
+    {
+        int ends[2];
+        if (pipe(ends) != 0)
+        {
+            break;
+        }
+        pid_t pid(fork());
+        if (pid == 0)
+        {
+            close(ends[0]);
+            for (size_t jj(0); jj < fds.size(); ++jj)
+            {
+                close(fds[jj]);
+            }
+            scan_worker(todo, next, ends[1]);
+            close(ends[1]);
+            _exit(0);
+        }
+        close(ends[1]);
+        if (pid < 0)
+        {
+            close(ends[0]);
+            break;
+        }
+        pids.push_back(pid);
+        fds.push_back(ends[0]);
+    }
+
+    results.assign(fds.size(), std::string());
+    std::vector<pollfd> polls(fds.size());
+    for (size_t ii(0); ii < fds.size(); ++ii)
+    {
+        polls[ii].fd = fds[ii];
+        polls[ii].events = POLLIN;
+    }
+    size_t open(fds.size());
+    char buf[65536];
+    while (open > 0)
+    {
+        if (poll(&polls[0], polls.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        for (size_t ii(0); ii < polls.size(); ++ii)
+        {
+            if (polls[ii].fd < 0 || polls[ii].revents == 0)
+            {
+                continue;
+            }
+            ssize_t got(read(polls[ii].fd, buf, sizeof(buf)));
+            if (got > 0)
+            {
+                results[ii].append(buf, got);
+            }
+            else if (got == 0 || errno != EINTR)
+            {
+                close(polls[ii].fd);
+                polls[ii].fd = -1;
+                --open;
+            }
+        }
+    }
+    for (size_t ii(0); ii < polls.size(); ++ii)
+    {
+        if (polls[ii].fd >= 0)
+        {
+            close(polls[ii].fd);
+        }
+    }
+    for (size_t ii(0); ii < pids.size(); ++ii)
+    {
+        waitpid(pids[ii], 0, 0);
+    }
+    munmap(const_cast<uint64_t*>(next), sizeof(uint64_t));
+    if (pids.empty())
+    {
+        throw std::runtime_error("Failed to start scanning processes");
+    }
+}
+
+
+static bool path_order(CatalogFile const& a, CatalogFile const& b)
+{
+    return a.path < b.path;
+}
+
+
+CatalogStats Catalog::update(std::string const& root,
+        std::string const& suffix, unsigned int workers)
+{
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    CatalogStats stats;
+
+    std::string base(root);
+    while (base.size() > 1 && base[base.size() - 1] == '/')
+    {
+        base.erase(base.size() - 1);
+    }
+    std::vector<FoundFile> found;
+    struct stat info;
+    if (stat(base.c_str(), &info) != 0)
+    {
+        throw std::runtime_error("Failed to find " + base + ": " +
+                strerror(errno));
+    }
+    if (S_ISDIR(info.st_mode))
+    {
+        find_files(base, suffix, found);
+    }
+    else
+    {
+        add_found(base, info, found);
+    }
+    stats.files = found.size();
+
+    // Keep what hasn't changed, and the files outside the root
+    std::string prefix(base == "/" ? base : base + '/');
+    std::map<std::string, size_t> old;
+    for (size_t ii(0); ii < files_.size(); ++ii)
+    {
+        old[files_[ii].path] = ii;
+    }
+    std::vector<CatalogFile> files;
+    std::vector<FoundFile> todo;
+    for (std::vector<FoundFile>::const_iterator ii(found.begin());
+            ii != found.end(); ++ii)
+    {
+        std::map<std::string, size_t>::iterator known(old.find(ii->path));
+        if (known == old.end())
+        {
+            todo.push_back(*ii);
+            continue;
+        }
+        CatalogFile& file(files_[known->second]);
+        old.erase(known);
+        if (file.bytes == ii->bytes && file.mtime == ii->mtime)
+        {
+            files.push_back(file);
+            ++stats.unchanged;
+        }
+        else
+        {
+            todo.push_back(*ii);
+        }
+    }
+    for (std::map<std::string, size_t>::iterator ii(old.begin());
+            ii != old.end(); ++ii)
+    {
+        if (ii->first == base || ii->first.compare(0, prefix.size(),
+                    prefix) == 0)
+        {
+            ++stats.removed;
+        }
+        else
+        {
+            files.push_back(files_[ii->second]);
+        }
+    }
+
+    if (workers == 0)
+    {
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    workers = std::max<size_t>(1, std::min<size_t>(workers, todo.size()));
+    std::vector<bool> done(todo.size(), false);
+    if (workers == 1)
+    {
+        for (size_t ii(0); ii < todo.size(); ++ii)
+        {
+            CatalogFile file;
+            try
+            {
+                scan_file(todo[ii], file);
+                files.push_back(file);
+                ++stats.scanned;
+            }
+            catch (std::exception const& e)
+            {
+                stats.errors.push_back(todo[ii].path + ": " + e.what());
+            }
+            done[ii] = true;
+        }
+    }
+    else
+    {
+        std::vector<std::string> results;
+        scan_in_workers(todo, workers, results);
+        for (size_t ii(0); ii < results.size(); ++ii)
+        {
+            ResultReader in(results[ii]);
+            uint64_t index;
+            bool read;
+            CatalogFile file;
+            std::string error;
+            while (get_result(in, index, read, file, error) &&
+                    index < todo.size())
+            {
+                done[index] = true;
+                if (read)
+                {
+                    file.path = todo[index].path;
+                    file.bytes = todo[index].bytes;
+                    file.mtime = todo[index].mtime;
+                    file_bounds(file);
+                    files.push_back(file);
+                    ++stats.scanned;
+                }
+                else
+                {
+                    stats.errors.push_back(todo[index].path + ": " + error);
+                }
+                file = CatalogFile();
+            }
+        }
+    }
+    // A worker that died part way through a file took the rest of its
+    // results with it
+    for (size_t ii(0); ii < todo.size(); ++ii)
+    {
+        if (!done[ii])
+        {
+            stats.errors.push_back(todo[ii].path +
+                    ": Scanning process exited");
+        }
+    }
+    stats.failed = stats.errors.size();
+
+    std::sort(files.begin(), files.end(), path_order);
+    files_.swap(files);
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    stats.seconds = (finished.tv_sec - started.tv_sec) +
+        (finished.tv_nsec - started.tv_nsec) / 1e9;
+    return stats;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Queries
+///////////////////////////////////////////////////////////////////////////////
+
+std::vector<CatalogMatch> Catalog::find(std::string const& channel,
+        uint64_t start, uint64_t end) const
+{
+    std::vector<CatalogMatch> result;
+    for (std::vector<CatalogFile>::const_iterator ii(files_.begin());
+            ii != files_.end(); ++ii)
+    {
+        if (ii->start_time >= end || ii->end_time < start)
+        {
+            continue;
+        }
+        for (std::vector<CatalogChannel>::const_iterator jj(
+                    ii->channels.begin()); jj != ii->channels.end(); ++jj)
+        {
+            if (jj->size > 0 && jj->start_time < end &&
+                    jj->end_time >= start &&
+                    (channel.empty() || jj->name == channel))
+            {
+                result.push_back(CatalogMatch(ii->path, *jj));
+            }
+        }
+    }
+    return result;
+}
+
+
+std::vector<std::string> Catalog::find_tag(std::string const& tag,
+        std::string const& value) const
+{
+    std::vector<std::string> result;
+    for (std::vector<CatalogFile>::const_iterator ii(files_.begin());
+            ii != files_.end(); ++ii)
+    {
+        CatalogTagMap::const_iterator found(ii->tags.find(tag));
+        if (found != ii->tags.end() && (value.empty() ||
+                    (found->second.has_value() &&
+                     found->second.value == value)))
+        {
+            result.push_back(ii->path);
+        }
+    }
+    return result;
+}
+
@@ -0,0 +1,929 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Export of channels to flat files for other tools.
+ */
+
+#include <hdf5r/export.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <inttypes.h>
+#include <map>
+#include <pthread.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace hdf5r;
+
+
+typedef enum { COL_INT, COL_UINT, COL_FLOAT, COL_STRING, COL_BYTES }
+    ColumnKind;
+
+
+// A field of a channel's records, written to its own file or CSV column(s)
+struct ExportColumn
+{
+    std::string name;
+    ColumnKind kind;
+    size_t offset; // Within the record
+    size_t size; // Of one element
+    size_t count; // Elements per record, more than one for arrays
+};
+
+
+// A channel being exported and the records of it that fall in the window
+struct ExportChannel
+{
+    ChannelID id;
+    std::string name;
+    std::string type_name;
+    std::string source_name;
+    size_t record_size;
+    hsize_t first, last;
+    // Of the time stamp column, kept apart from the fields' names
+    std::string timestamp_name;
+    std::vector<ExportColumn> columns;
+};
+
+
+// Consecutive records of one channel on their way through the pipeline
+struct ExportBlock
+{
+    size_t chan;
+    uint64_t seq;
+    size_t count;
+    bool last; // The channel's final block
+    std::vector<uint64_t> timestamps;
+    std::vector<char> records;
+    // One buffer per column in binary format; the text in CSV format
+    std::vector<std::string> out;
+};
+
+
+// State shared by the reader, converter and writer threads. Blocks cycle
+// from the free list to the reader, to the converters, to the writer and
+// back, so memory use is bounded by the number of blocks.
+struct ExportPipeline
+{
+    ExportFormat format;
+    std::string dir;
+    std::vector<ExportChannel> const* channels;
+
+    pthread_mutex_t lock;
+    pthread_cond_t block_free;
+    pthread_cond_t block_read;
+    pthread_cond_t block_converted;
+    std::vector<ExportBlock*> free;
+    std::deque<ExportBlock*> read;
+    std::map<uint64_t, ExportBlock*> converted;
+    bool reading_done;
+    uint64_t total_blocks;
+    uint64_t bytes_written;
+    std::string error;
+};
+
+
+static void fail(ExportPipeline* pipe, std::string const& what)
+{
+    pthread_mutex_lock(&pipe->lock);
+    if (pipe->error.empty())
+    {
+        pipe->error = what;
+    }
+    pthread_cond_broadcast(&pipe->block_free);
+    pthread_cond_broadcast(&pipe->block_read);
+    pthread_cond_broadcast(&pipe->block_converted);
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+
+static ExportColumn make_column(std::string const& name, ColumnKind kind,
+        size_t offset, size_t size, size_t count)
+{
+    ExportColumn column = {name, kind, offset, size, count};
+    return column;
+}
+
+
+// The kind of column an atomic type becomes
+static ColumnKind column_kind(hid_t type)
+{
+    size_t size(H5Tget_size(type));
+    switch (H5Tget_class(type))
+    {
+        case H5T_INTEGER:
+            if (size != 1 && size != 2 && size != 4 && size != 8)
+            {
+                return COL_BYTES;
+            }
+            return H5Tget_sign(type) == H5T_SGN_NONE ? COL_UINT : COL_INT;
+        case H5T_FLOAT:
+            return size == sizeof(float) || size == sizeof(double) ?
+                COL_FLOAT : COL_BYTES;
+        case H5T_STRING:
+            if (H5Tis_variable_str(type) > 0)
+            {
+                throw std::runtime_error(
+                        "Can't export variable-length strings");
+            }
+            return COL_STRING;
+        case H5T_ENUM:
+        {
+            hid_t base(H5Tget_super(type));
+            ColumnKind kind(column_kind(base));
+            H5Tclose(base);
+            return kind;
+        }
+        case H5T_VLEN:
+            throw std::runtime_error("Can't export variable-length types");
+        default:
+            return COL_BYTES;
+    }
+}
+
+
+// Flatten a type into columns, one per atomic member
+static void add_columns(hid_t type, std::string const& name, size_t offset,
+        std::vector<ExportColumn>& columns)
+{
+    H5T_class_t type_class(H5Tget_class(type));
+    if (type_class == H5T_COMPOUND)
+    {
+        int members(H5Tget_nmembers(type));
+        for (int ii(0); ii < members; ++ii)
+        {
+            char* member_name(H5Tget_member_name(type, ii));
+            std::string path(name.empty() ? member_name :
+                    name + '.' + member_name);
+            H5free_memory(member_name);
+            hid_t member_type(H5Tget_member_type(type, ii));
+            try
+            {
+                add_columns(member_type, path,
+                        offset + H5Tget_member_offset(type, ii), columns);
+            }
+            catch (...)
+            {
+                H5Tclose(member_type);
+                throw;
+            }
+            H5Tclose(member_type);
+        }
+        return;
+    }
+
+    std::string path(name.empty() ? "value" : name);
+    if (type_class == H5T_ARRAY)
+    {
+        // Arrays of atomic types become a column with several elements per
+        // record; anything more deeply nested is exported as bytes
+        hid_t base(H5Tget_super(type));
+        H5T_class_t base_class(H5Tget_class(base));
+        size_t size(H5Tget_size(type)), base_size(H5Tget_size(base));
+        ColumnKind kind(COL_BYTES);
+        try
+        {
+            if (base_class != H5T_COMPOUND && base_class != H5T_ARRAY)
+            {
+                kind = column_kind(base);
+            }
+        }
+        catch (...)
+        {
+            H5Tclose(base);
+            throw;
+        }
+        H5Tclose(base);
+        if (kind == COL_BYTES)
+        {
+            columns.push_back(make_column(path, COL_BYTES, offset, size, 1));
+        }
+        else
+        {
+            columns.push_back(make_column(path, kind, offset, base_size,
+                        size / base_size));
+        }
+        return;
+    }
+    columns.push_back(make_column(path, column_kind(type), offset,
+                H5Tget_size(type), 1));
+}
+
+
+static std::string column_type_name(ExportColumn const& column)
+{
+    char buf[16];
+    switch (column.kind)
+    {
+        case COL_INT:
+            snprintf(buf, sizeof(buf), "int%u",
+                    static_cast<unsigned int>(column.size * 8));
+            return buf;
+        case COL_UINT:
+            snprintf(buf, sizeof(buf), "uint%u",
+                    static_cast<unsigned int>(column.size * 8));
+            return buf;
+        case COL_FLOAT:
+            return column.size == sizeof(float) ? "float32" : "float64";
+        case COL_STRING:
+            return "string";
+        default:
+            return "bytes";
+    }
+}
+
+
+static std::string binary_file_name(ExportChannel const& chan,
+        std::string const& field)
+{
+    return chan.name + '.' + field + ".bin";
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Conversion
+///////////////////////////////////////////////////////////////////////////////
+
+
+static void convert_binary(ExportChannel const& chan, ExportBlock& block)
+{
+    block.out.resize(chan.columns.size());
+    for (size_t ii(0); ii < chan.columns.size(); ++ii)
+    {
+        ExportColumn const& column(chan.columns[ii]);
+        size_t width(column.size * column.count);
+        std::string& out(block.out[ii]);
+        out.resize(block.count * width);
+        if (block.count == 0)
+        {
+            continue;
+        }
+        char* dest(&out[0]);
+        char const* src(&block.records[0] + column.offset);
+        for (size_t rec(0); rec < block.count; ++rec)
+        {
+            memcpy(dest, src, width);
+            dest += width;
+            src += chan.record_size;
+        }
+    }
+}
+
+
+static void format_value(ExportColumn const& column, char const* src,
+        std::string& out)
+{
+    char buf[64];
+    int len(0);
+    switch (column.kind)
+    {
+        case COL_INT:
+        {
+            int64_t value(0);
+            if (column.size == 1)
+            {
+                int8_t v; memcpy(&v, src, 1); value = v;
+            }
+            else if (column.size == 2)
+            {
+                int16_t v; memcpy(&v, src, 2); value = v;
+            }
+            else if (column.size == 4)
+            {
+                int32_t v; memcpy(&v, src, 4); value = v;
+            }
+            else
+            {
+                memcpy(&value, src, 8);
+            }
+            len = snprintf(buf, sizeof(buf), "%" PRId64, value);
+            break;
+        }
+        case COL_UINT:
+        {
+            uint64_t value(0);
+            if (column.size == 1)
+            {
+                uint8_t v; memcpy(&v, src, 1); value = v;
+            }
+            else if (column.size == 2)
+            {
+                uint16_t v; memcpy(&v, src, 2); value = v;
+            }
+            else if (column.size == 4)
+            {
+                uint32_t v; memcpy(&v, src, 4); value = v;
+            }
+            else
+            {
+                memcpy(&value, src, 8);
+            }
+            len = snprintf(buf, sizeof(buf), "%" PRIu64, value);
+            break;
+        }
+        case COL_FLOAT:
+            if (column.size == sizeof(float))
+            {
+                float value;
+                memcpy(&value, src, sizeof(value));
+                len = snprintf(buf, sizeof(buf), "%.9g", value);
+            }
+            else
+            {
+                double value;
+                memcpy(&value, src, sizeof(value));
+                len = snprintf(buf, sizeof(buf), "%.17g", value);
+            }
+            break;
+        case COL_STRING:
+        {
+            out += '"';
+            for (size_t ii(0); ii < column.size && src[ii] != '\0'; ++ii)
+            {
+                if (src[ii] == '"')
+                {
+                    out += '"';
+                }
+                out += src[ii];
+            }
+            out += '"';
+            return;
+        }
+        default:
+        {
+            static char const* const hex = "0123456789abcdef";
+            for (size_t ii(0); ii < column.size; ++ii)
+            {
+                unsigned char byte(src[ii]);
+                out += hex[byte >> 4];
+                out += hex[byte & 0xf];
+            }
+            return;
+        }
+    }
+    out.append(buf, len);
+}
+
+
+static void convert_csv(ExportChannel const& chan, ExportBlock& block)
+{
+    block.out.resize(1);
+    std::string& out(block.out[0]);
+    out.clear();
+    char buf[32];
+    for (size_t rec(0); rec < block.count; ++rec)
+    {
+        out.append(buf, snprintf(buf, sizeof(buf), "%" PRIu64,
+                    block.timestamps[rec]));
+        char const* record(&block.records[0] + rec * chan.record_size);
+        for (size_t ii(0); ii < chan.columns.size(); ++ii)
+        {
+            ExportColumn const& column(chan.columns[ii]);
+            for (size_t elem(0); elem < column.count; ++elem)
+            {
+                out += ',';
+                format_value(column,
+                        record + column.offset + elem * column.size, out);
+            }
+        }
+        out += '\n';
+    }
+}
+
+
+static std::string csv_header(ExportChannel const& chan)
+{
+    std::string header(chan.timestamp_name);
+    char buf[32];
+    for (size_t ii(0); ii < chan.columns.size(); ++ii)
+    {
+        ExportColumn const& column(chan.columns[ii]);
+        for (size_t elem(0); elem < column.count; ++elem)
+        {
+            header += ',' + column.name;
+            if (column.count > 1)
+            {
+                snprintf(buf, sizeof(buf), "[%u]",
+                        static_cast<unsigned int>(elem));
+                header += buf;
+            }
+        }
+    }
+    return header + '\n';
+}
+
+
+static void* convert_worker(void* arg)
+{
+    ExportPipeline* pipe = reinterpret_cast<ExportPipeline*>(arg);
+    while (true)
+    {
+        pthread_mutex_lock(&pipe->lock);
+        while (pipe->read.empty() && !pipe->reading_done &&
+                pipe->error.empty())
+        {
+            pthread_cond_wait(&pipe->block_read, &pipe->lock);
+        }
+        if (pipe->read.empty() || !pipe->error.empty())
+        {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        ExportBlock* block(pipe->read.front());
+        pipe->read.pop_front();
+        pthread_mutex_unlock(&pipe->lock);
+
+        ExportChannel const& chan((*pipe->channels)[block->chan]);
+        try
+        {
+            if (pipe->format == EXPORT_BINARY)
+            {
+                convert_binary(chan, *block);
+            }
+            else
+            {
+                convert_csv(chan, *block);
+            }
+        }
+        catch (std::exception const& e)
+        {
+            pthread_mutex_lock(&pipe->lock);
+            pipe->free.push_back(block);
+            pthread_mutex_unlock(&pipe->lock);
+            fail(pipe, e.what());
+            break;
+        }
+
+        pthread_mutex_lock(&pipe->lock);
+        pipe->converted[block->seq] = block;
+        pthread_cond_broadcast(&pipe->block_converted);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Writing
+///////////////////////////////////////////////////////////////////////////////
+
+
+static void close_files(std::vector<FILE*>& files)
+{
+    for (size_t ii(0); ii < files.size(); ++ii)
+    {
+        fclose(files[ii]);
+    }
+    files.clear();
+}
+
+
+static FILE* open_output(std::string const& path)
+{
+    FILE* file(fopen(path.c_str(), "wb"));
+    if (file == 0)
+    {
+        throw std::runtime_error("Failed to create " + path + ": " +
+                strerror(errno));
+    }
+    return file;
+}
+
+
+static void write_output(FILE* file, char const* buf, size_t size)
+{
+    if (size > 0 && fwrite(buf, 1, size, file) != size)
+    {
+        throw std::runtime_error(std::string("Failed to write export: ") +
+                strerror(errno));
+    }
+}
+
+
+// Write a block, opening the channel's files at its first block and
+// closing them after its last. Only one channel's files are open at once.
+static void write_block(ExportPipeline* pipe, ExportBlock const& block,
+        std::vector<FILE*>& files)
+{
+    ExportChannel const& chan((*pipe->channels)[block.chan]);
+    if (files.empty())
+    {
+        if (pipe->format == EXPORT_BINARY)
+        {
+            files.push_back(open_output(pipe->dir + '/' +
+                        binary_file_name(chan, chan.timestamp_name)));
+            for (size_t ii(0); ii < chan.columns.size(); ++ii)
+            {
+                files.push_back(open_output(pipe->dir + '/' +
+                            binary_file_name(chan, chan.columns[ii].name)));
+            }
+        }
+        else
+        {
+            files.push_back(open_output(pipe->dir + '/' + chan.name +
+                        ".csv"));
+            std::string header(csv_header(chan));
+            write_output(files[0], header.data(), header.size());
+            pipe->bytes_written += header.size();
+        }
+    }
+
+    if (pipe->format == EXPORT_BINARY)
+    {
+        size_t size(block.count * sizeof(uint64_t));
+        if (size > 0)
+        {
+            write_output(files[0],
+                    reinterpret_cast<char const*>(&block.timestamps[0]),
+                    size);
+        }
+        pipe->bytes_written += size;
+        for (size_t ii(0); ii < block.out.size(); ++ii)
+        {
+            write_output(files[ii + 1], block.out[ii].data(),
+                    block.out[ii].size());
+            pipe->bytes_written += block.out[ii].size();
+        }
+    }
+    else
+    {
+        write_output(files[0], block.out[0].data(), block.out[0].size());
+        pipe->bytes_written += block.out[0].size();
+    }
+
+    if (block.last)
+    {
+        for (size_t ii(0); ii < files.size(); ++ii)
+        {
+            if (fflush(files[ii]) != 0)
+            {
+                throw std::runtime_error(
+                        std::string("Failed to write export: ") +
+                        strerror(errno));
+            }
+        }
+        close_files(files);
+    }
+}
+
+
+static void* write_worker(void* arg)
+{
+    ExportPipeline* pipe = reinterpret_cast<ExportPipeline*>(arg);
+    std::vector<FILE*> files;
+    uint64_t next_seq(0);
+    while (true)
+    {
+        pthread_mutex_lock(&pipe->lock);
+        while (pipe->converted.find(next_seq) == pipe->converted.end() &&
+                !(pipe->reading_done && next_seq == pipe->total_blocks) &&
+                pipe->error.empty())
+        {
+            pthread_cond_wait(&pipe->block_converted, &pipe->lock);
+        }
+        std::map<uint64_t, ExportBlock*>::iterator found(
+                pipe->converted.find(next_seq));
+        if (found == pipe->converted.end() || !pipe->error.empty())
+        {
+            pthread_mutex_unlock(&pipe->lock);
+            break;
+        }
+        ExportBlock* block(found->second);
+        pipe->converted.erase(found);
+        pthread_mutex_unlock(&pipe->lock);
+
+        try
+        {
+            write_block(pipe, *block, files);
+        }
+        catch (std::exception const& e)
+        {
+            fail(pipe, e.what());
+        }
+        ++next_seq;
+
+        pthread_mutex_lock(&pipe->lock);
+        pipe->free.push_back(block);
+        pthread_cond_signal(&pipe->block_free);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    close_files(files);
+    return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Schema
+///////////////////////////////////////////////////////////////////////////////
+
+
+static std::string json_string(std::string const& str)
+{
+    std::string result("\"");
+    char buf[8];
+    for (size_t ii(0); ii < str.size(); ++ii)
+    {
+        unsigned char c(str[ii]);
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c < 0x20)
+        {
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result + '"';
+}
+
+
+static void write_schema(std::string const& dir,
+        std::vector<ExportChannel> const& channels, ExportOptions const& opts)
+{
+    std::string path(dir + "/schema.json");
+    FILE* file(open_output(path));
+    fprintf(file, "{\n  \"byte_order\": \"%s\",\n",
+            H5Tget_order(H5T_NATIVE_INT) == H5T_ORDER_BE ? "big" : "little");
+    fprintf(file, "  \"start\": %" PRIu64 ",\n  \"end\": %" PRIu64 ",\n",
+            opts.start(), opts.end());
+    fprintf(file, "  \"channels\": [");
+    for (size_t ii(0); ii < channels.size(); ++ii)
+    {
+        ExportChannel const& chan(channels[ii]);
+        fprintf(file, "%s\n    {\n", ii == 0 ? "" : ",");
+        fprintf(file, "      \"name\": %s,\n", json_string(chan.name).c_str());
+        fprintf(file, "      \"type_name\": %s,\n",
+                json_string(chan.type_name).c_str());
+        fprintf(file, "      \"source_name\": %s,\n",
+                json_string(chan.source_name).c_str());
+        fprintf(file, "      \"records\": %" PRIu64 ",\n",
+                static_cast<uint64_t>(chan.last - chan.first));
+        fprintf(file, "      \"columns\": [\n");
+        fprintf(file, "        {\"name\": %s, \"file\": %s, "
+                "\"type\": \"uint64\", \"size\": 8, \"count\": 1}",
+                json_string(chan.timestamp_name).c_str(),
+                json_string(binary_file_name(chan,
+                        chan.timestamp_name)).c_str());
+        for (size_t jj(0); jj < chan.columns.size(); ++jj)
+        {
+            ExportColumn const& column(chan.columns[jj]);
+            fprintf(file, ",\n        {\"name\": %s, \"file\": %s, "
+                    "\"type\": \"%s\", \"size\": %u, \"count\": %u}",
+                    json_string(column.name).c_str(),
+                    json_string(binary_file_name(chan, column.name)).c_str(),
+                    column_type_name(column).c_str(),
+                    static_cast<unsigned int>(column.size),
+                    static_cast<unsigned int>(column.count));
+        }
+        fprintf(file, "\n      ]\n    }");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    if (ferror(file) || fclose(file) != 0)
+    {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Export
+///////////////////////////////////////////////////////////////////////////////
+
+
+// The time stamp column is "timestamp", with underscores in front if a field
+// already has that name, so that the two don't share a file or CSV heading
+static std::string timestamp_name(std::vector<ExportColumn> const& columns)
+{
+    std::string name("timestamp");
+    bool taken(true);
+    while (taken)
+    {
+        taken = false;
+        for (size_t ii(0); ii < columns.size() && !taken; ++ii)
+        {
+            taken = columns[ii].name == name;
+        }
+        if (taken)
+        {
+            name = '_' + name;
+        }
+    }
+    return name;
+}
+
+
+static std::vector<ExportChannel> plan_export(HDF5R& file,
+        ExportOptions const& opts)
+{
+    std::vector<ExportChannel> channels;
+    if (opts.channels().empty())
+    {
+        std::vector<ChannelID> ids(file.channels());
+        channels.resize(ids.size());
+        for (size_t ii(0); ii < ids.size(); ++ii)
+        {
+            channels[ii].id = ids[ii];
+        }
+    }
+    for (std::vector<std::string>::const_iterator ii(opts.channels().begin());
+            ii != opts.channels().end(); ++ii)
+    {
+        ExportChannel chan;
+        chan.id = file.get_channel_id(*ii);
+        channels.push_back(chan);
+    }
+
+    for (std::vector<ExportChannel>::iterator ii(channels.begin());
+            ii != channels.end(); ++ii)
+    {
+        ChannelInfo info(file.get_channel_info(ii->id));
+        ii->name = info.name();
+        ii->type_name = info.type_name();
+        ii->source_name = info.source_name();
+        ii->record_size = H5Tget_size(info.mem_type());
+        add_columns(info.mem_type(), "", 0, ii->columns);
+        ii->timestamp_name = timestamp_name(ii->columns);
+        ii->first = opts.start() == 0 ? 0 :
+            file.find_entry(ii->id, opts.start());
+        ii->last = opts.end() == static_cast<uint64_t>(-1) ? info.size() :
+            file.find_entry(ii->id, opts.end());
+        ii->last = std::max(ii->first, ii->last);
+    }
+    return channels;
+}
+
+
+static double seconds_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+ExportStats hdf5r::export_channels(HDF5R& file, std::string const& dir,
+        ExportOptions const& options)
+{
+    double started(seconds_now());
+    std::vector<ExportChannel> channels(plan_export(file, options));
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        throw std::runtime_error("Failed to create " + dir + ": " +
+                strerror(errno));
+    }
+
+    ExportPipeline pipe;
+    pipe.format = options.format();
+    pipe.dir = dir;
+    pipe.channels = &channels;
+    pipe.reading_done = false;
+    pipe.total_blocks = 0;
+    pipe.bytes_written = 0;
+    std::vector<ExportBlock> blocks(std::max<size_t>(1, options.max_blocks()));
+    for (size_t ii(0); ii < blocks.size(); ++ii)
+    {
+        pipe.free.push_back(&blocks[ii]);
+    }
+    size_t block_records(std::max<size_t>(1, options.block_records()));
+    pthread_mutex_init(&pipe.lock, 0);
+    pthread_cond_init(&pipe.block_free, 0);
+    pthread_cond_init(&pipe.block_read, 0);
+    pthread_cond_init(&pipe.block_converted, 0);
+
+    unsigned int threads(options.threads());
+    if (threads == 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = std::max(1u, threads);
+    std::vector<pthread_t> workers;
+    for (unsigned int ii(0); ii < threads; ++ii)
+    {
+        pthread_t worker;
+        if (pthread_create(&worker, 0, convert_worker, &pipe) == 0)
+        {
+            workers.push_back(worker);
+        }
+    }
+    pthread_t writer;
+    bool have_writer(pthread_create(&writer, 0, write_worker, &pipe) == 0);
+    if (workers.empty() || !have_writer)
+    {
+        fail(&pipe, "Failed to start export threads");
+    }
+
+    // Read on this thread, so that only it uses the file
+    ExportStats stats;
+    uint64_t seq(0);
+    for (size_t chan(0); chan < channels.size(); ++chan)
+    {
+        ExportChannel const& export_chan(channels[chan]);
+        hsize_t pos(export_chan.first);
+        bool last(false);
+        while (!last)
+        {
+            pthread_mutex_lock(&pipe.lock);
+            while (pipe.free.empty() && pipe.error.empty())
+            {
+                pthread_cond_wait(&pipe.block_free, &pipe.lock);
+            }
+            if (!pipe.error.empty())
+            {
+                pthread_mutex_unlock(&pipe.lock);
+                break;
+            }
+            ExportBlock* block(pipe.free.back());
+            pipe.free.pop_back();
+            pthread_mutex_unlock(&pipe.lock);
+
+            block->chan = chan;
+            block->seq = seq;
+            block->count = std::min<hsize_t>(block_records,
+                    export_chan.last - pos);
+            last = pos + block->count >= export_chan.last;
+            block->last = last;
+            block->timestamps.resize(block->count);
+            block->records.resize(block->count * export_chan.record_size);
+            try
+            {
+                if (block->count > 0)
+                {
+                    file.get_entries(export_chan.id, pos, block->count,
+                            &block->timestamps[0], &block->records[0]);
+                }
+            }
+            catch (std::exception const& e)
+            {
+                pthread_mutex_lock(&pipe.lock);
+                pipe.free.push_back(block);
+                pthread_mutex_unlock(&pipe.lock);
+                fail(&pipe, e.what());
+                break;
+            }
+            pos += block->count;
+            stats.records += block->count;
+            stats.bytes_read += block->count *
+                (export_chan.record_size + sizeof(uint64_t));
+
+            pthread_mutex_lock(&pipe.lock);
+            pipe.read.push_back(block);
+            ++seq;
+            pthread_cond_signal(&pipe.block_read);
+            pthread_mutex_unlock(&pipe.lock);
+        }
+    }
+
+    pthread_mutex_lock(&pipe.lock);
+    pipe.reading_done = true;
+    pipe.total_blocks = seq;
+    pthread_cond_broadcast(&pipe.block_read);
+    pthread_cond_broadcast(&pipe.block_converted);
+    pthread_mutex_unlock(&pipe.lock);
+    for (std::vector<pthread_t>::const_iterator ii(workers.begin());
+            ii != workers.end(); ++ii)
+    {
+        pthread_join(*ii, 0);
+    }
+    if (have_writer)
+    {
+        pthread_join(writer, 0);
+    }
+    pthread_cond_destroy(&pipe.block_converted);
+    pthread_cond_destroy(&pipe.block_read);
+    pthread_cond_destroy(&pipe.block_free);
+    pthread_mutex_destroy(&pipe.lock);
+    if (!pipe.error.empty())
+    {
+        throw std::runtime_error(pipe.error);
+    }
+
+    if (options.format() == EXPORT_BINARY)
+    {
+        write_schema(dir, channels, options);
+    }
+    stats.bytes_written = pipe.bytes_written;
+    stats.seconds = seconds_now() - started;
+    return stats;
+}
+
@@ -16,7 +16,13 @@
 #include <hdf5r/hdf5r.h>
 
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <queue>
 #include <stdexcept>
+#include <time.h>
+#include <unistd.h>
 #include <vector>
 
 using namespace hdf5r;
@@ -33,98 +39,117 @@ ChannelInfo::ChannelInfo()
 }
 
 
-ChannelInfo::ChannelInfo(std::string name, std::string type_name,
-        std::string source_name, hid_t mem_type, size_t size,
-        uint64_t start_time, uint64_t end_time)
-    : name_(name), type_name_(type_name),
-    source_name_(source_name), mem_type_(-1), size_(size),
-    start_time_(start_time), end_time_(end_time)
+ChannelInfo::ChannelInfo(std::string const& name,
+        std::string const& type_name, std::string const& source_name,
+        hid_t mem_type, size_t size, uint64_t start_time, uint64_t end_time)
+    : name_(name), type_name_(type_name), source_name_(source_name),
+    mem_type_(Handle::share(mem_type)), size_(size), start_time_(start_time),
+    end_time_(end_time)
 {
-    if (mem_type >= 0)
-    {
-        mem_type_ = H5Tcopy(mem_type);
-    }
 }
 
-ChannelInfo::ChannelInfo(ChannelInfo const& rhs)
-    : name_(rhs.name_), type_name_(rhs.type_name_),
-    source_name_(rhs.source_name_), mem_type_(-1),
-    size_(rhs.size_), start_time_(rhs.start_time_), end_time_(rhs.end_time_)
-{
-    if (rhs.mem_type_ >= 0)
-    {
-        mem_type_ = H5Tcopy(rhs.mem_type_);
-    }
-}
 
-ChannelInfo::~ChannelInfo()
+///////////////////////////////////////////////////////////////////////////////
+// Channel class
+///////////////////////////////////////////////////////////////////////////////
+
+
+Channel::Channel(std::string const& name, hid_t group, hid_t rec_space,
+        hid_t rec_set, hid_t ts_space, hid_t ts_set, hid_t mem_type,
+        size_t size)
+    : name_(name), group_(group), rec_space_(rec_space), rec_set_(rec_set),
+    ts_space_(ts_space), ts_set_(ts_set), mem_type_(mem_type), period_(0),
+    size_(size), cursor_(0), committed_(size), indexed_(0), last_used_(0),
+    capacity_(0), head_(0), committed_head_(0), frozen_(false)
 {
-    if (mem_type_ >= 0)
-    {
-        H5Tclose(mem_type_);
-    }
 }
 
 
-ChannelInfo& ChannelInfo::operator=(ChannelInfo const& rhs)
+void Channel::open(hid_t group, hid_t rec_space, hid_t rec_set,
+        hid_t ts_space, hid_t ts_set, hid_t mem_type)
 {
-    name_ = rhs.name_;
-    type_name_ = rhs.type_name_;
-    source_name_ = rhs.source_name_;
-    if (mem_type_ >= 0)
-    {
-        H5Tclose(mem_type_);
-    }
-    if (rhs.mem_type_ >= 0)
-    {
-        mem_type_ = H5Tcopy(rhs.mem_type_);
-    }
-    else
-    {
-        mem_type_ = -1;
-    }
-    size_ = rhs.size_;
-    start_time_ = rhs.start_time_;
-    end_time_ = rhs.end_time_;
+    group_.reset(group);
+    rec_space_.reset(rec_space);
+    rec_set_.reset(rec_set);
+    ts_space_.reset(ts_space);
+    ts_set_.reset(ts_set);
+    mem_type_.reset(mem_type);
 }
 
 
-void ChannelInfo::mem_type(hid_t mem_type)
+void Channel::close()
 {
-    if (mem_type_ >= 0)
-    {
-        H5Tclose(mem_type_);
-    }
-    if (mem_type >= 0)
-    {
-        mem_type_ = H5Tcopy(mem_type);
-    }
+    rec_set_.reset();
+    rec_space_.reset();
+    ts_set_.reset();
+    ts_space_.reset();
+    mem_type_.reset();
+    columns_.clear();
+    timeline_.reset();
+    runs_.clear();
+    group_.reset();
 }
 
 
-///////////////////////////////////////////////////////////////////////////////
-// Channel class
-///////////////////////////////////////////////////////////////////////////////
+static bool run_before(hsize_t index, Channel::TimelineRun const& run)
+{
+    return index < run.first;
+}
 
 
-Channel::Channel(std::string name, hid_t group, hid_t rec_space, hid_t rec_set,
-        hid_t ts_space, hid_t ts_set, hid_t mem_type, size_t size)
-    : name_(name), group_(group), rec_space_(rec_space), rec_set_(rec_set),
-    ts_space_(ts_space), ts_set_(ts_set), mem_type_(mem_type), size_(size)
+static bool run_time_before(uint64_t timestamp,
+        Channel::TimelineRun const& run)
 {
+    return timestamp < run.timestamp;
 }
 
 
-Channel::Channel(Channel const& rhs)
-    : name_(rhs.name_), group_(rhs.group_), rec_space_(rhs.rec_space_),
-    rec_set_(rhs.rec_set_), ts_space_(rhs.ts_space_), ts_set_(rhs.ts_set_),
-    mem_type_(rhs.mem_type_), size_(rhs.size_)
+void Channel::timeline_stamps(hsize_t start, hsize_t count,
+        uint64_t* const buf) const
 {
+    if (count == 0)
+    {
+        return;
+    }
+    // The run holding the first record; runs that begin at the same record
+    // replace one another, so it is the last to begin at or before it
+    std::vector<TimelineRun>::const_iterator run(std::upper_bound(
+                runs_.begin(), runs_.end(), start, run_before));
+    if (run == runs_.begin())
+    {
+        throw std::runtime_error("No timeline for records of channel " +
+                name_);
+    }
+    --run;
+    for (hsize_t ii(0); ii < count; ++ii)
+    {
+        hsize_t index(start + ii);
+        while (run + 1 != runs_.end() && (run + 1)->first <= index)
+        {
+            ++run;
+        }
+        buf[ii] = run->timestamp + (index - run->first) * period_;
+    }
 }
 
 
-Channel::~Channel()
+hsize_t Channel::timeline_find(uint64_t timestamp) const
 {
+    // The last run starting at or before the time stamp; with the records
+    // in time order, its successor starts after it
+    std::vector<TimelineRun>::const_iterator run(std::upper_bound(
+                runs_.begin(), runs_.end(), timestamp, run_time_before));
+    if (run == runs_.begin())
+    {
+        return 0;
+    }
+    hsize_t end(run == runs_.end() ? size_ : std::min<hsize_t>(run->first,
+                size_));
+    --run;
+    // Round up to the first record of the run at or after the time stamp
+    hsize_t index(run->first + (timestamp - run->timestamp + period_ - 1) /
+            period_);
+    return std::min(index, end);
 }
 
 
@@ -143,763 +168,3713 @@ herr_t get_child_names(hid_t root, char const* const name,
 }
 
 
-HDF5R::HDF5R(std::string filename, Mode mode)
-    : fn_(filename), mode_(mode), file_(-1), channels_grp_(-1), tags_grp_(-1),
-    next_id_(0)
+static uint64_t monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+HDF5R::HDF5R(std::string const& filename, Mode mode,
+        FileProfile const& profile)
+    : fn_(filename), mode_(mode), profile_(profile), swmr_(false),
+    next_id_(0), open_channels_(0), use_clock_(0),
+    index_loaded_(false), index_in_file_(false),
+    uncommitted_(0),
+    last_checkpoint_(monotonic_ms())
 {
     switch(mode_)
     {
         case RDONLY:
-            file_ = H5Fopen(fn_.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-            if (file_ < 0)
+            file_.reset(open_file(H5F_ACC_RDONLY));
+            if (!file_.valid())
             {
                 throw std::runtime_error("File not found");
             }
             break;
         case RDWR:
             // Attempt to open the file, if it doesn't exist, fail
-            file_ = H5Fopen(fn_.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
-            if (file_ < 0)
+            file_.reset(open_file(H5F_ACC_RDWR));
+            if (!file_.valid())
             {
                 throw std::runtime_error("File not found");
             }
             break;
         case NEW:
             // Make a new file unless there is one already there
-            file_ = H5Fcreate(fn_.c_str(), 0, H5P_DEFAULT,
-                    H5P_DEFAULT);
-            if (file_ < 0)
+            file_.reset(create_file(0));
+            if (!file_.valid())
             {
                 throw std::runtime_error("Could not create new file");
             }
             break;
         case TRUNCATE:
             // Make a new file, overwriting anything already there
-            file_ = H5Fcreate(fn_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
-                    H5P_DEFAULT);
-            if (file_ < 0)
+            file_.reset(create_file(H5F_ACC_TRUNC));
+            if (!file_.valid())
             {
                 throw std::runtime_error("Could not create new file");
             }
             break;
+        case SWMR_WRITE:
+            // Make a new file in the latest format, overwriting anything
+            // already there. SWMR writing is started by start_swmr().
+            file_.reset(create_file(H5F_ACC_TRUNC));
+            if (!file_.valid())
+            {
+                throw std::runtime_error("Could not create new file");
+            }
+            break;
+        case SWMR_READ:
+            // Open a file that may still be being written
+            file_.reset(open_file(H5F_ACC_RDONLY | H5F_ACC_SWMR_READ));
+            if (!file_.valid())
+            {
+                throw std::runtime_error("File not found");
+            }
+            break;
     }
+    // Memory spaces for single records and for pairs of time stamps, reused
+    // by every read and write
+    hsize_t elem_size[] = {1};
+    elem_space_.reset(H5Screate_simple(1, elem_size, 0));
+    hsize_t pair_size[] = {2};
+    pair_space_.reset(H5Screate_simple(1, pair_size, 0));
     prepare();
 }
 
 
-HDF5R::HDF5R(HDF5R const& rhs)
-    : mode_(rhs.mode_), file_(rhs.file_), channels_grp_(rhs.channels_grp_),
-    tags_grp_(rhs.tags_grp_), next_id_(rhs.next_id_)
+HDF5R::~HDF5R()
 {
+    if (swmr_)
+    {
+        // New objects cannot be created in SWMR mode, so reopen the file
+        // normally to write the index
+        close_objects();
+        swmr_ = false;
+        file_.reset(open_file(H5F_ACC_RDWR));
+        if (file_.valid())
+        {
+            write_index();
+        }
+    }
+    else if (file_.valid())
+    {
+        write_index();
+        write_committed();
+    }
+    close_objects();
 }
 
 
-HDF5R::~HDF5R()
+void HDF5R::start_swmr()
 {
-    write_index();
-    std::for_each(channels_.begin(), channels_.end(), close_group_fun());
-    if (tags_grp_ >= 0)
+    if (mode_ != SWMR_WRITE)
     {
-        H5Gclose(tags_grp_);
+        throw std::runtime_error("File was not opened in SWMR_WRITE mode");
     }
-    if (channels_grp_ >= 0)
+    if (swmr_)
     {
-        H5Gclose(channels_grp_);
+        return;
     }
-    if (file_ >= 0)
+    if (H5Fstart_swmr_write(file_.get()) < 0)
     {
-        H5Fclose(file_);
+        throw std::runtime_error("Failed to start SWMR writing");
     }
+    swmr_ = true;
 }
 
 
-ChannelID HDF5R::add_channel(std::string name, std::string type_name,
-        std::string source_name, hid_t mem_type, hid_t file_type)
+void HDF5R::flush()
 {
-    // Check the channel doesn't already exist
-    if (have_channel(name))
+    // Nothing to flush in the read-only modes
+    if (mode_ == RDONLY || mode_ == SWMR_READ)
     {
-        throw std::runtime_error("Channel already exists");
+        return;
+    }
+    if (H5Fflush(file_.get(), H5F_SCOPE_GLOBAL) < 0)
+    {
+        throw std::runtime_error("Failed to flush file");
     }
-
-    ChannelID id(next_id_++);
-    // Create a group for the channel
-    hid_t group = H5Gcreate(channels_grp_, name.c_str(), H5P_DEFAULT,
-            H5P_DEFAULT, H5P_DEFAULT);
-    // Populate it with the channel's properties
-    write_uint(group, "uid", id);
-    write_string(group, "name", name);
-    write_string(group, "type_name", type_name);
-    write_string(group, "source_name", source_name);
-    write_type(group, "mem_type", mem_type);
-    // Create a dataset for the entries and a parallel dataset for the time
-    // stamps
-    hsize_t dims[1] = {10};
-    hsize_t max_dims[1] = {H5S_UNLIMITED};
-    // Ensure chunking is enabled so we can grow the record datasets
-    hsize_t chunk_size = {1};
-    hid_t parms = H5Pcreate(H5P_DATASET_CREATE);
-    H5Pset_chunk(parms, 1, &chunk_size);
-    hid_t rec_space = H5Screate_simple(1, dims, max_dims);
-    hid_t rec_set = H5Dcreate(group, RECORDS_SET, file_type, rec_space,
-            H5P_DEFAULT, parms, H5P_DEFAULT);
-    hid_t ts_space = H5Screate_simple(1, dims, max_dims);
-    hid_t ts_set = H5Dcreate(group, TIMESTAMPS_SET, H5T_STD_U64LE, ts_space,
-            H5P_DEFAULT, parms, H5P_DEFAULT);
-
-    channels_[id] = Channel(name, group, rec_space, rec_set, ts_space, ts_set,
-            mem_type);
-    return id;
 }
 
 
-std::vector<ChannelID> HDF5R::channels() const
+void HDF5R::checkpoint()
 {
-    std::vector<ChannelID> result;
-    for (std::map<ChannelID, Channel>::const_iterator ii(channels_.begin());
-            ii != channels_.end(); ++ii)
+    if (mode_ == RDONLY || mode_ == SWMR_READ)
     {
-        result.push_back(ii->first);
+        return;
     }
-    return result;
+    // Make the records durable before advancing the index and the committed
+    // counts past them. Neither can be written in SWMR mode, where the
+    // flushed dataset extents serve the same purpose.
+    flush();
+    if (!swmr_)
+    {
+        write_index();
+    }
+    write_committed();
+    flush();
+    uncommitted_ = 0;
+    last_checkpoint_ = monotonic_ms();
 }
 
 
-ChannelInfo HDF5R::get_channel_info(ChannelID chan_id)
+size_t HDF5R::committed(ChannelID chan_id)
 {
-    if (channels_.find(chan_id) == channels_.end())
-    {
-        throw std::runtime_error("Bad channel ID");
-    }
-    return read_channel_info(channels_[chan_id]);
+    return channel(chan_id).committed();
 }
 
 
-bool HDF5R::have_channel(std::string name) const
+// Target size of a chunk of a channel's records or time stamps
+static size_t const CHUNK_BYTES = 8192;
+
+
+ChannelID HDF5R::add_channel(std::string const& name,
+        std::string const& type_name, std::string const& source_name,
+        hid_t mem_type, hid_t file_type)
 {
-    for (std::map<ChannelID, Channel>::const_iterator ii(channels_.begin());
-            ii != channels_.end(); ++ii)
+    // Ensure chunking is enabled so we can grow the record datasets. A chunk
+    // per record would add to the chunk index on every write, so chunks hold
+    // as many records as fit in CHUNK_BYTES.
+    hsize_t chunk_size = std::max<hsize_t>(1,
+            CHUNK_BYTES / H5Tget_size(file_type));
+    hid_t rec_parms = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(rec_parms, 1, &chunk_size);
+    chunk_size = CHUNK_BYTES / sizeof(uint64_t);
+    hid_t ts_parms = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(ts_parms, 1, &chunk_size);
+    ChannelID id(0);
+    try
     {
-        if (ii->second.name() == name)
-        {
-            return true;
-        }
+        id = create_channel(name, type_name, source_name, mem_type, file_type,
+                rec_parms, ts_parms);
+    }
+    catch (...)
+    {
+        H5Pclose(ts_parms);
+        H5Pclose(rec_parms);
+        throw;
     }
-    return false;
+    H5Pclose(ts_parms);
+    H5Pclose(rec_parms);
+    return id;
 }
 
 
-void HDF5R::add_entry(ChannelID chan_id, uint64_t timestamp,
-        void const* const buf)
+ChannelID HDF5R::add_ring_channel(std::string const& name,
+        std::string const& type_name, std::string const& source_name,
+        hid_t mem_type, hid_t file_type, size_t capacity)
 {
-    Channel& chan(channels_[chan_id]);
-    hsize_t write_size[] = {1};
-    hid_t write_space = H5Screate_simple(1, write_size, 0);
-    hsize_t extent[1];
-    extent[0] = chan.size() + 1;
-    hsize_t coords[1];
-    coords[0] = chan.size();
-
-    // Extend the record data set by one element
-    if (H5Dset_extent(chan.rec_set(), extent) < 0)
+    if (capacity == 0)
     {
-        throw std::runtime_error("Failed to extend dataset for new record");
+        throw std::runtime_error("Ring channel capacity must not be zero");
     }
-    // Select the (new) last element in the data set
-    if (H5Sselect_elements(chan.rec_space(), H5S_SELECT_SET, 1, coords) < 0)
+    // A SWMR writer cannot update the head, so readers could not find the
+    // oldest record
+    if (mode_ == SWMR_WRITE)
     {
-        throw std::runtime_error("Failed to select element to write record");
+        throw std::runtime_error("Ring channels cannot be used in SWMR files");
     }
-    // Write the record
-    if (H5Dwrite(chan.rec_set(), chan.mem_type(), write_space, chan.rec_space(),
-                H5P_DEFAULT, buf) < 0)
+    // As add_channel(), but the chunks need be no bigger than the channel
+    hsize_t chunk_size = std::min<hsize_t>(capacity, std::max<hsize_t>(1,
+                CHUNK_BYTES / H5Tget_size(file_type)));
+    hid_t rec_parms = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(rec_parms, 1, &chunk_size);
+    chunk_size = std::min<hsize_t>(capacity, CHUNK_BYTES / sizeof(uint64_t));
+    hid_t ts_parms = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(ts_parms, 1, &chunk_size);
+    ChannelID id(0);
+    try
     {
-        throw std::runtime_error("Failed to write record");
+        id = create_channel(name, type_name, source_name, mem_type, file_type,
+                rec_parms, ts_parms, capacity);
+    }
+    catch (...)
+    {
+        H5Pclose(ts_parms);
+        H5Pclose(rec_parms);
+        throw;
     }
+    H5Pclose(ts_parms);
+    H5Pclose(rec_parms);
+    return id;
+}
 
-    // Repeat for the time stamp
-    if (H5Dset_extent(chan.ts_set(), extent) < 0)
+
+ChannelID HDF5R::add_fixed_rate_channel(std::string const& name,
+        std::string const& type_name, std::string const& source_name,
+        hid_t mem_type, hid_t file_type, uint64_t period)
+{
+    if (period == 0)
     {
-        throw std::runtime_error("Failed to extend dataset for new timestamp");
+        throw std::runtime_error("Fixed-rate channel period must not be zero");
     }
-    if (H5Sselect_elements(chan.ts_space(), H5S_SELECT_SET, 1, coords) < 0)
+    // As add_channel(), without the time stamps
+    hsize_t chunk_size = std::max<hsize_t>(1,
+            CHUNK_BYTES / H5Tget_size(file_type));
+    hid_t rec_parms = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(rec_parms, 1, &chunk_size);
+    ChannelID id(0);
+    try
     {
-        throw std::runtime_error("Failed to select element to write timestamp");
+        id = create_channel(name, type_name, source_name, mem_type, file_type,
+                rec_parms, -1, 0, false, period);
     }
-    if (H5Dwrite(chan.ts_set(), H5T_NATIVE_ULLONG, write_space, chan.ts_space(),
-                H5P_DEFAULT, &timestamp) < 0)
+    catch (...)
     {
-        throw std::runtime_error("Failed to write timestamp");
+        H5Pclose(rec_parms);
+        throw;
     }
+    H5Pclose(rec_parms);
+    return id;
+}
 
-    // Update the channel size
-    chan.size(chan.size() + 1);
 
-    IndexPointerList index_entry;
-    index_entry.push_back(IndexPointer(chan_id, coords[0]));
-    index_[timestamp] = index_entry;
+uint64_t HDF5R::period(ChannelID chan_id)
+{
+    return channel(chan_id).period();
 }
 
 
-size_t HDF5R::get_entry_size(ChannelID chan_id, hsize_t index)
+size_t HDF5R::ring_capacity(ChannelID chan_id)
 {
-    // index is actually ignored, since all entries in a dataset must be a
-    // fixed size in HDF5.
-    return H5Tget_size(channels_[chan_id].mem_type());
+    return channel(chan_id).capacity();
 }
 
 
-uint64_t HDF5R::get_entry(ChannelID chan_id, hsize_t index, void* const buf)
+ChannelID HDF5R::add_columnar_channel(std::string const& name,
+        std::string const& type_name, std::string const& source_name,
+        hid_t mem_type, hid_t file_type)
 {
-    Channel& chan(channels_[chan_id]);
-    hsize_t read_size[] = {1};
-    hid_t elem_space = H5Screate_simple(1, read_size, 0);
-    hsize_t coords[1];
-    coords[0] = index;
-    // Select and read the time stamp
-    if (H5Sselect_elements(chan.ts_space(), H5S_SELECT_SET, 1, coords) < 0)
+    if (H5Tget_class(file_type) != H5T_COMPOUND ||
+            H5Tget_class(mem_type) != H5T_COMPOUND)
     {
-        throw std::runtime_error("Failed to select time stamp");
+        throw std::runtime_error("Columnar channels need compound types");
     }
-    uint64_t timestamp(0);
-    if (H5Dread(chan.ts_set(), H5T_NATIVE_ULLONG, elem_space, chan.ts_space(),
-                H5P_DEFAULT, &timestamp) < 0)
+    // Each column is written from the field of the same name in memory
+    int fields(H5Tget_nmembers(file_type));
+    for (int ii(0); ii < fields; ++ii)
     {
-        throw std::runtime_error("Failed to read time stamp");
+        char* field(H5Tget_member_name(file_type, ii));
+        bool found(H5Tget_member_index(mem_type, field) >= 0);
+        std::string field_name(field);
+        H5free_memory(field);
+        if (!found)
+        {
+            throw std::runtime_error("Memory type of channel " + name +
+                    " has no field " + field_name);
+        }
     }
-    // Select and read the data
-    if (H5Sselect_elements(chan.rec_space(), H5S_SELECT_SET, 1, coords) < 0)
+    // Time stamps are chunked as in add_channel(); create_columns() chunks
+    // each column by the size of its field
+    hsize_t chunk_size = CHUNK_BYTES / sizeof(uint64_t);
+    hid_t ts_parms = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(ts_parms, 1, &chunk_size);
+    ChannelID id(0);
+    try
     {
-        throw std::runtime_error("Failed to select record");
+        id = create_channel(name, type_name, source_name, mem_type, file_type,
+                -1, ts_parms, 0, true);
     }
-    if (H5Dread(chan.rec_set(), chan.mem_type(), elem_space, chan.rec_space(),
-                H5P_DEFAULT, buf) < 0)
+    catch (...)
     {
-        throw std::runtime_error("Failed to read record");
+        H5Pclose(ts_parms);
+        throw;
     }
+    H5Pclose(ts_parms);
+    return id;
+}
 
-    return timestamp;
+
+bool HDF5R::columnar(ChannelID chan_id)
+{
+    return channel(chan_id).columnar();
 }
 
 
-std::string HDF5R::get_text_tag(std::string tag)
+void HDF5R::freeze(ChannelID chan_id)
 {
-    if (tags_grp_ < 0)
+    Channel& chan(channel(chan_id));
+    if (chan.capacity() == 0)
     {
-        throw std::runtime_error("No such tag: " + tag);
+        throw std::runtime_error("Only ring channels can be frozen");
     }
-    return read_string(tags_grp_, tag);
+    freeze_channel(chan);
+    checkpoint();
 }
 
 
-size_t HDF5R::get_binary_tag(std::string tag, void* const buf)
+void HDF5R::freeze()
 {
-    if (tags_grp_ < 0)
+    for (std::map<ChannelID, Channel>::iterator ii(channels_.begin());
+            ii != channels_.end(); ++ii)
     {
-        throw std::runtime_error("No such tag: " + tag);
+        // Only ring channels need opening
+        if (ii->second.is_open() && ii->second.capacity() == 0)
+        {
+            continue;
+        }
+        Channel& chan(channel(ii->first));
+        if (chan.capacity() > 0)
+        {
+            freeze_channel(chan);
+        }
     }
+    checkpoint();
+}
 
-    // Open the tag's dataset
-    hid_t dset = H5Dopen(tags_grp_, tag.c_str(), H5P_DEFAULT);
-    if (dset < 0)
+
+bool HDF5R::frozen(ChannelID chan_id)
+{
+    return channel(chan_id).frozen();
+}
+
+
+void HDF5R::freeze_channel(Channel& chan)
+{
+    if (mode_ == RDONLY || mode_ == SWMR_READ)
     {
-        throw std::runtime_error("No such tag: " + tag);
+        throw std::runtime_error("Cannot freeze a channel of a read-only file");
     }
-    hid_t type = H5Dget_type(dset);
-    if (type < 0)
+    if (!chan.frozen())
     {
-        throw std::runtime_error("Failed to get data type for tag " + tag);
+        write_uint_attr(chan.group(), "frozen", 1);
+        chan.frozen(true);
     }
-    size_t len = H5Tget_size(type);
-    if (len < 0)
+}
+
+
+ChannelID HDF5R::create_channel(std::string const& name,
+        std::string const& type_name, std::string const& source_name,
+        hid_t mem_type, hid_t file_type, hid_t rec_parms, hid_t ts_parms,
+        size_t capacity, bool columnar, uint64_t period)
+{
+    // New datasets cannot be created once SWMR writing has started
+    check_not_swmr("add channels");
+    // Check the channel doesn't already exist
+    if (have_channel(name))
     {
-        throw std::runtime_error("Failed to get data length for tag " + tag);
+        throw std::runtime_error("Channel already exists");
     }
-    // If buf is zero, just get the size
-    if (buf == 0)
+
+    ChannelID id(next_id_++);
+    // Create a group for the channel
+    hid_t group = H5Gcreate(channels_grp_.get(), name.c_str(), H5P_DEFAULT,
+            H5P_DEFAULT, H5P_DEFAULT);
+    // Populate it with the channel's properties. These are attributes in the
+    // group's own object header; older files stored each as a separate
+    // object, which made creating and opening a channel several times more
+    // expensive.
+    write_uint_attr(group, "uid", id);
+    write_string_attr(group, "type_name", type_name);
+    write_string_attr(group, "source_name", source_name);
+    write_type_attr(group, "mem_type", mem_type);
+    if (capacity > 0)
     {
-        return len;
+        write_uint_attr(group, "capacity", capacity);
+        write_uint_attr(group, "head", 0);
+        write_uint_attr(group, "frozen", 0);
     }
-    // Read the tag's data
-    if (H5Dread(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf) < 0)
+    if (period > 0)
     {
-        throw std::runtime_error("Error reading data for tag " + tag);
+        write_uint_attr(group, "period", period);
     }
-    H5Tclose(type);
-    H5Dclose(dset);
-    return len;
+    // Create a dataset for the entries, or one for each field of a columnar
+    // channel's, and a parallel dataset for the time stamps, or the timeline
+    // of a fixed-rate channel. Those of ring channels grow until they are
+    // full.
+    hsize_t dims[1] = {0};
+    hsize_t max_dims[1] = {capacity > 0 ? capacity : H5S_UNLIMITED};
+    std::vector<Channel::Column> columns;
+    if (columnar)
+    {
+        try
+        {
+            create_columns(group, name, mem_type, file_type, columns);
+        }
+        catch (...)
+        {
+            H5Gclose(group);
+            throw;
+        }
+    }
+    hid_t dapl = profile_.make_dapl(name);
+    hid_t rec_space(-1), rec_set(-1);
+    if (!columnar)
+    {
+        rec_space = H5Screate_simple(1, dims, max_dims);
+        rec_set = H5Dcreate(group, RECORDS_SET, file_type, rec_space,
+                H5P_DEFAULT, rec_parms, dapl);
+    }
+    hid_t ts_space(-1), ts_set(-1), timeline(-1);
+    if (period > 0)
+    {
+        timeline = create_timeline(group);
+    }
+    else
+    {
+        ts_space = H5Screate_simple(1, dims, max_dims);
+        ts_set = H5Dcreate(group, TIMESTAMPS_SET, H5T_STD_U64LE, ts_space,
+                H5P_DEFAULT, ts_parms, dapl);
+    }
+    H5Pclose(dapl);
+
+    // Keep a private copy of the type so the caller may close theirs
+    Channel chan(name, group, rec_space, rec_set, ts_space, ts_set,
+            H5Tcopy(mem_type));
+    chan.type_name(type_name);
+    chan.source_name(source_name);
+    chan.capacity(capacity);
+    chan.columns(columns);
+    chan.period(period);
+    chan.timeline(timeline);
+    chan.last_used(++use_clock_);
+    channels_[id] = chan;
+    channel_names_[name] = id;
+    ++open_channels_;
+    close_idle_channels();
+    return id;
 }
 
 
-std::map<std::string, TagType> HDF5R::get_tags() const
+// Copy count elements of one chunked data set from first to dest_first of
+// another with the same type and chunking, which must already be big enough.
+// Chunks that line up and lie wholly inside the range are copied as stored.
+static void copy_elements(hid_t src, hid_t dest, hsize_t first,
+        hsize_t dest_first, hsize_t count, CopyStats* stats)
 {
-    std::map<std::string, TagType> result;
-    if (tags_grp_ < 0)
+    hid_t type = H5Dget_type(src);
+    hid_t src_parms = H5Dget_create_plist(src);
+    hid_t dest_parms = H5Dget_create_plist(dest);
+    hsize_t src_chunk(0), dest_chunk(0);
+    H5Pget_chunk(src_parms, 1, &src_chunk);
+    H5Pget_chunk(dest_parms, 1, &dest_chunk);
+    H5Pclose(dest_parms);
+    H5Pclose(src_parms);
+    size_t size(H5Tget_size(type));
+    bool raw(src_chunk > 0 && src_chunk == dest_chunk &&
+            first % src_chunk == 0 && dest_first % dest_chunk == 0);
+    // Anything not copied raw is copied in blocks of whole destination
+    // chunks, read and written in the file's own type so nothing is converted
+    hsize_t block(std::max<hsize_t>(1, (1 << 20) / size));
+    if (dest_chunk > 0)
     {
-        // No tags
-        return result;
+        block = std::max<hsize_t>(1, block / dest_chunk) * dest_chunk;
     }
-
-    std::vector<std::string> tags;
-    H5Literate(tags_grp_, H5_INDEX_NAME, H5_ITER_NATIVE, 0, get_child_names,
-            &tags);
-
-    for(std::vector<std::string>::const_iterator ii(tags.begin());
-            ii != tags.end(); ++ii)
+    hid_t src_space = H5Dget_space(src);
+    hid_t dest_space = H5Dget_space(dest);
+    std::vector<char> buf;
+    std::string error;
+    hsize_t pos(0);
+    while (pos < count && error.empty())
     {
-        hid_t dset = H5Dopen(tags_grp_, ii->c_str(), H5P_DEFAULT);
-        if (dset < 0)
-        {
-            throw std::runtime_error("Error opening tag " + *ii);
-        }
-        hid_t type = H5Dget_type(dset);
-        if (type < 0)
-        {
-            throw std::runtime_error("Failed to get data type for tag " + *ii);
-        }
-        if (H5Tget_class(type) == H5T_STRING)
+        if (raw && pos + src_chunk <= count)
         {
-            result[*ii] = STRING_TAG;
+            hsize_t src_offset(first + pos);
+            hsize_t dest_offset(dest_first + pos);
+            hsize_t stored(0);
+            uint32_t filters(0);
+            if (H5Dget_chunk_storage_size(src, &src_offset, &stored) >= 0 &&
+                    stored > 0)
+            {
+                buf.resize(stored);
+                if (H5Dread_chunk(src, H5P_DEFAULT, &src_offset, &filters,
+                            &buf[0]) < 0 ||
+                        H5Dwrite_chunk(dest, H5P_DEFAULT, filters,
+                            &dest_offset, stored, &buf[0]) < 0)
+                {
+                    error = "Failed to copy chunk";
+                    break;
+                }
+                if (stats != 0)
+                {
+                    ++stats->raw_chunks;
+                    stats->raw_bytes += stored;
+                }
+                pos += src_chunk;
+                continue;
+            }
         }
-        else
+        // Raw copies stop at the last whole chunk, so only the final partial
+        // chunk is decoded
+        hsize_t n(std::min(raw ? src_chunk : block, count - pos));
+        hsize_t src_start(first + pos);
+        hsize_t dest_start(dest_first + pos);
+        buf.resize(n * size);
+        hid_t mem_space = H5Screate_simple(1, &n, 0);
+        H5Sselect_hyperslab(src_space, H5S_SELECT_SET, &src_start, 0, &n, 0);
+        H5Sselect_hyperslab(dest_space, H5S_SELECT_SET, &dest_start, 0, &n,
+                0);
+        if (H5Dread(src, type, mem_space, src_space, H5P_DEFAULT,
+                    &buf[0]) < 0 ||
+                H5Dwrite(dest, type, mem_space, dest_space, H5P_DEFAULT,
+                    &buf[0]) < 0)
         {
-            result[*ii] = BINARY_TAG;
+            error = "Failed to copy records";
         }
-        H5Tclose(type);
-        H5Dclose(dset);
+        H5Sclose(mem_space);
+        pos += n;
+    }
+    H5Sclose(dest_space);
+    H5Sclose(src_space);
+    H5Tclose(type);
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
     }
-    return result;
-}
-
-
-void HDF5R::set_text_tag(std::string tag, std::string value)
-{
-    prepare_tags_group();
-    write_string(tags_grp_, tag, value);
 }
 
 
-void HDF5R::set_binary_tag(std::string tag, void const* const buf, size_t size)
+// Copy records [first, first + count) of a channel's data set, in two runs
+// if they wrap around the end of a ring channel's
+static void copy_channel_set(Channel const& chan, hid_t src, hid_t dest,
+        hsize_t first, hsize_t count, CopyStats* stats)
 {
-    prepare_tags_group();
-    // Create a binary type of the necessary length
-    hid_t type = H5Tcreate(H5T_OPAQUE, size);
-    // Create the dataspace and dataset
-    hid_t dspace = H5Screate(H5S_SCALAR);
-    hid_t dset = H5Dcreate(tags_grp_, tag.c_str(), type, dspace, H5P_DEFAULT,
-            H5P_DEFAULT, H5P_DEFAULT);
-    // Write the binary blob
-    if (H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf) < 0)
+    hsize_t run(chan.run(first, count));
+    copy_elements(src, dest, chan.position(first), 0, run, stats);
+    if (run < count)
     {
-        throw std::runtime_error("Error writing binary tag " + tag);
+        copy_elements(src, dest, 0, run, count - run, stats);
     }
-    // Clean up
-    H5Dclose(dset);
-    H5Sclose(dspace);
-    H5Tclose(type);
 }
 
 
-///////////////////////////////////////////////////////////////////////////////
-// Private functions
-///////////////////////////////////////////////////////////////////////////////
-
-
-char const* const HDF5R::CHANNELS_GROUP = "/channels";
-char const* const HDF5R::TAGS_GROUP = "/tags";
-char const* const HDF5R::INDEX_SET = "/index";
-char const* const HDF5R::RECORDS_SET = "records";
-char const* const HDF5R::TIMESTAMPS_SET = "timestamps";
-
-
-void HDF5R::prepare()
+// A compound type of a columnar channel's fields as they are stored
+static hid_t columns_file_type(Channel const& chan)
 {
-    // If the file does not yet have a channels group, make it
-    channels_grp_ = H5Gopen(file_, CHANNELS_GROUP, H5P_DEFAULT);
-    if (channels_grp_ < 0)
+    std::vector<Channel::Column> const& columns(chan.columns());
+    std::vector<hid_t> types;
+    size_t size(0);
+    for (size_t ii(0); ii < columns.size(); ++ii)
     {
-        channels_grp_ = H5Gcreate(file_, CHANNELS_GROUP, H5P_DEFAULT,
-                H5P_DEFAULT, H5P_DEFAULT);
+        types.push_back(H5Dget_type(columns[ii].set.get()));
+        size += H5Tget_size(types.back());
     }
-    // Otherwise, read the existing channels from the file
-    else
+    hid_t type = H5Tcreate(H5T_COMPOUND, size);
+    size_t offset(0);
+    for (size_t ii(0); ii < columns.size(); ++ii)
     {
-        std::vector<std::string> chan_names;
-        H5Literate(channels_grp_, H5_INDEX_NAME, H5_ITER_NATIVE, 0,
-                get_child_names, &chan_names);
-        for(std::vector<std::string>::const_iterator ii(chan_names.begin());
-                ii != chan_names.end(); ++ii)
-        {
-            hid_t group = H5Gopen(channels_grp_, ii->c_str(), H5P_DEFAULT);
-            hid_t rec_set = H5Dopen(group, RECORDS_SET, H5P_DEFAULT);
-            hid_t rec_space = H5Dget_space(rec_set);
-            hid_t ts_set = H5Dopen(group, TIMESTAMPS_SET, H5P_DEFAULT);
-            hid_t ts_space = H5Dget_space(ts_set);
-            hid_t mem_type = read_type(group, "mem_type");
-            hsize_t num_recs;
-            H5Sget_simple_extent_dims(ts_space, &num_recs, 0);
-            unsigned int uid = read_uint(group, "uid");
-            channels_[uid] = Channel(*ii, group, rec_space, rec_set,
-                    ts_space, ts_set, mem_type, num_recs);
-            if (uid + 1 > next_id_)
-            {
-                next_id_ = uid + 1;
-            }
-        }
+        H5Tinsert(type, columns[ii].name.c_str(), offset, types[ii]);
+        offset += H5Tget_size(types[ii]);
+        H5Tclose(types[ii]);
     }
-
-    prepare_tags_group();
-    read_index();
+    return type;
 }
 
 
-void HDF5R::prepare_tags_group()
+ChannelID HDF5R::copy_channel(HDF5R& src, ChannelID src_id,
+        std::string const& name, hsize_t first, hsize_t last,
+        CopyStats* stats)
 {
-    // If the tags group is open, nothing to do
-    if (tags_grp_ >= 0)
+    if (&src == this)
     {
-        return;
+        throw std::runtime_error("Can't copy a channel within a file");
+    }
+    Channel& src_chan(src.channel(src_id));
+    last = std::min<hsize_t>(last, src_chan.size());
+    first = std::min(first, last);
+    // The new channel gets the source's storage layout, including its chunk
+    // size and any filters, so that its chunks can be copied as they are.
+    // The columns of a columnar channel are chunked by their fields' sizes,
+    // so the new channel's match them.
+    bool columnar(src_chan.columnar());
+    hid_t file_type = columnar ? columns_file_type(src_chan) :
+        H5Dget_type(src_chan.rec_set());
+    hid_t rec_parms = columnar ? -1 : H5Dget_create_plist(src_chan.rec_set());
+    uint64_t period(src_chan.period());
+    hid_t ts_parms = period > 0 ? -1 : H5Dget_create_plist(src_chan.ts_set());
+    ChannelID id(0);
+    try
+    {
+        id = create_channel(name, src_chan.type_name(),
+                src_chan.source_name(), src_chan.mem_type(), file_type,
+                rec_parms, ts_parms, 0, columnar, period);
+    }
+    catch (...)
+    {
+        if (ts_parms >= 0)
+        {
+            H5Pclose(ts_parms);
+        }
+        if (rec_parms >= 0)
+        {
+            H5Pclose(rec_parms);
+        }
+        H5Tclose(file_type);
+        throw;
+    }
+    if (ts_parms >= 0)
+    {
+        H5Pclose(ts_parms);
+    }
+    if (rec_parms >= 0)
+    {
+        H5Pclose(rec_parms);
+    }
+    H5Tclose(file_type);
+
+    Channel& chan(channel(id));
+    hsize_t extent[1] = {last - first};
+    hsize_t max_extent[1] = {H5S_UNLIMITED};
+    if ((period == 0 && H5Dset_extent(chan.ts_set(), extent) < 0) ||
+            (!columnar && H5Dset_extent(chan.rec_set(), extent) < 0))
+    {
+        throw std::runtime_error("Failed to extend copied channel");
+    }
+    if (period == 0)
+    {
+        H5Sset_extent_simple(chan.ts_space(), 1, extent, max_extent);
+    }
+    if (columnar)
+    {
+        extend_columns(chan, extent[0]);
+        for (size_t ii(0); ii < chan.columns().size(); ++ii)
+        {
+            copy_channel_set(src_chan, src_chan.columns()[ii].set.get(),
+                    chan.columns()[ii].set.get(), first, extent[0], stats);
+        }
+    }
+    else
+    {
+        H5Sset_extent_simple(chan.rec_space(), 1, extent, max_extent);
+        copy_channel_set(src_chan, src_chan.rec_set(), chan.rec_set(), first,
+                extent[0], stats);
+    }
+    if (period == 0)
+    {
+        copy_channel_set(src_chan, src_chan.ts_set(), chan.ts_set(), first,
+                extent[0], stats);
+    }
+    else if (extent[0] > 0)
+    {
+        // The runs of the copied records, the first starting with them
+        Channel::TimelineRun run = {0, 0};
+        src_chan.timeline_stamps(first, 1, &run.timestamp);
+        chan.runs().push_back(run);
+        std::vector<Channel::TimelineRun> const& runs(src_chan.runs());
+        for (size_t ii(0); ii < runs.size(); ++ii)
+        {
+            if (runs[ii].first > first && runs[ii].first < last)
+            {
+                run.first = runs[ii].first - first;
+                run.timestamp = runs[ii].timestamp;
+                chan.runs().push_back(run);
+            }
+        }
+        write_runs(chan, 0);
+    }
+    chan.size(extent[0]);
+    if (stats != 0)
+    {
+        stats->records += extent[0];
+    }
+    src.close_idle_channels();
+    return id;
+}
+
+
+
+hsize_t HDF5R::chunk_start(ChannelID chan_id, hsize_t index)
+{
+    Channel& chan(channel(chan_id));
+    // The widest field's column holds the most bytes, and has the fewest
+    // records per chunk
+    std::vector<hid_t> sets;
+    std::vector<Channel::Column> const& columns(chan.columns());
+    for (size_t ii(0); ii < columns.size(); ++ii)
+    {
+        sets.push_back(columns[ii].set.get());
+    }
+    if (sets.empty())
+    {
+        sets.push_back(chan.rec_set());
+    }
+    hsize_t chunk(0);
+    for (size_t ii(0); ii < sets.size(); ++ii)
+    {
+        Handle parms(H5Dget_create_plist(sets[ii]));
+        hsize_t records(0);
+        if (H5Pget_chunk(parms.get(), 1, &records) < 1)
+        {
+            throw std::runtime_error("Failed to get chunk size of channel " +
+                    chan.name());
+        }
+        if (chunk == 0 || records < chunk)
+        {
+            chunk = records;
+        }
+    }
+    // A ring channel's chunks are counted from the start of its data sets
+    hsize_t offset(chan.position(index) % chunk);
+    return offset <= index ? index - offset : index;
+}
+
+std::vector<ChannelID> HDF5R::channels() const
+{
+    std::vector<ChannelID> result;
+    for (std::map<ChannelID, Channel>::const_iterator ii(channels_.begin());
+            ii != channels_.end(); ++ii)
+    {
+        result.push_back(ii->first);
+    }
+    return result;
+}
+
+
+ChannelInfo HDF5R::get_channel_info(ChannelID chan_id)
+{
+    return read_channel_info(channel(chan_id));
+}
+
+
+bool HDF5R::have_channel(std::string const& name) const
+{
+    return channel_names_.find(name) != channel_names_.end();
+}
+
+
+ChannelID HDF5R::get_channel_id(std::string const& name) const
+{
+    std::map<std::string, ChannelID>::const_iterator found(
+            channel_names_.find(name));
+    if (found == channel_names_.end())
+    {
+        throw std::runtime_error("No such channel: " + name);
+    }
+    return found->second;
+}
+
+
+void HDF5R::add_entry(ChannelID chan_id, uint64_t timestamp,
+        void const* const buf)
+{
+    append_entry(chan_id, channel(chan_id), timestamp, buf);
+    check_durability();
+}
+
+
+void HDF5R::add_frame(uint64_t timestamp, Frame const& records)
+{
+    // Check every channel before writing anything, so that a bad frame
+    // leaves the file as it was
+    for (Frame::const_iterator ii(records.begin()); ii != records.end();
+            ++ii)
+    {
+        if (channels_.find(ii->first) == channels_.end())
+        {
+            throw std::runtime_error("Bad channel ID");
+        }
+        for (Frame::const_iterator jj(records.begin()); jj != ii; ++jj)
+        {
+            if (jj->first == ii->first)
+            {
+                throw std::runtime_error(
+                        "Frame has more than one record for a channel");
+            }
+        }
+    }
+    // Each channel is looked up only as it is written, because opening one
+    // may close another that has nothing unsaved
+    std::vector<FrameUndo> undo;
+    undo.reserve(records.size());
+    size_t indexed(index_.size()), pending(pending_index_.size());
+    try
+    {
+        for (Frame::const_iterator ii(records.begin()); ii != records.end();
+                ++ii)
+        {
+            Channel& chan(channel(ii->first));
+            undo.push_back(frame_undo(ii->first, chan));
+            append_entry(ii->first, chan, timestamp, ii->second);
+        }
+    }
+    catch (...)
+    {
+        try
+        {
+            undo_frame(undo, timestamp, indexed, pending);
+        }
+        catch (...)
+        {
+            // The records are no longer counted, which is what matters;
+            // the error worth passing on is the first one
+        }
+        throw;
+    }
+    // Once for the whole frame, so that a checkpoint never commits part of
+    // one
+    check_durability(records.size());
+}
+
+
+HDF5R::FrameUndo HDF5R::frame_undo(ChannelID chan_id, Channel& chan)
+{
+    FrameUndo undo;
+    undo.chan = chan_id;
+    undo.size = chan.size();
+    undo.runs = chan.runs().size();
+    undo.head = chan.head();
+    undo.extent = 0;
+    undo.overwrites = false;
+    undo.old_timestamp = 0;
+    if (chan.capacity() > 0)
+    {
+        H5Sget_simple_extent_dims(chan.rec_space(), &undo.extent, 0);
+        undo.overwrites = chan.size() == chan.capacity() && !chan.frozen();
+    }
+    if (undo.overwrites)
+    {
+        undo.old_record.resize(H5Tget_size(chan.mem_type()));
+        read_records(chan, 0, 1, chan.mem_type(), &undo.old_record[0]);
+        read_timestamps(chan, chan.ts_space(), 0, 1, &undo.old_timestamp);
+    }
+    return undo;
+}
+
+
+// Take back the records of a frame that failed part way through. The
+// channels' sizes and the index are put back before the file, so that the
+// records are not committed later even if the file can't be put back.
+void HDF5R::undo_frame(std::vector<FrameUndo> const& undo,
+        uint64_t timestamp, size_t indexed, size_t pending)
+{
+    index_.remove_last(timestamp, index_.size() - indexed);
+    pending_index_.resize(pending);
+    std::vector<size_t> added_runs(undo.size());
+    for (size_t ii(0); ii < undo.size(); ++ii)
+    {
+        Channel& chan(channels_[undo[ii].chan]);
+        chan.size(undo[ii].size);
+        chan.head(undo[ii].head);
+        added_runs[ii] = chan.runs().size() - undo[ii].runs;
+        chan.runs().resize(undo[ii].runs);
+        forget_cached_blocks(undo[ii].chan);
+    }
+
+    for (size_t ii(0); ii < undo.size(); ++ii)
+    {
+        Channel& chan(channels_[undo[ii].chan]);
+        if (chan.capacity() > 0)
+        {
+            if (undo[ii].overwrites)
+            {
+                write_ring_slot(chan, chan.position(0),
+                        undo[ii].old_timestamp, &undo[ii].old_record[0]);
+            }
+            hsize_t extent[1] = {undo[ii].extent};
+            hsize_t max_extent[1] = {chan.capacity()};
+            if (H5Dset_extent(chan.rec_set(), extent) < 0 ||
+                    H5Dset_extent(chan.ts_set(), extent) < 0)
+            {
+                throw std::runtime_error("Failed to shrink ring channel");
+            }
+            H5Sset_extent_simple(chan.rec_space(), 1, extent, max_extent);
+            H5Sset_extent_simple(chan.ts_space(), 1, extent, max_extent);
+            continue;
+        }
+        hsize_t extent[1] = {chan.size()};
+        hsize_t max_extent[1] = {H5S_UNLIMITED};
+        if (chan.columnar())
+        {
+            extend_columns(chan, extent[0]);
+        }
+        else
+        {
+            if (H5Dset_extent(chan.rec_set(), extent) < 0)
+            {
+                throw std::runtime_error("Failed to shrink channel " +
+                        chan.name());
+            }
+            H5Sset_extent_simple(chan.rec_space(), 1, extent, max_extent);
+        }
+        if (chan.period() == 0)
+        {
+            if (H5Dset_extent(chan.ts_set(), extent) < 0)
+            {
+                throw std::runtime_error("Failed to shrink channel " +
+                        chan.name());
+            }
+            H5Sset_extent_simple(chan.ts_space(), 1, extent, max_extent);
+        }
+        else if (added_runs[ii] > 0)
+        {
+            write_runs(chan, chan.runs().size());
+        }
+    }
+}
+
+
+void HDF5R::append_entry(ChannelID chan_id, Channel& chan,
+        uint64_t timestamp, void const* const buf)
+{
+    if (chan.capacity() > 0)
+    {
+        add_ring_entry(chan_id, chan, timestamp, buf);
+        return;
+    }
+    hsize_t extent[1];
+    extent[0] = chan.size() + 1;
+    hsize_t max_extent[1] = {H5S_UNLIMITED};
+    hsize_t coords[1];
+    coords[0] = chan.size();
+
+    if (chan.period() > 0)
+    {
+        // Before the record, so that SWMR readers that see the record can
+        // tell its time stamp
+        append_timeline(chan, coords[0], 1, &timestamp);
+    }
+    if (chan.columnar())
+    {
+        write_columns(chan, coords[0], 1, buf);
+    }
+    else
+    {
+        // Extend the record data set by one element
+        if (H5Dset_extent(chan.rec_set(), extent) < 0)
+        {
+            throw std::runtime_error(
+                    "Failed to extend dataset for new record");
+        }
+        // Keep the cached data space in step with the data set
+        H5Sset_extent_simple(chan.rec_space(), 1, extent, max_extent);
+        // Select the (new) last element in the data set
+        if (H5Sselect_elements(chan.rec_space(), H5S_SELECT_SET, 1,
+                    coords) < 0)
+        {
+            throw std::runtime_error(
+                    "Failed to select element to write record");
+        }
+        // Write the record
+        if (H5Dwrite(chan.rec_set(), chan.mem_type(), elem_space_.get(),
+                    chan.rec_space(), H5P_DEFAULT, buf) < 0)
+        {
+            throw std::runtime_error("Failed to write record");
+        }
+    }
+
+    // Repeat for the time stamp
+    if (chan.period() == 0)
+    {
+        if (H5Dset_extent(chan.ts_set(), extent) < 0)
+        {
+            throw std::runtime_error(
+                    "Failed to extend dataset for new timestamp");
+        }
+        H5Sset_extent_simple(chan.ts_space(), 1, extent, max_extent);
+        if (H5Sselect_elements(chan.ts_space(), H5S_SELECT_SET, 1,
+                    coords) < 0)
+        {
+            throw std::runtime_error(
+                    "Failed to select element to write timestamp");
+        }
+        if (H5Dwrite(chan.ts_set(), H5T_NATIVE_UINT64, elem_space_.get(),
+                    chan.ts_space(), H5P_DEFAULT, &timestamp) < 0)
+        {
+            throw std::runtime_error("Failed to write timestamp");
+        }
+    }
+
+    // Update the channel size
+    chan.size(chan.size() + 1);
+
+    index_.append(timestamp, chan_id, coords[0]);
+    if (index_in_file_)
+    {
+        pending_index_.push_back(std::make_pair(timestamp,
+                    IndexPointer(chan_id, coords[0])));
+    }
+}
+
+
+void HDF5R::add_ring_entry(ChannelID chan_id, Channel& chan,
+        uint64_t timestamp, void const* const buf)
+{
+    bool full(chan.size() == chan.capacity());
+    if (full && chan.frozen())
+    {
+        return;
+    }
+    // A full channel's new record goes where its oldest was
+    hsize_t coords[1] = {chan.position(full ? 0 : chan.size())};
+    hsize_t extent[1];
+    H5Sget_simple_extent_dims(chan.rec_space(), extent, 0);
+    if (coords[0] >= extent[0])
+    {
+        extent[0] = coords[0] + 1;
+        hsize_t max_extent[1] = {chan.capacity()};
+        if (H5Dset_extent(chan.rec_set(), extent) < 0 ||
+                H5Dset_extent(chan.ts_set(), extent) < 0)
+        {
+            throw std::runtime_error("Failed to extend ring channel");
+        }
+        H5Sset_extent_simple(chan.rec_space(), 1, extent, max_extent);
+        H5Sset_extent_simple(chan.ts_space(), 1, extent, max_extent);
+    }
+    write_ring_slot(chan, coords[0], timestamp, buf);
+    if (full)
+    {
+        // Every record moves down one place, so cached blocks are stale
+        chan.head((chan.head() + 1) % chan.capacity());
+        forget_cached_blocks(chan_id);
+    }
+    else
+    {
+        chan.size(chan.size() + 1);
+    }
+}
+
+
+void HDF5R::write_ring_slot(Channel& chan, hsize_t position,
+        uint64_t timestamp, void const* const buf)
+{
+    hsize_t coords[1] = {position};
+    if (H5Sselect_elements(chan.rec_space(), H5S_SELECT_SET, 1, coords) < 0 ||
+            H5Dwrite(chan.rec_set(), chan.mem_type(), elem_space_.get(),
+                chan.rec_space(), H5P_DEFAULT, buf) < 0)
+    {
+        throw std::runtime_error("Failed to write record");
+    }
+    if (H5Sselect_elements(chan.ts_space(), H5S_SELECT_SET, 1, coords) < 0 ||
+            H5Dwrite(chan.ts_set(), H5T_NATIVE_UINT64, elem_space_.get(),
+                chan.ts_space(), H5P_DEFAULT, &timestamp) < 0)
+    {
+        throw std::runtime_error("Failed to write timestamp");
+    }
+}
+
+
+void HDF5R::add_entries(ChannelID chan_id, size_t count,
+        uint64_t const* const timestamps, void const* const buf)
+{
+    Channel& chan(channel(chan_id));
+    if (count == 0)
+    {
+        return;
+    }
+    if (chan.capacity() > 0)
+    {
+        // Any of the records may overwrite another
+        size_t rec_size(H5Tget_size(chan.mem_type()));
+        for (size_t ii(0); ii < count; ++ii)
+        {
+            add_ring_entry(chan_id, chan, timestamps[ii],
+                    static_cast<char const*>(buf) + ii * rec_size);
+        }
+        check_durability(count);
+        return;
+    }
+    hsize_t start(chan.size());
+    hsize_t extent[1] = {start + count};
+    hsize_t max_extent[1] = {H5S_UNLIMITED};
+    hsize_t n(count);
+    bool fixed_rate(chan.period() > 0);
+    if (fixed_rate)
+    {
+        append_timeline(chan, start, count, timestamps);
+    }
+    if (chan.columnar())
+    {
+        write_columns(chan, start, count, buf);
+    }
+    else if (H5Dset_extent(chan.rec_set(), extent) < 0)
+    {
+        throw std::runtime_error("Failed to extend datasets for new records");
+    }
+    if (!fixed_rate && H5Dset_extent(chan.ts_set(), extent) < 0)
+    {
+        throw std::runtime_error("Failed to extend datasets for new records");
+    }
+    if (!chan.columnar())
+    {
+        H5Sset_extent_simple(chan.rec_space(), 1, extent, max_extent);
+    }
+    if (!fixed_rate)
+    {
+        H5Sset_extent_simple(chan.ts_space(), 1, extent, max_extent);
+    }
+    hid_t mem_space = H5Screate_simple(1, &n, 0);
+    std::string error;
+    if (!chan.columnar() &&
+            (H5Sselect_hyperslab(chan.rec_space(), H5S_SELECT_SET, &start, 0,
+                &n, 0) < 0 ||
+            H5Dwrite(chan.rec_set(), chan.mem_type(), mem_space,
+                chan.rec_space(), H5P_DEFAULT, buf) < 0))
+    {
+        error = "Failed to write records";
+    }
+    else if (!fixed_rate &&
+            (H5Sselect_hyperslab(chan.ts_space(), H5S_SELECT_SET, &start, 0,
+                &n, 0) < 0 ||
+            H5Dwrite(chan.ts_set(), H5T_NATIVE_UINT64, mem_space,
+                chan.ts_space(), H5P_DEFAULT, timestamps) < 0))
+    {
+        error = "Failed to write timestamps";
+    }
+    H5Sclose(mem_space);
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+    chan.size(start + count);
+
+    index_.append(count, timestamps, chan_id, start);
+    if (index_in_file_)
+    {
+        for (size_t ii(0); ii < count; ++ii)
+        {
+            pending_index_.push_back(std::make_pair(timestamps[ii],
+                        IndexPointer(chan_id, start + ii)));
+        }
+    }
+
+    check_durability(count);
+}
+
+
+size_t HDF5R::get_entry_size(ChannelID chan_id, hsize_t index)
+{
+    // index is actually ignored, since all entries in a dataset must be a
+    // fixed size in HDF5.
+    return H5Tget_size(channel(chan_id).mem_type());
+}
+
+
+uint64_t HDF5R::get_entry(ChannelID chan_id, hsize_t index, void* const buf)
+{
+    Channel& chan(channel(chan_id));
+    // Records holding variable-length data point to memory allocated for
+    // each read, so only fixed-size records can be copied out of the cache
+    if (profile_.record_cache().bytes() > 0 && index < chan.size() &&
+            H5Tdetect_class(chan.mem_type(), H5T_VLEN) <= 0)
+    {
+        CachedBlock const& block(cached_block(chan_id, chan, index));
+        size_t rec_size(H5Tget_size(chan.mem_type()));
+        memcpy(buf, &block.records[(index - block.start) * rec_size],
+                rec_size);
+        return block.timestamps[index - block.start];
+    }
+    hsize_t coords[1];
+    coords[0] = chan.position(index);
+    uint64_t timestamp(0);
+    if (chan.period() > 0)
+    {
+        chan.timeline_stamps(index, 1, &timestamp);
+    }
+    // Select and read the time stamp
+    else if (H5Sselect_elements(chan.ts_space(), H5S_SELECT_SET, 1,
+                coords) < 0)
+    {
+        throw std::runtime_error("Failed to select time stamp");
+    }
+    else if (H5Dread(chan.ts_set(), H5T_NATIVE_UINT64, elem_space_.get(),
+                chan.ts_space(), H5P_DEFAULT, &timestamp) < 0)
+    {
+        throw std::runtime_error("Failed to read time stamp");
+    }
+    if (chan.columnar())
+    {
+        read_columns(chan, index, 1, 0, buf);
+        return timestamp;
+    }
+    // Select and read the data
+    if (H5Sselect_elements(chan.rec_space(), H5S_SELECT_SET, 1, coords) < 0)
+    {
+        throw std::runtime_error("Failed to select record");
+    }
+    if (H5Dread(chan.rec_set(), chan.mem_type(), elem_space_.get(),
+                chan.rec_space(), H5P_DEFAULT, buf) < 0)
+    {
+        throw std::runtime_error("Failed to read record");
+    }
+
+    return timestamp;
+}
+
+
+void HDF5R::clear_record_cache()
+{
+    record_cache_.clear();
+    cached_blocks_.clear();
+    record_cache_stats_ = RecordCacheStats();
+}
+
+
+void HDF5R::forget_cached_blocks(ChannelID chan_id)
+{
+    std::map<BlockKey, BlockList::iterator>::iterator ii(
+            cached_blocks_.lower_bound(BlockKey(chan_id, 0)));
+    while (ii != cached_blocks_.end() && ii->first.first == chan_id)
+    {
+        CachedBlock const& block(*ii->second);
+        record_cache_stats_.bytes -= block.timestamps.size() *
+            sizeof(uint64_t) + block.records.size();
+        --record_cache_stats_.blocks;
+        record_cache_.erase(ii->second);
+        cached_blocks_.erase(ii++);
+    }
+}
+
+
+size_t HDF5R::refresh()
+{
+    // Only a file being followed can change underneath us
+    if (mode_ != SWMR_READ)
+    {
+        return 0;
+    }
+
+    size_t new_records(0);
+    hsize_t max_extent[1] = {H5S_UNLIMITED};
+    for (std::map<ChannelID, Channel>::iterator ii(channels_.begin());
+            ii != channels_.end(); ++ii)
+    {
+        Channel& chan(ii->second);
+        // Channels not yet opened pick up their size when they are, unless
+        // the index needs their new records now
+        if (!chan.is_open())
+        {
+            if (index_loaded_)
+            {
+                size_t old_size(chan.size());
+                channel(ii->first);
+                new_records += chan.size() - old_size;
+            }
+            continue;
+        }
+        // Time stamps are written after their records, so only the time
+        // stamps need to be checked for new data. Fixed-rate channels'
+        // timelines are written before their records, so their records
+        // are checked instead.
+        bool fixed_rate(chan.period() > 0);
+        hid_t last_set(fixed_rate ? chan.rec_set() : chan.ts_set());
+        if (H5Drefresh(last_set) < 0)
+        {
+            throw std::runtime_error("Failed to refresh time stamps");
+        }
+        hid_t last_space = H5Dget_space(last_set);
+        hsize_t num_recs(0);
+        H5Sget_simple_extent_dims(last_space, &num_recs, 0);
+        H5Sclose(last_space);
+        if (num_recs <= chan.size())
+        {
+            continue;
+        }
+        hsize_t old_size(chan.size());
+        if (fixed_rate)
+        {
+            if (H5Drefresh(chan.timeline()) < 0)
+            {
+                throw std::runtime_error("Failed to refresh timeline");
+            }
+            chan.size(num_recs);
+            load_timeline(chan);
+        }
+        std::vector<Channel::Column> const& columns(chan.columns());
+        for (size_t jj(0); jj < columns.size(); ++jj)
+        {
+            if (H5Drefresh(columns[jj].set.get()) < 0)
+            {
+                throw std::runtime_error("Failed to refresh records");
+            }
+            H5Sset_extent_simple(columns[jj].space.get(), 1, &num_recs,
+                    max_extent);
+        }
+        if (!chan.columnar())
+        {
+            if (!fixed_rate && H5Drefresh(chan.rec_set()) < 0)
+            {
+                throw std::runtime_error("Failed to refresh records");
+            }
+            H5Sset_extent_simple(chan.rec_space(), 1, &num_recs, max_extent);
+        }
+        if (!fixed_rate)
+        {
+            H5Sset_extent_simple(chan.ts_space(), 1, &num_recs, max_extent);
+        }
+        new_records += num_recs - old_size;
+        chan.size(num_recs);
+        index_followed(ii->first, chan);
+    }
+    return new_records;
+}
+
+
+size_t HDF5R::follow(ChannelID chan_id, size_t max_count,
+        uint64_t* const timestamps, void* const buf)
+{
+    Channel& chan(channel(chan_id));
+    size_t count(get_entries(chan_id, chan.cursor(), max_count, timestamps,
+                buf));
+    chan.cursor(chan.cursor() + count);
+    return count;
+}
+
+
+size_t HDF5R::get_entries(ChannelID chan_id, hsize_t start, size_t count,
+        uint64_t* const timestamps, void* const buf)
+{
+    Channel& chan(channel(chan_id));
+    if (start >= chan.size())
+    {
+        return 0;
+    }
+    count = std::min<hsize_t>(count, chan.size() - start);
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (timestamps != 0)
+    {
+        read_timestamps(chan, chan.ts_space(), start, count, timestamps);
+    }
+    if (buf != 0)
+    {
+        read_records(chan, start, count, chan.mem_type(), buf);
+    }
+    return count;
+}
+
+
+size_t HDF5R::get_fields(ChannelID chan_id, hsize_t start, size_t count,
+        std::vector<std::string> const& fields, uint64_t* const timestamps,
+        void* const buf)
+{
+    Channel& chan(channel(chan_id));
+    if (H5Tget_class(chan.mem_type()) != H5T_COMPOUND)
+    {
+        throw std::runtime_error("Records of channel " + chan.name() +
+                " have no fields");
+    }
+    // A memory type of just the fields asked for, in their usual places
+    Handle type(H5Tcreate(H5T_COMPOUND, H5Tget_size(chan.mem_type())));
+    for (std::vector<std::string>::const_iterator ii(fields.begin());
+            ii != fields.end(); ++ii)
+    {
+        int member(H5Tget_member_index(chan.mem_type(), ii->c_str()));
+        if (member < 0)
+        {
+            throw std::runtime_error("Records of channel " + chan.name() +
+                    " have no field " + *ii);
+        }
+        Handle field_type(H5Tget_member_type(chan.mem_type(), member));
+        H5Tinsert(type.get(), ii->c_str(),
+                H5Tget_member_offset(chan.mem_type(), member),
+                field_type.get());
+    }
+
+    if (start >= chan.size())
+    {
+        return 0;
+    }
+    count = std::min<hsize_t>(count, chan.size() - start);
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (timestamps != 0)
+    {
+        read_timestamps(chan, chan.ts_space(), start, count, timestamps);
+    }
+    if (buf == 0 || fields.empty())
+    {
+        return count;
+    }
+    if (chan.columnar())
+    {
+        read_columns(chan, start, count, &fields, buf);
+    }
+    else
+    {
+        read_records(chan, start, count, type.get(), buf);
+    }
+    return count;
+}
+
+
+hsize_t HDF5R::find_entry(ChannelID chan_id, uint64_t timestamp)
+{
+    Channel& chan(channel(chan_id));
+    if (chan.period() > 0)
+    {
+        return chan.timeline_find(timestamp);
+    }
+    // Binary search over the time stamps on disk, one element at a time;
+    // the chunk cache holds the few chunks visited
+    hsize_t lo(0), hi(chan.size());
+    while (lo < hi)
+    {
+        hsize_t mid(lo + (hi - lo) / 2);
+        uint64_t stamp(0);
+        read_timestamps(chan, chan.ts_space(), mid, 1, &stamp);
+        if (stamp < timestamp)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+// Number of time stamps read from a channel at a time when rebuilding the
+// index
+static hsize_t const REBUILD_BLOCK_SIZE = 65536;
+// Time stamps sampled from each channel to split the merge into slices
+static size_t const REBUILD_SAMPLES = 64;
+
+
+// A channel's time stamps, sorted, along with the record each came from
+struct RebuildRun
+{
+    ChannelID chan_id;
+    std::vector<uint64_t> timestamps;
+    std::vector<uint64_t> records;
+};
+
+
+// Records of the rebuilt index within a range of time stamps, merged from
+// every channel
+struct RebuildSlice
+{
+    // Where the slice starts in each run
+    std::vector<size_t> begin;
+    std::vector<uint64_t> timestamps;
+    std::vector<ChannelID> channels;
+    std::vector<uint64_t> records;
+};
+
+
+// Work shared by the threads sorting and merging the rebuilt index. They
+// use no part of the HDF5 library, which is not safe to use from several
+// threads at once.
+struct RebuildWork
+{
+    std::vector<RebuildRun> runs;
+    std::vector<RebuildSlice> slices;
+    size_t next;
+    pthread_mutex_t lock;
+};
+
+
+// Position of the next unmerged time stamp in a run
+struct RunCursor
+{
+    uint64_t timestamp;
+    size_t run;
+    size_t pos;
+
+    bool operator<(RunCursor const& rhs) const
+    {
+        // Reversed so the priority queue yields the earliest time stamp, with
+        // ties going to the lowest channel
+        if (timestamp != rhs.timestamp)
+        {
+            return timestamp > rhs.timestamp;
+        }
+        return run > rhs.run;
+    }
+};
+
+
+struct sort_by_timestamp_fun
+{
+    sort_by_timestamp_fun(std::vector<uint64_t> const& timestamps)
+        : timestamps_(timestamps)
+    {}
+
+    bool operator()(uint64_t lhs, uint64_t rhs) const
+    {
+        return timestamps_[lhs] < timestamps_[rhs];
+    }
+
+    std::vector<uint64_t> const& timestamps_;
+};
+
+
+// The next task for a rebuild thread, or false once they are all taken
+static bool next_rebuild_task(RebuildWork* work, size_t tasks, size_t& task)
+{
+    pthread_mutex_lock(&work->lock);
+    task = work->next++;
+    pthread_mutex_unlock(&work->lock);
+    return task < tasks;
+}
+
+
+// Time stamps are normally already in order within a channel, but sort any
+// that are not, remembering which record each came from
+static void* sort_runs_worker(void* arg)
+{
+    RebuildWork* work = reinterpret_cast<RebuildWork*>(arg);
+    size_t run;
+    while (next_rebuild_task(work, work->runs.size(), run))
+    {
+        std::vector<uint64_t>& timestamps(work->runs[run].timestamps);
+        std::vector<uint64_t>& records(work->runs[run].records);
+        records.resize(timestamps.size());
+        for (size_t ii(0); ii < records.size(); ++ii)
+        {
+            records[ii] = ii;
+        }
+        for (size_t ii(1); ii < timestamps.size(); ++ii)
+        {
+            if (timestamps[ii] < timestamps[ii - 1])
+            {
+                std::stable_sort(records.begin(), records.end(),
+                        sort_by_timestamp_fun(timestamps));
+                std::vector<uint64_t> sorted(timestamps.size());
+                for (size_t jj(0); jj < records.size(); ++jj)
+                {
+                    sorted[jj] = timestamps[records[jj]];
+                }
+                timestamps.swap(sorted);
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+
+// Merge the channels' records within each slice, keeping every record that
+// shares a time stamp
+static void* merge_slices_worker(void* arg)
+{
+    RebuildWork* work = reinterpret_cast<RebuildWork*>(arg);
+    size_t slice;
+    while (next_rebuild_task(work, work->slices.size(), slice))
+    {
+        RebuildSlice& dest(work->slices[slice]);
+        std::vector<size_t> end(work->runs.size());
+        std::priority_queue<RunCursor> heads;
+        size_t total(0);
+        for (size_t run(0); run < work->runs.size(); ++run)
+        {
+            end[run] = slice + 1 < work->slices.size() ?
+                work->slices[slice + 1].begin[run] :
+                work->runs[run].timestamps.size();
+            total += end[run] - dest.begin[run];
+            if (dest.begin[run] < end[run])
+            {
+                RunCursor head = {work->runs[run].timestamps[dest.begin[run]],
+                    run, dest.begin[run]};
+                heads.push(head);
+            }
+        }
+        dest.timestamps.reserve(total);
+        dest.channels.reserve(total);
+        dest.records.reserve(total);
+        while (!heads.empty())
+        {
+            RunCursor head(heads.top());
+            heads.pop();
+            RebuildRun const& source(work->runs[head.run]);
+            dest.timestamps.push_back(head.timestamp);
+            dest.channels.push_back(source.chan_id);
+            dest.records.push_back(source.records[head.pos]);
+            if (++head.pos < end[head.run])
+            {
+                head.timestamp = source.timestamps[head.pos];
+                heads.push(head);
+            }
+        }
+    }
+    return 0;
+}
+
+
+// Run a worker on this thread and threads - 1 others until it returns on
+// all of them
+static void run_rebuild_workers(void* (*worker)(void*), RebuildWork* work,
+        unsigned int threads)
+{
+    work->next = 0;
+    std::vector<pthread_t> workers;
+    for (unsigned int ii(1); ii < threads; ++ii)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, 0, worker, work) == 0)
+        {
+            workers.push_back(thread);
+        }
+    }
+    // This thread does its share too
+    worker(work);
+    for (std::vector<pthread_t>::const_iterator ii(workers.begin());
+            ii != workers.end(); ++ii)
+    {
+        pthread_join(*ii, 0);
+    }
+}
+
+
+void HDF5R::rebuild_index(unsigned int threads)
+{
+    // The time stamps are read by this thread alone, as the HDF5 library
+    // can only be used by one thread at a time
+    RebuildWork work;
+    work.runs.resize(channels_.size());
+    size_t run(0), total(0);
+    for (std::map<ChannelID, Channel>::iterator ii(channels_.begin());
+            ii != channels_.end(); ++ii, ++run)
+    {
+        Channel& chan(channel(ii->first));
+        std::vector<uint64_t>& timestamps(work.runs[run].timestamps);
+        work.runs[run].chan_id = ii->first;
+        // Ring channels' records move as they are overwritten, so they are
+        // not indexed
+        if (chan.capacity() > 0)
+        {
+            continue;
+        }
+        timestamps.resize(chan.size());
+        total += chan.size();
+        for (hsize_t start(0); start < chan.size();
+                start += REBUILD_BLOCK_SIZE)
+        {
+            read_timestamps(chan, chan.ts_space(), start,
+                    std::min<hsize_t>(REBUILD_BLOCK_SIZE,
+                        chan.size() - start), &timestamps[start]);
+        }
+    }
+
+    if (threads == 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    threads = std::max<size_t>(1, std::min<size_t>(threads,
+                total / REBUILD_BLOCK_SIZE));
+    pthread_mutex_init(&work.lock, 0);
+    run_rebuild_workers(sort_runs_worker, &work, threads);
+
+    // Split the merge into slices of about the same number of records, at
+    // time stamps sampled evenly from every channel. Records sharing a time
+    // stamp all fall in the same slice.
+    std::vector<uint64_t> samples;
+    for (run = 0; run < work.runs.size(); ++run)
+    {
+        std::vector<uint64_t> const& timestamps(work.runs[run].timestamps);
+        for (size_t ii(0); ii < REBUILD_SAMPLES && !timestamps.empty(); ++ii)
+        {
+            samples.push_back(timestamps[ii * timestamps.size() /
+                    REBUILD_SAMPLES]);
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+    work.slices.resize(threads);
+    for (size_t slice(0); slice < work.slices.size(); ++slice)
+    {
+        std::vector<size_t>& begin(work.slices[slice].begin);
+        begin.resize(work.runs.size(), 0);
+        if (slice == 0)
+        {
+            continue;
+        }
+        uint64_t split(samples[slice * samples.size() / threads]);
+        for (run = 0; run < work.runs.size(); ++run)
+        {
+            std::vector<uint64_t> const& timestamps(
+                    work.runs[run].timestamps);
+            begin[run] = std::lower_bound(timestamps.begin(),
+                    timestamps.end(), split) - timestamps.begin();
+        }
+    }
+    run_rebuild_workers(merge_slices_worker, &work, threads);
+    pthread_mutex_destroy(&work.lock);
+
+    Index index;
+    index.reserve(total);
+    for (size_t slice(0); slice < work.slices.size(); ++slice)
+    {
+        RebuildSlice const& source(work.slices[slice]);
+        for (size_t ii(0); ii < source.timestamps.size(); ++ii)
+        {
+            index.append(source.timestamps[ii], source.channels[ii],
+                    source.records[ii]);
+        }
+    }
+
+    index_.swap(index);
+    index_loaded_ = true;
+    pending_index_.clear();
+    index_in_file_ = false;
+    for (std::map<ChannelID, Channel>::iterator ii(channels_.begin());
+            ii != channels_.end(); ++ii)
+    {
+        ii->second.indexed(ii->second.size());
+    }
+}
+
+
+std::string HDF5R::get_text_tag(std::string const& tag)
+{
+    TagInfo const& info(tag_info(tag));
+    std::vector<char> temp(info.size + 1, 0);
+    read_tag(tag, info, &temp[0]);
+    return std::string(&temp[0]);
+}
+
+
+size_t HDF5R::get_binary_tag(std::string const& tag, void* const buf)
+{
+    TagInfo const& info(tag_info(tag));
+    // If buf is zero, just get the size
+    if (buf != 0)
+    {
+        read_tag(tag, info, buf);
+    }
+    return info.size;
+}
+
+
+std::map<std::string, TagType> HDF5R::get_tags() const
+{
+    std::map<std::string, TagType> result;
+    for (std::map<std::string, TagInfo>::const_iterator ii(tags_.begin());
+            ii != tags_.end(); ++ii)
+    {
+        result[ii->first] = ii->second.type;
+    }
+    return result;
+}
+
+
+TagMap HDF5R::get_all_tags()
+{
+    TagMap result;
+    std::vector<char> temp;
+    for (std::map<std::string, TagInfo>::const_iterator ii(tags_.begin());
+            ii != tags_.end(); ++ii)
+    {
+        TagInfo const& info(ii->second);
+        temp.assign(info.size + 1, 0);
+        read_tag(ii->first, info, &temp[0]);
+        Tag& tag(result[ii->first]);
+        tag.type = info.type;
+        if (info.type == STRING_TAG)
+        {
+            tag.value = &temp[0];
+        }
+        else
+        {
+            tag.value.assign(&temp[0], info.size);
+        }
+    }
+    return result;
+}
+
+
+// Tags up to this size are stored as attributes of the tags group, where
+// they are all read with the group's header. Larger ones are data sets.
+static size_t const TAG_ATTRIBUTE_BYTES = 16 * 1024;
+
+
+void HDF5R::set_text_tag(std::string const& tag, std::string const& value)
+{
+    check_not_swmr("add tags");
+    prepare_tags_group();
+    remove_tag(tag);
+    TagInfo info = {STRING_TAG, value.size() + 1,
+        value.size() + 1 <= TAG_ATTRIBUTE_BYTES};
+    if (info.attribute)
+    {
+        write_string_attr(tags_grp_.get(), tag, value);
+    }
+    else
+    {
+        write_string(tags_grp_.get(), tag, value);
+    }
+    tags_[tag] = info;
+}
+
+
+void HDF5R::set_binary_tag(std::string const& tag, void const* const buf,
+        size_t size)
+{
+    check_not_swmr("add tags");
+    prepare_tags_group();
+    remove_tag(tag);
+    TagInfo info = {BINARY_TAG, size, size <= TAG_ATTRIBUTE_BYTES};
+    // Create a binary type of the necessary length
+    hid_t type = H5Tcreate(H5T_OPAQUE, size);
+    hid_t dspace = H5Screate(H5S_SCALAR);
+    herr_t status(-1);
+    if (info.attribute)
+    {
+        hid_t attr = H5Acreate(tags_grp_.get(), tag.c_str(), type, dspace,
+                H5P_DEFAULT, H5P_DEFAULT);
+        if (attr >= 0)
+        {
+            status = H5Awrite(attr, type, buf);
+            H5Aclose(attr);
+        }
+    }
+    else
+    {
+        hid_t dset = H5Dcreate(tags_grp_.get(), tag.c_str(), type, dspace,
+                H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if (dset >= 0)
+        {
+            status = H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
+            H5Dclose(dset);
+        }
+    }
+    H5Sclose(dspace);
+    H5Tclose(type);
+    if (status < 0)
+    {
+        throw std::runtime_error("Error writing binary tag " + tag);
+    }
+    tags_[tag] = info;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Private functions
+///////////////////////////////////////////////////////////////////////////////
+
+
+char const* const HDF5R::CHANNELS_GROUP = "/channels";
+char const* const HDF5R::TAGS_GROUP = "/tags";
+char const* const HDF5R::INDEX_SET = "/index";
+char const* const HDF5R::RECORDS_SET = "records";
+char const* const HDF5R::TIMESTAMPS_SET = "timestamps";
+char const* const HDF5R::TIMELINE_SET = "timeline";
+char const* const HDF5R::COLUMNS_GROUP = "columns";
+
+
+hid_t HDF5R::make_fapl(bool page_buffer) const
+{
+    FileProfile profile(profile_);
+    if (mode_ == SWMR_WRITE || mode_ == SWMR_READ)
+    {
+        // SWMR requires the latest file format, and cannot be used with a
+        // page buffer. Readers see writes in the order the default driver
+        // makes them, which buffering drivers don't keep.
+        profile.libver_bounds(H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+        profile.page_buffer_size(0);
+        profile.driver(SEC2);
+    }
+    if (!page_buffer)
+    {
+        profile.page_buffer_size(0);
+    }
+    return profile.make_fapl();
+}
+
+
+hid_t HDF5R::open_file(unsigned int flags) const
+{
+    hid_t fapl = make_fapl(true);
+    hid_t file = H5Fopen(fn_.c_str(), flags, fapl);
+    H5Pclose(fapl);
+    if (file < 0 && profile_.page_buffer_size() > 0)
+    {
+        // Only files created with paged file space can have a page buffer
+        fapl = make_fapl(false);
+        file = H5Fopen(fn_.c_str(), flags, fapl);
+        H5Pclose(fapl);
+    }
+    return file;
+}
+
+
+hid_t HDF5R::create_file(unsigned int flags) const
+{
+    hid_t fcpl = profile_.make_fcpl();
+    hid_t fapl(-1);
+    try
+    {
+        fapl = make_fapl(true);
+    }
+    catch (...)
+    {
+        H5Pclose(fcpl);
+        throw;
+    }
+    hid_t file = H5Fcreate(fn_.c_str(), flags, fcpl, fapl);
+    H5Pclose(fcpl);
+    H5Pclose(fapl);
+    return file;
+}
+
+
+// Size of a channel that has not been opened and has no committed size. It
+// is learnt when the channel is opened.
+static size_t const UNKNOWN_SIZE = static_cast<size_t>(-1);
+
+
+void HDF5R::prepare()
+{
+    // If the file does not yet have a channels group, make it
+    channels_grp_.reset(H5Gopen(file_.get(), CHANNELS_GROUP, H5P_DEFAULT));
+    if (!channels_grp_.valid())
+    {
+        channels_grp_.reset(H5Gcreate(file_.get(), CHANNELS_GROUP,
+                    H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+    }
+    // Otherwise, read the existing channels from the file
+    else
+    {
+        std::vector<std::string> chan_names;
+        H5Literate(channels_grp_.get(), H5_INDEX_NAME, H5_ITER_NATIVE, 0,
+                get_child_names, &chan_names);
+        for(std::vector<std::string>::const_iterator ii(chan_names.begin());
+                ii != chan_names.end(); ++ii)
+        {
+            // Only the channel's ID and committed size are read now; the
+            // channel is opened when it is first used
+            hid_t group = H5Gopen(channels_grp_.get(), ii->c_str(),
+                    H5P_DEFAULT);
+            if (group < 0)
+            {
+                throw std::runtime_error("Failed to open channel " + *ii);
+            }
+            size_t size(UNKNOWN_SIZE);
+            ChannelID uid(0);
+            size_t capacity(0);
+            hsize_t head(0);
+            bool frozen(false);
+            try
+            {
+                if (H5Aexists(group, "uid") > 0)
+                {
+                    uid = read_uint_attr(group, "uid");
+                }
+                else
+                {
+                    uid = read_uint(group, "uid");
+                }
+                if (H5Aexists(group, "committed") > 0)
+                {
+                    size = read_uint_attr(group, "committed");
+                }
+                if (H5Aexists(group, "capacity") > 0)
+                {
+                    capacity = read_uint_attr(group, "capacity");
+                    head = read_uint_attr(group, "head");
+                    frozen = read_uint_attr(group, "frozen") != 0;
+                }
+            }
+            catch (...)
+            {
+                H5Gclose(group);
+                throw;
+            }
+            H5Gclose(group);
+            Channel chan(*ii, -1, -1, -1, -1, -1, -1, size);
+            chan.capacity(capacity);
+            chan.head(head);
+            chan.committed_head(head);
+            chan.frozen(frozen);
+            channels_[uid] = chan;
+            channel_names_[*ii] = uid;
+            if (uid + 1 > next_id_)
+            {
+                next_id_ = uid + 1;
+            }
+        }
+    }
+
+    prepare_tags_group();
+    read_tag_info();
+    // A read-only file's index is read when it is first used, so that
+    // opening one just to copy or read its channels doesn't load it
+    if (mode_ != RDONLY && mode_ != SWMR_READ)
+    {
+        read_index();
+    }
+}
+
+
+void HDF5R::prepare_tags_group()
+{
+    // If the tags group is open, nothing to do
+    if (tags_grp_.valid())
+    {
+        return;
     }
     // If the file does not yet have a tags group, make it
-    tags_grp_ = H5Gopen(file_, TAGS_GROUP, H5P_DEFAULT);
-    if (tags_grp_ < 0)
+    tags_grp_.reset(H5Gopen(file_.get(), TAGS_GROUP, H5P_DEFAULT));
+    if (!tags_grp_.valid())
+    {
+        tags_grp_.reset(H5Gcreate(file_.get(), TAGS_GROUP, H5P_DEFAULT,
+                    H5P_DEFAULT, H5P_DEFAULT));
+    }
+}
+
+
+static herr_t get_attr_names(hid_t obj, char const* const name,
+        H5A_info_t const* const info, void* op_data)
+{
+    static_cast<std::vector<std::string>*>(op_data)->push_back(name);
+    return 0;
+}
+
+
+void HDF5R::read_tag_info()
+{
+    tags_.clear();
+    if (!tags_grp_.valid())
+    {
+        return;
+    }
+    std::vector<std::string> names;
+    H5Aiterate(tags_grp_.get(), H5_INDEX_NAME, H5_ITER_NATIVE, 0,
+            get_attr_names, &names);
+    for (std::vector<std::string>::const_iterator ii(names.begin());
+            ii != names.end(); ++ii)
+    {
+        hid_t attr = H5Aopen(tags_grp_.get(), ii->c_str(), H5P_DEFAULT);
+        if (attr < 0)
+        {
+            throw std::runtime_error("Error opening tag " + *ii);
+        }
+        hid_t type = H5Aget_type(attr);
+        TagInfo info = {H5Tget_class(type) == H5T_STRING ? STRING_TAG :
+            BINARY_TAG, H5Tget_size(type), true};
+        tags_[*ii] = info;
+        H5Tclose(type);
+        H5Aclose(attr);
+    }
+    // Large tags, and all tags of files written before tags were attributes
+    names.clear();
+    H5Literate(tags_grp_.get(), H5_INDEX_NAME, H5_ITER_NATIVE, 0,
+            get_child_names, &names);
+    for (std::vector<std::string>::const_iterator ii(names.begin());
+            ii != names.end(); ++ii)
+    {
+        hid_t dset = H5Dopen(tags_grp_.get(), ii->c_str(), H5P_DEFAULT);
+        if (dset < 0)
+        {
+            throw std::runtime_error("Error opening tag " + *ii);
+        }
+        hid_t type = H5Dget_type(dset);
+        TagInfo info = {H5Tget_class(type) == H5T_STRING ? STRING_TAG :
+            BINARY_TAG, H5Tget_size(type), false};
+        tags_[*ii] = info;
+        H5Tclose(type);
+        H5Dclose(dset);
+    }
+}
+
+
+HDF5R::TagInfo const& HDF5R::tag_info(std::string const& tag) const
+{
+    std::map<std::string, TagInfo>::const_iterator ii(tags_.find(tag));
+    if (ii == tags_.end())
+    {
+        throw std::runtime_error("No such tag: " + tag);
+    }
+    return ii->second;
+}
+
+
+void HDF5R::read_tag(std::string const& tag, TagInfo const& info,
+        void* const buf) const
+{
+    herr_t status(-1);
+    if (info.attribute)
+    {
+        hid_t attr = H5Aopen(tags_grp_.get(), tag.c_str(), H5P_DEFAULT);
+        if (attr >= 0)
+        {
+            hid_t type = H5Aget_type(attr);
+            status = H5Aread(attr, type, buf);
+            H5Tclose(type);
+            H5Aclose(attr);
+        }
+    }
+    else
+    {
+        hid_t dset = H5Dopen(tags_grp_.get(), tag.c_str(), H5P_DEFAULT);
+        if (dset >= 0)
+        {
+            hid_t type = H5Dget_type(dset);
+            status = H5Dread(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buf);
+            H5Tclose(type);
+            H5Dclose(dset);
+        }
+    }
+    if (status < 0)
+    {
+        throw std::runtime_error("Error reading data for tag " + tag);
+    }
+}
+
+
+void HDF5R::remove_tag(std::string const& tag)
+{
+    std::map<std::string, TagInfo>::iterator ii(tags_.find(tag));
+    if (ii == tags_.end())
+    {
+        return;
+    }
+    herr_t status(ii->second.attribute ?
+            H5Adelete(tags_grp_.get(), tag.c_str()) :
+            H5Ldelete(tags_grp_.get(), tag.c_str(), H5P_DEFAULT));
+    if (status < 0)
+    {
+        throw std::runtime_error("Error replacing tag " + tag);
+    }
+    tags_.erase(ii);
+}
+
+
+void HDF5R::close_objects()
+{
+    std::for_each(channels_.begin(), channels_.end(), close_group_fun());
+    channels_.clear();
+    channel_names_.clear();
+    open_channels_ = 0;
+    tags_.clear();
+    clear_record_cache();
+    pair_space_.reset();
+    elem_space_.reset();
+    tags_grp_.reset();
+    channels_grp_.reset();
+    file_.reset();
+}
+
+
+void HDF5R::check_not_swmr(char const* const what) const
+{
+    if (swmr_)
+    {
+        throw std::runtime_error(std::string("Cannot ") + what +
+                " in SWMR mode");
+    }
+}
+
+
+Channel& HDF5R::channel(ChannelID chan_id)
+{
+    std::map<ChannelID, Channel>::iterator ii(channels_.find(chan_id));
+    if (ii == channels_.end())
+    {
+        throw std::runtime_error("Bad channel ID");
+    }
+    Channel& chan(ii->second);
+    chan.last_used(++use_clock_);
+    if (!chan.is_open())
+    {
+        open_channel(chan);
+        // Records a followed file gained while the channel was closed
+        index_followed(chan_id, chan);
+        close_idle_channels();
+    }
+    return chan;
+}
+
+
+void HDF5R::open_channel(Channel& chan)
+{
+    hid_t group = H5Gopen(channels_grp_.get(), chan.name().c_str(),
+            H5P_DEFAULT);
+    if (group < 0)
+    {
+        throw std::runtime_error("Failed to open channel " + chan.name());
+    }
+    bool columnar(H5Lexists(group, COLUMNS_GROUP, H5P_DEFAULT) > 0);
+    uint64_t period(H5Aexists(group, "period") > 0 ?
+            read_uint_attr(group, "period") : 0);
+    hid_t dapl = profile_.make_dapl(chan.name());
+    hid_t rec_set = columnar ? -1 : H5Dopen(group, RECORDS_SET, dapl);
+    hid_t ts_set = period > 0 ? -1 : H5Dopen(group, TIMESTAMPS_SET, dapl);
+    hid_t timeline = period > 0 ? H5Dopen(group, TIMELINE_SET, dapl) : -1;
+    H5Pclose(dapl);
+    // Older files hold the type as a named type rather than an attribute
+    bool compact(H5Aexists(group, "mem_type") > 0);
+    hid_t committed_type(-1);
+    if (compact)
+    {
+        committed_type = read_type_attr(group, "mem_type");
+    }
+    else
+    {
+        committed_type = H5Topen(group, "mem_type", H5P_DEFAULT);
+    }
+    std::vector<Channel::Column> columns;
+    if ((columnar && (committed_type < 0 ||
+                    !open_columns(group, chan.name(), committed_type,
+                        columns))) ||
+            (!columnar && rec_set < 0) || (period == 0 && ts_set < 0) ||
+            (period > 0 && timeline < 0) || committed_type < 0)
+    {
+        if (committed_type >= 0)
+        {
+            H5Tclose(committed_type);
+        }
+        if (ts_set >= 0)
+        {
+            H5Dclose(ts_set);
+        }
+        if (timeline >= 0)
+        {
+            H5Dclose(timeline);
+        }
+        if (rec_set >= 0)
+        {
+            H5Dclose(rec_set);
+        }
+        H5Gclose(group);
+        throw std::runtime_error("Failed to open channel " + chan.name());
+    }
+    if (mode_ == SWMR_READ)
+    {
+        // The library keeps the metadata of closed data sets, so a reopened
+        // channel's extents may be stale
+        hid_t const sets[] = {rec_set, ts_set, timeline};
+        for (size_t ii(0); ii < sizeof(sets) / sizeof(sets[0]); ++ii)
+        {
+            if (sets[ii] >= 0)
+            {
+                H5Drefresh(sets[ii]);
+            }
+        }
+    }
+    hid_t rec_space = columnar ? -1 : H5Dget_space(rec_set);
+    hid_t ts_space = period > 0 ? -1 : H5Dget_space(ts_set);
+    // Detach the type from the file so that sharing it does not keep the
+    // file open
+    hid_t mem_type = H5Tcopy(committed_type);
+    H5Tclose(committed_type);
+    chan.open(group, rec_space, rec_set, ts_space, ts_set, mem_type);
+    chan.columns(columns);
+    chan.period(period);
+    chan.timeline(timeline);
+    ++open_channels_;
+
+    hsize_t num_recs;
+    H5Sget_simple_extent_dims(period > 0 ? rec_space : ts_space, &num_recs,
+            0);
+    if (chan.size() == UNKNOWN_SIZE)
+    {
+        // Ignore anything written after the last checkpoint of a file that
+        // was not closed cleanly
+        if (H5Aexists(group, "committed") > 0)
+        {
+            num_recs = std::min<hsize_t>(num_recs,
+                    read_uint_attr(group, "committed"));
+        }
+        chan.size(num_recs);
+        chan.committed(num_recs);
+    }
+    else if (mode_ == SWMR_READ && num_recs > chan.size())
+    {
+        // A SWMR file has no committed sizes; its flushed extents are
+        // always consistent
+        chan.size(num_recs);
+        chan.committed(num_recs);
+    }
+    if (period > 0)
+    {
+        load_timeline(chan);
+    }
+    if (chan.capacity() > 0 && mode_ != SWMR_READ)
+    {
+        drop_overwritten(chan);
+    }
+    if (chan.type_name().empty())
+    {
+        if (compact)
+        {
+            chan.type_name(read_string_attr(group, "type_name"));
+            chan.source_name(read_string_attr(group, "source_name"));
+        }
+        else
+        {
+            chan.type_name(read_string(group, "type_name"));
+            chan.source_name(read_string(group, "source_name"));
+        }
+    }
+}
+
+
+void HDF5R::drop_overwritten(Channel& chan)
+{
+    if (chan.size() < 2)
+    {
+        return;
+    }
+    // Records added to a ring channel after the last checkpoint of a file
+    // that was not closed cleanly may have overwritten the oldest of those
+    // checkpointed. Being newer than the newest of those, they are found at
+    // the start of the channel.
+    uint64_t newest(0);
+    read_timestamps(chan, chan.ts_space(), chan.size() - 1, 1, &newest);
+    hsize_t lo(0), hi(chan.size() - 1);
+    while (lo < hi)
+    {
+        hsize_t mid(lo + (hi - lo) / 2);
+        uint64_t stamp(0);
+        read_timestamps(chan, chan.ts_space(), mid, 1, &stamp);
+        if (stamp > newest)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo > 0)
+    {
+        chan.head(chan.position(lo));
+        chan.size(chan.size() - lo);
+    }
+}
+
+
+void HDF5R::close_idle_channels()
+{
+    size_t limit(profile_.max_open_channels());
+    bool read_only(mode_ == RDONLY || mode_ == SWMR_READ);
+    while (limit > 0 && open_channels_ > limit)
+    {
+        // Close the least recently used channel that has nothing unsaved,
+        // but never the one just used, which the caller is about to use
+        Channel* idle(0);
+        for (std::map<ChannelID, Channel>::iterator ii(channels_.begin());
+                ii != channels_.end(); ++ii)
+        {
+            Channel& chan(ii->second);
+            if (chan.is_open() && chan.last_used() != use_clock_ &&
+                    (read_only || !chan.unsaved()) &&
+                    (idle == 0 || chan.last_used() < idle->last_used()))
+            {
+                idle = &chan;
+            }
+        }
+        if (idle == 0)
+        {
+            return;
+        }
+        idle->close();
+        --open_channels_;
+    }
+}
+
+
+ChannelInfo HDF5R::read_channel_info(Channel const& chan) const
+{
+    // Get the first and last time stamps
+    uint64_t timestamps[2] = {0, 0};
+    if (chan.size() > 0 && chan.period() > 0)
+    {
+        chan.timeline_stamps(0, 1, &timestamps[0]);
+        chan.timeline_stamps(chan.size() - 1, 1, &timestamps[1]);
+    }
+    else if (chan.size() > 0)
+    {
+        hsize_t coords[2];
+        coords[0] = chan.position(0);
+        coords[1] = chan.position(chan.size() - 1);
+        if (H5Sselect_elements(chan.ts_space(), H5S_SELECT_SET, 2, coords) < 0)
+        {
+            throw std::runtime_error("Failed to select start and end time stamps");
+        }
+        if (H5Dread(chan.ts_set(), H5T_NATIVE_UINT64, pair_space_.get(),
+                    chan.ts_space(), H5P_DEFAULT, timestamps) < 0)
+        {
+            throw std::runtime_error("Failed to read start and end time stamps");
+        }
+    }
+
+    return ChannelInfo(chan.name(), chan.type_name(), chan.source_name(),
+            chan.mem_type(), chan.size(), timestamps[0], timestamps[1]);
+}
+
+
+std::string HDF5R::read_string(hid_t group, std::string const& set) const
+{
+    // Open the dataset
+    hid_t dset = H5Dopen(group, set.c_str(), H5P_DEFAULT);
+    if (dset < 0)
+    {
+        throw std::runtime_error("Failed to open string " + set);
+    }
+    // Get the string's data type
+    hid_t str_type = H5Dget_type(dset);
+    if (str_type < 0)
+    {
+        throw std::runtime_error("Failed to get string data type for" + set);
+    }
+    // Make some temporary space to store the string data
+    size_t len = H5Tget_size(str_type);
+    if (len < 0)
+    {
+        throw std::runtime_error("Error reading string length for " + set);
+    }
+    char* temp = new char[len];
+    // Read the string from the dataset
+    if (H5Dread(dset, str_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, temp) < 0)
+    {
+        throw std::runtime_error("Error reading string " + set);
+    }
+    std::string result(temp);
+    // Clean up
+    delete[] temp;
+    H5Tclose(str_type);
+    H5Dclose(dset);
+
+    return result;
+}
+
+
+hid_t HDF5R::read_type(hid_t group, std::string const& set) const
+{
+    hid_t result = H5Topen(group, set.c_str(), H5P_DEFAULT);
+    if (result < 0)
+    {
+        throw std::runtime_error("Error reading data type " + set);
+    }
+    return result;
+}
+
+
+uint64_t HDF5R::read_uint(hid_t group, std::string const& set) const
+{
+    hid_t dset = H5Dopen(group, set.c_str(), H5P_DEFAULT);
+    if (dset < 0)
+    {
+        throw std::runtime_error("Failed to open uint " + set);
+    }
+    uint64_t result(0);
+    herr_t status = H5Dread(dset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL,
+            H5P_DEFAULT, &result);
+    H5Dclose(dset);
+    if (status < 0)
+    {
+        throw std::runtime_error("Failed to read uint " + set);
+    }
+    return result;
+}
+
+
+void HDF5R::write_string(hid_t group, std::string const& set,
+        std::string const& str)
+{
+    // Create a string type of the necessary length
+    hid_t str_type = H5Tcopy(H5T_C_S1);
+    if (H5Tset_size(str_type, str.size() + 1) < 0)
+    {
+        throw std::runtime_error("Error setting string size for string " + set);
+    }
+    // Create the dataspace and dataset for the string
+    hid_t dspace = H5Screate(H5S_SCALAR);
+    hid_t dset = H5Dcreate(group, set.c_str(), str_type, dspace, H5P_DEFAULT,
+            H5P_DEFAULT, H5P_DEFAULT);
+    // Write the string to the dataset
+    if (H5Dwrite(dset, str_type, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                str.c_str()) < 0)
+    {
+        throw std::runtime_error("Error writing string " + set);
+    }
+    // Clean up
+    H5Dclose(dset);
+    H5Sclose(dspace);
+    H5Tclose(str_type);
+}
+
+
+uint64_t HDF5R::read_uint_attr(hid_t obj, std::string const& attr) const
+{
+    hid_t attr_id = H5Aopen(obj, attr.c_str(), H5P_DEFAULT);
+    if (attr_id < 0)
+    {
+        throw std::runtime_error("Failed to open attribute " + attr);
+    }
+    uint64_t result(0);
+    herr_t status = H5Aread(attr_id, H5T_NATIVE_UINT64, &result);
+    H5Aclose(attr_id);
+    if (status < 0)
+    {
+        throw std::runtime_error("Failed to read attribute " + attr);
+    }
+    return result;
+}
+
+
+void HDF5R::write_uint_attr(hid_t obj, std::string const& attr, uint64_t value)
+{
+    hid_t attr_id(-1);
+    if (H5Aexists(obj, attr.c_str()) > 0)
+    {
+        attr_id = H5Aopen(obj, attr.c_str(), H5P_DEFAULT);
+    }
+    else
+    {
+        hid_t dspace = H5Screate(H5S_SCALAR);
+        attr_id = H5Acreate(obj, attr.c_str(), H5T_STD_U64LE, dspace,
+                H5P_DEFAULT, H5P_DEFAULT);
+        H5Sclose(dspace);
+    }
+    if (attr_id < 0)
+    {
+        throw std::runtime_error("Failed to open attribute " + attr);
+    }
+    herr_t status = H5Awrite(attr_id, H5T_NATIVE_UINT64, &value);
+    H5Aclose(attr_id);
+    if (status < 0)
+    {
+        throw std::runtime_error("Error writing attribute " + attr);
+    }
+}
+
+
+std::string HDF5R::read_string_attr(hid_t obj, std::string const& attr) const
+{
+    hid_t attr_id = H5Aopen(obj, attr.c_str(), H5P_DEFAULT);
+    if (attr_id < 0)
+    {
+        throw std::runtime_error("Failed to open attribute " + attr);
+    }
+    hid_t str_type = H5Aget_type(attr_id);
+    std::vector<char> temp(H5Tget_size(str_type) + 1, 0);
+    herr_t status = H5Aread(attr_id, str_type, &temp[0]);
+    H5Tclose(str_type);
+    H5Aclose(attr_id);
+    if (status < 0)
+    {
+        throw std::runtime_error("Failed to read attribute " + attr);
+    }
+    return std::string(&temp[0]);
+}
+
+
+void HDF5R::write_string_attr(hid_t obj, std::string const& attr,
+        std::string const& str)
+{
+    // A string type of the necessary length
+    hid_t str_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(str_type, str.size() + 1);
+    hid_t dspace = H5Screate(H5S_SCALAR);
+    hid_t attr_id = H5Acreate(obj, attr.c_str(), str_type, dspace,
+            H5P_DEFAULT, H5P_DEFAULT);
+    H5Sclose(dspace);
+    if (attr_id < 0)
+    {
+        H5Tclose(str_type);
+        throw std::runtime_error("Failed to create attribute " + attr);
+    }
+    herr_t status = H5Awrite(attr_id, str_type, str.c_str());
+    H5Aclose(attr_id);
+    H5Tclose(str_type);
+    if (status < 0)
+    {
+        throw std::runtime_error("Error writing attribute " + attr);
+    }
+}
+
+
+hid_t HDF5R::read_type_attr(hid_t obj, std::string const& attr) const
+{
+    hid_t attr_id = H5Aopen(obj, attr.c_str(), H5P_DEFAULT);
+    if (attr_id < 0)
+    {
+        throw std::runtime_error("Failed to open attribute " + attr);
+    }
+    hid_t result = H5Aget_type(attr_id);
+    H5Aclose(attr_id);
+    if (result < 0)
+    {
+        throw std::runtime_error("Error reading data type " + attr);
+    }
+    return result;
+}
+
+
+void HDF5R::write_type_attr(hid_t obj, std::string const& attr, hid_t type)
+{
+    // Only the attribute's type is of interest, so it holds no data
+    hid_t dspace = H5Screate(H5S_NULL);
+    hid_t attr_id = H5Acreate(obj, attr.c_str(), type, dspace, H5P_DEFAULT,
+            H5P_DEFAULT);
+    H5Sclose(dspace);
+    if (attr_id < 0)
+    {
+        throw std::runtime_error("Error writing data type " + attr);
+    }
+    H5Aclose(attr_id);
+}
+
+
+typedef struct
+{
+    ChannelID channel;
+    uint64_t record;
+} RawIndexPointer;
+typedef struct
+{
+    uint64_t timestamp;
+    hvl_t records;
+} RawIndexEntry;
+
+
+// Number of index entries read or written at a time
+static size_t const INDEX_BLOCK_SIZE = 4096;
+
+
+hid_t HDF5R::make_index_ftype() const
+{
+    // Individual record pointer type
+    hid_t index_ptr = H5Tcreate(H5T_COMPOUND, 8 + 8);
+    herr_t s = H5Tinsert(index_ptr, "channel", 0, H5T_STD_U64LE);
+    s = H5Tinsert(index_ptr, "record", 8, H5T_STD_U64LE);
+
+    // Variable-length array of record pointers
+    hid_t rec_ptr_array = H5Tvlen_create(index_ptr);
+
+    // Single index entry type
+    hid_t index_entry = H5Tcreate(H5T_COMPOUND, 8 + sizeof(hvl_t));
+    s = H5Tinsert(index_entry, "timestamp", 0, H5T_STD_U64LE);
+    s = H5Tinsert(index_entry, "records", 8, rec_ptr_array);
+    H5Tclose(rec_ptr_array);
+    H5Tclose(index_ptr);
+    return index_entry;
+}
+
+
+hid_t HDF5R::make_index_mtype() const
+{
+    // Individual record pointer type
+    hid_t index_ptr = H5Tcreate(H5T_COMPOUND, sizeof(RawIndexPointer));
+    herr_t s = H5Tinsert(index_ptr, "channel", HOFFSET(RawIndexPointer, channel),
+            H5T_NATIVE_UINT64);
+    s = H5Tinsert(index_ptr, "record", HOFFSET(RawIndexPointer, record),
+            H5T_NATIVE_UINT64);
+
+    // Variable-length array of record pointers
+    hid_t rec_ptr_array = H5Tvlen_create(index_ptr);
+
+    // Single index entry type
+    hid_t index_entry = H5Tcreate(H5T_COMPOUND, sizeof(RawIndexEntry));
+    s = H5Tinsert(index_entry, "timestamp", HOFFSET(RawIndexEntry, timestamp),
+            H5T_NATIVE_UINT64);
+    s = H5Tinsert(index_entry, "records", HOFFSET(RawIndexEntry, records),
+            rec_ptr_array);
+    // The entry type holds its own copies of the member types
+    H5Tclose(rec_ptr_array);
+    H5Tclose(index_ptr);
+    return index_entry;
+}
+
+
+IndexView HDF5R::index()
+{
+    if (!index_loaded_)
+    {
+        read_index();
+    }
+    return index_.view();
+}
+
+
+void HDF5R::read_index()
+{
+    index_loaded_ = true;
+    // A file being written in SWMR mode has no index until it is closed
+    if (mode_ == SWMR_READ)
+    {
+        for (std::map<ChannelID, Channel>::iterator ii(channels_.begin());
+                ii != channels_.end(); ++ii)
+        {
+            index_followed(ii->first, channel(ii->first));
+        }
+        return;
+    }
+    // Attempt to open the index, if it exists
+    if (H5Lexists(file_.get(), INDEX_SET, H5P_DEFAULT) <= 0)
+    {
+        // No index, nothing to do
+        return;
+    }
+    hid_t index_set = H5Dopen(file_.get(), INDEX_SET, H5P_DEFAULT);
+    if (index_set < 0)
+    {
+        throw std::runtime_error("Failed to open index");
+    }
+
+    hid_t mtype = make_index_mtype();
+    hid_t index_space = H5Dget_space(index_set);
+    hsize_t num_entries(0), max_entries(0);
+    H5Sget_simple_extent_dims(index_space, &num_entries, &max_entries);
+    // Only an extensible index can be added to at the next checkpoint
+    index_in_file_ = max_entries == H5S_UNLIMITED;
+
+    std::vector<RawIndexEntry> entries(std::min<hsize_t>(num_entries,
+                INDEX_BLOCK_SIZE));
+    for (hsize_t start(0); start < num_entries; start += entries.size())
+    {
+        // Read the next block of entries
+        hsize_t count(std::min<hsize_t>(entries.size(), num_entries - start));
+        hid_t read_space = H5Screate_simple(1, &count, 0);
+        H5Sselect_hyperslab(index_space, H5S_SELECT_SET, &start, 0, &count, 0);
+        if (H5Dread(index_set, mtype, read_space, index_space, H5P_DEFAULT,
+                    &entries[0]) < 0)
+        {
+            H5Sclose(read_space);
+            throw std::runtime_error("Failed to read index entries");
+        }
+        // Copy the data out, skipping records that were not committed before
+        // the file was last closed. Entries for a time stamp may be spread
+        // over several checkpoints.
+        for (hsize_t ii(0); ii < count; ++ii)
+        {
+            RawIndexPointer* ptrs =
+                reinterpret_cast<RawIndexPointer*>(entries[ii].records.p);
+            for (size_t jj(0); jj < entries[ii].records.len; ++jj)
+            {
+                std::map<ChannelID, Channel>::const_iterator chan(
+                        channels_.find(ptrs[jj].channel));
+                if (chan == channels_.end() ||
+                        ptrs[jj].record >= chan->second.size())
+                {
+                    // The file no longer matches this index
+                    index_in_file_ = false;
+                    continue;
+                }
+                index_.append(entries[ii].timestamp, ptrs[jj].channel,
+                        ptrs[jj].record);
+            }
+        }
+        // Clean up the allocated memory
+        H5Dvlen_reclaim(mtype, read_space, H5P_DEFAULT, &entries[0]);
+        H5Sclose(read_space);
+    }
+    H5Sclose(index_space);
+    H5Tclose(mtype);
+    H5Dclose(index_set);
+}
+
+
+// Append a block of index entries to the end of the index data set. The
+// entries' record counts must be set; their pointers are taken in order from
+// ptrs.
+static void append_index_block(hid_t dset, hid_t mtype,
+        std::vector<RawIndexEntry>& entries,
+        std::vector<RawIndexPointer>& ptrs)
+{
+    if (entries.empty())
+    {
+        return;
+    }
+    RawIndexPointer* next(&ptrs[0]);
+    for (std::vector<RawIndexEntry>::iterator ii(entries.begin());
+            ii != entries.end(); ++ii)
+    {
+        ii->records.p = next;
+        next += ii->records.len;
+    }
+
+    hid_t dspace = H5Dget_space(dset);
+    hsize_t start[1];
+    H5Sget_simple_extent_dims(dspace, start, 0);
+    hsize_t count[1] = {entries.size()};
+    hsize_t extent[1] = {start[0] + count[0]};
+    if (H5Dset_extent(dset, extent) < 0)
+    {
+        H5Sclose(dspace);
+        throw std::runtime_error("Failed to extend index");
+    }
+    H5Sset_extent_simple(dspace, 1, extent, 0);
+    H5Sselect_hyperslab(dspace, H5S_SELECT_SET, start, 0, count, 0);
+    hid_t write_space = H5Screate_simple(1, count, 0);
+    herr_t status = H5Dwrite(dset, mtype, write_space, dspace, H5P_DEFAULT,
+            &entries[0]);
+    H5Sclose(write_space);
+    H5Sclose(dspace);
+    if (status < 0)
+    {
+        throw std::runtime_error("Failed to write index elements");
+    }
+    entries.clear();
+    ptrs.clear();
+}
+
+
+// Add a record to the block of index entries being built, writing the block
+// out first if it is full. Records sharing a time stamp are written as a
+// single entry.
+static void add_index_record(hid_t dset, hid_t mtype,
+        std::vector<RawIndexEntry>& entries,
+        std::vector<RawIndexPointer>& ptrs, uint64_t timestamp,
+        ChannelID channel, uint64_t record)
+{
+    if (entries.empty() || entries.back().timestamp != timestamp)
+    {
+        if (entries.size() == INDEX_BLOCK_SIZE)
+        {
+            append_index_block(dset, mtype, entries, ptrs);
+        }
+        RawIndexEntry entry;
+        entry.timestamp = timestamp;
+        entry.records.len = 0;
+        entries.push_back(entry);
+    }
+    RawIndexPointer ptr = {channel, record};
+    ptrs.push_back(ptr);
+    ++entries.back().records.len;
+}
+
+
+
+// Add the records of a channel of a followed file that are not yet in the
+// index
+void HDF5R::index_followed(ChannelID chan_id, Channel& chan)
+{
+    // Ring channels' records move as they are overwritten, so they are not
+    // indexed
+    if (mode_ != SWMR_READ || !index_loaded_ || chan.capacity() > 0)
+    {
+        return;
+    }
+    std::vector<uint64_t> timestamps;
+    for (hsize_t start(chan.indexed()); start < chan.size();
+            start += timestamps.size())
+    {
+        timestamps.resize(std::min<hsize_t>(INDEX_BLOCK_SIZE,
+                    chan.size() - start));
+        read_timestamps(chan, chan.ts_space(), start, timestamps.size(),
+                &timestamps[0]);
+        index_.append(timestamps.size(), &timestamps[0], chan_id, start);
+    }
+    chan.indexed(chan.size());
+}
+
+void HDF5R::write_index()
+{
+    // Can't write the index in read-only mode
+    if (mode_ == RDONLY || mode_ == SWMR_READ)
+    {
+        return;
+    }
+    if (index_in_file_)
+    {
+        // Only the entries added since the last checkpoint need writing
+        append_index();
+        return;
+    }
+
+    // Replace any index in the file (it may be from an older version that
+    // cannot grow, or have been rebuilt) with the full in-memory index
+    pending_index_.clear();
+    hid_t dset = create_index_set();
+    hid_t mtype = make_index_mtype();
+    // Write out the index a block at a time to avoid duplicating a
+    // potentially large amount of memory
+    IndexView view(index_.view());
+    std::vector<RawIndexEntry> entries;
+    std::vector<RawIndexPointer> ptrs;
+    entries.reserve(std::min<size_t>(view.size(), INDEX_BLOCK_SIZE));
+    ptrs.reserve(std::min<size_t>(view.size(), INDEX_BLOCK_SIZE));
+    for (size_t ii(0); ii < view.size(); ++ii)
+    {
+        add_index_record(dset, mtype, entries, ptrs, view.timestamp(ii),
+                view.channel(ii), view.record(ii));
+    }
+    append_index_block(dset, mtype, entries, ptrs);
+    H5Dclose(dset);
+    H5Tclose(mtype);
+    index_in_file_ = true;
+}
+
+
+hid_t HDF5R::create_index_set()
+{
+    if (H5Lexists(file_.get(), INDEX_SET, H5P_DEFAULT) > 0)
+    {
+        H5Ldelete(file_.get(), INDEX_SET, H5P_DEFAULT);
+    }
+    // Create an extensible index dataset
+    hid_t ftype = make_index_ftype();
+    hsize_t len(0);
+    hsize_t max_len(H5S_UNLIMITED);
+    hsize_t chunk_len(INDEX_BLOCK_SIZE);
+    hid_t parms = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(parms, 1, &chunk_len);
+    hid_t dspace = H5Screate_simple(1, &len, &max_len);
+    hid_t dset = H5Dcreate(file_.get(), INDEX_SET, ftype, dspace, H5P_DEFAULT,
+            parms, H5P_DEFAULT);
+    H5Sclose(dspace);
+    H5Pclose(parms);
+    H5Tclose(ftype);
+    if (dset < 0)
+    {
+        throw std::runtime_error("Failed to create index");
+    }
+    return dset;
+}
+
+
+void HDF5R::append_index()
+{
+    if (pending_index_.empty())
+    {
+        return;
+    }
+
+    hid_t mtype = make_index_mtype();
+    hid_t dset = H5Dopen(file_.get(), INDEX_SET, H5P_DEFAULT);
+    if (dset < 0)
+    {
+        H5Tclose(mtype);
+        throw std::runtime_error("Failed to open index for writing");
+    }
+
+    std::vector<RawIndexEntry> entries;
+    std::vector<RawIndexPointer> ptrs;
+    entries.reserve(std::min<size_t>(pending_index_.size(), INDEX_BLOCK_SIZE));
+    ptrs.reserve(std::min<size_t>(pending_index_.size(), INDEX_BLOCK_SIZE));
+    for (std::vector<std::pair<uint64_t, IndexPointer> >::const_iterator
+            ii(pending_index_.begin()); ii != pending_index_.end(); ++ii)
+    {
+        add_index_record(dset, mtype, entries, ptrs, ii->first,
+                ii->second.first, ii->second.second);
+    }
+    append_index_block(dset, mtype, entries, ptrs);
+    pending_index_.clear();
+    H5Dclose(dset);
+    H5Tclose(mtype);
+}
+
+
+// Records per sorted run spilled by merge_index(), and per read of a run
+// while merging them
+static size_t const MERGE_RUN_SIZE = 1 << 20;
+static size_t const MERGE_READ_SIZE = 4096;
+
+
+// An index record on its way through merge_index()
+struct MergeRecord
+{
+    uint64_t timestamp;
+    ChannelID channel;
+    uint64_t record;
+
+    bool operator<(MergeRecord const& rhs) const
+    {
+        return timestamp < rhs.timestamp;
+    }
+};
+
+
+// A sorted run in the spill file, and the part of it being merged
+struct MergeRun
+{
+    off_t next; // Offset of the first record not yet read
+    off_t end;
+    std::vector<MergeRecord> buf;
+    size_t pos;
+};
+
+
+// Sort a run of index records and append it to the spill file. Records with
+// the same time stamp keep their order.
+static void spill_run(FILE* spill, std::vector<MergeRecord>& run,
+        std::vector<MergeRun>& runs)
+{
+    if (run.empty())
+    {
+        return;
+    }
+    std::stable_sort(run.begin(), run.end());
+    MergeRun spilled;
+    spilled.next = ftello(spill);
+    spilled.end = spilled.next + run.size() * sizeof(MergeRecord);
+    spilled.pos = 0;
+    if (spilled.next < 0 ||
+            fwrite(&run[0], sizeof(MergeRecord), run.size(), spill) !=
+            run.size())
+    {
+        throw std::runtime_error("Failed to write index run");
+    }
+    runs.push_back(spilled);
+    run.clear();
+}
+
+
+// Read the next part of a run. Returns false at the end of the run.
+static bool fill_run(int spill, MergeRun& run)
+{
+    if (run.next == run.end)
+    {
+        return false;
+    }
+    size_t count(std::min<off_t>(MERGE_READ_SIZE,
+                (run.end - run.next) / sizeof(MergeRecord)));
+    run.buf.resize(count);
+    ssize_t size(count * sizeof(MergeRecord));
+    if (pread(spill, &run.buf[0], size, run.next) != size)
+    {
+        throw std::runtime_error("Failed to read index run");
+    }
+    run.next += size;
+    run.pos = 0;
+    return true;
+}
+
+
+// Read the records of a file's index that the channel map keeps, spilling
+// them in sorted runs
+static void spill_index_source(hid_t index_set, hid_t mtype,
+        ChannelMap const& map, FILE* spill, std::vector<MergeRecord>& run,
+        std::vector<MergeRun>& runs)
+{
+    hid_t index_space = H5Dget_space(index_set);
+    hsize_t num_entries(0);
+    H5Sget_simple_extent_dims(index_space, &num_entries, 0);
+    std::vector<RawIndexEntry> entries(std::min<hsize_t>(num_entries,
+                INDEX_BLOCK_SIZE));
+    std::string error;
+    for (hsize_t start(0); start < num_entries && error.empty();
+            start += entries.size())
+    {
+        hsize_t count(std::min<hsize_t>(entries.size(), num_entries - start));
+        hid_t read_space = H5Screate_simple(1, &count, 0);
+        H5Sselect_hyperslab(index_space, H5S_SELECT_SET, &start, 0, &count, 0);
+        if (H5Dread(index_set, mtype, read_space, index_space, H5P_DEFAULT,
+                    &entries[0]) < 0)
+        {
+            H5Sclose(read_space);
+            error = "Failed to read index entries";
+            break;
+        }
+        try
+        {
+            for (hsize_t ii(0); ii < count; ++ii)
+            {
+                RawIndexPointer* ptrs =
+                    reinterpret_cast<RawIndexPointer*>(entries[ii].records.p);
+                for (size_t jj(0); jj < entries[ii].records.len; ++jj)
+                {
+                    ChannelMap::const_iterator found(
+                            map.find(ptrs[jj].channel));
+                    if (found == map.end() ||
+                            ptrs[jj].record < found->second.first ||
+                            ptrs[jj].record >= found->second.last)
+                    {
+                        continue;
+                    }
+                    MergeRecord record = {entries[ii].timestamp,
+                        found->second.id,
+                        ptrs[jj].record - found->second.first};
+                    run.push_back(record);
+                    if (run.size() == MERGE_RUN_SIZE)
+                    {
+                        spill_run(spill, run, runs);
+                    }
+                }
+            }
+        }
+        catch (std::runtime_error const& e)
+        {
+            error = e.what();
+        }
+        H5Dvlen_reclaim(mtype, read_space, H5P_DEFAULT, &entries[0]);
+        H5Sclose(read_space);
+    }
+    H5Sclose(index_space);
+    if (!error.empty())
     {
-        tags_grp_ = H5Gcreate(file_, TAGS_GROUP, H5P_DEFAULT,
-                H5P_DEFAULT, H5P_DEFAULT);
+        throw std::runtime_error(error);
     }
 }
 
 
-ChannelInfo HDF5R::read_channel_info(Channel const& chan) const
+uint64_t HDF5R::merge_index(std::vector<IndexSource> const& sources)
 {
-    // Basic properties
-    std::string name = read_string(chan.group(), "name");
-    std::string type_name = read_string(chan.group(), "type_name");
-    std::string source_name = read_string(chan.group(), "source_name");
-    hid_t mem_type = read_type(chan.group(), "mem_type");
-
-    // Get the first and last time stamps
-    uint64_t timestamps[2] = {0, 0};
-    if (chan.size() > 0)
+    if (mode_ == RDONLY || mode_ == SWMR_READ)
     {
-        hsize_t read_size[] = {2};
-        hid_t elem_space = H5Screate_simple(1, read_size, 0);
-        hsize_t coords[2];
-        coords[0] = 0;
-        coords[1] = chan.size() - 1;
-        if (H5Sselect_elements(chan.ts_space(), H5S_SELECT_SET, 2, coords) < 0)
+        throw std::runtime_error("Can't merge indexes into a read-only file");
+    }
+    check_not_swmr("merge indexes");
+    FILE* spill(tmpfile());
+    if (spill == 0)
+    {
+        throw std::runtime_error("Failed to create file for index merge");
+    }
+    hid_t mtype = make_index_mtype();
+    hid_t dset(-1);
+    uint64_t total(0);
+    try
+    {
+        // Source indexes are not necessarily in order, as late records are
+        // appended to them at checkpoints, so each is read in runs that are
+        // sorted before they are spilled
+        std::vector<MergeRecord> run;
+        std::vector<MergeRun> runs;
+        for (std::vector<IndexSource>::const_iterator ii(sources.begin());
+                ii != sources.end(); ++ii)
         {
-            throw std::runtime_error("Failed to select start and end time stamps");
+            hid_t file = H5Fopen(ii->first.c_str(), H5F_ACC_RDONLY,
+                    H5P_DEFAULT);
+            if (file < 0)
+            {
+                throw std::runtime_error("Failed to open " + ii->first);
+            }
+            if (H5Lexists(file, INDEX_SET, H5P_DEFAULT) <= 0)
+            {
+                H5Fclose(file);
+                continue;
+            }
+            hid_t index_set = H5Dopen(file, INDEX_SET, H5P_DEFAULT);
+            try
+            {
+                if (index_set < 0)
+                {
+                    throw std::runtime_error("Failed to open index of " +
+                            ii->first);
+                }
+                spill_index_source(index_set, mtype, ii->second, spill, run,
+                        runs);
+            }
+            catch (...)
+            {
+                if (index_set >= 0)
+                {
+                    H5Dclose(index_set);
+                }
+                H5Fclose(file);
+                throw;
+            }
+            H5Dclose(index_set);
+            H5Fclose(file);
         }
-        if (H5Dread(chan.ts_set(), H5T_NATIVE_UINT64, elem_space,
-                    chan.ts_space(), H5P_DEFAULT, timestamps) < 0)
+        spill_run(spill, run, runs);
+        std::vector<MergeRecord>().swap(run);
+        if (fflush(spill) != 0)
         {
-            throw std::runtime_error("Failed to read start and end time stamps");
+            throw std::runtime_error("Failed to write index run");
+        }
+
+        // Merge the runs, earliest time stamp first and otherwise in the
+        // order of the sources
+        int fd(fileno(spill));
+        std::priority_queue<RunCursor> heads;
+        for (size_t ii(0); ii < runs.size(); ++ii)
+        {
+            if (fill_run(fd, runs[ii]))
+            {
+                RunCursor head = {runs[ii].buf[0].timestamp, ii, 0};
+                heads.push(head);
+            }
+        }
+        dset = create_index_set();
+        std::vector<RawIndexEntry> entries;
+        std::vector<RawIndexPointer> ptrs;
+        while (!heads.empty())
+        {
+            RunCursor head(heads.top());
+            heads.pop();
+            MergeRun& source(runs[head.run]);
+            MergeRecord const& record(source.buf[source.pos]);
+            add_index_record(dset, mtype, entries, ptrs, record.timestamp,
+                    record.channel, record.record);
+            ++total;
+            if (++source.pos < source.buf.size() || fill_run(fd, source))
+            {
+                head.timestamp = source.buf[source.pos].timestamp;
+                heads.push(head);
+            }
         }
+        append_index_block(dset, mtype, entries, ptrs);
     }
+    catch (...)
+    {
+        if (dset >= 0)
+        {
+            H5Dclose(dset);
+        }
+        H5Tclose(mtype);
+        fclose(spill);
+        throw;
+    }
+    H5Dclose(dset);
+    H5Tclose(mtype);
+    fclose(spill);
+    // The file's index has been replaced; entries added from here on are
+    // appended to it
+    index_.clear();
+    pending_index_.clear();
+    index_in_file_ = true;
+    return total;
+}
 
-    ChannelInfo result(name, type_name, source_name, mem_type, chan.size(),
-            timestamps[0], timestamps[1]);
-    H5Tclose(mem_type);
-    return result;
+
+static size_t cached_bytes(std::vector<uint64_t> const& timestamps,
+        std::vector<char> const& records)
+{
+    return timestamps.size() * sizeof(uint64_t) + records.size();
 }
 
 
-std::string HDF5R::read_string(hid_t group, std::string set) const
+HDF5R::CachedBlock const& HDF5R::cached_block(ChannelID chan_id,
+        Channel& chan, hsize_t index)
 {
-    // Open the dataset
-    hid_t dset = H5Dopen(group, set.c_str(), H5P_DEFAULT);
-    if (dset < 0)
+    RecordCache const& cache(profile_.record_cache());
+    size_t block_records(std::max<size_t>(cache.block_records(), 1));
+    BlockKey key(chan_id, index - index % block_records);
+    std::map<BlockKey, BlockList::iterator>::iterator ii(
+            cached_blocks_.find(key));
+    if (ii != cached_blocks_.end())
     {
-        throw std::runtime_error("Failed to open string " + set);
+        BlockList::iterator block(ii->second);
+        if (index < block->start + block->count)
+        {
+            ++record_cache_stats_.hits;
+            record_cache_.splice(record_cache_.begin(), record_cache_, block);
+            return *block;
+        }
+        // The block was read before the channel grew past it; read it again
+        record_cache_stats_.bytes -= cached_bytes(block->timestamps,
+                block->records);
+        --record_cache_stats_.blocks;
+        record_cache_.erase(block);
+        cached_blocks_.erase(ii);
     }
-    // Get the string's data type
-    hid_t str_type = H5Dget_type(dset);
-    if (str_type < 0)
+    ++record_cache_stats_.misses;
+
+    record_cache_.push_front(CachedBlock());
+    CachedBlock& block(record_cache_.front());
+    block.chan = chan_id;
+    block.start = key.second;
+    block.count = std::min<hsize_t>(block_records, chan.size() - block.start);
+    try
     {
-        throw std::runtime_error("Failed to get string data type for" + set);
+        block.timestamps.resize(block.count);
+        block.records.resize(block.count * H5Tget_size(chan.mem_type()));
+        read_timestamps(chan, chan.ts_space(), block.start, block.count,
+                &block.timestamps[0]);
+        read_records(chan, block.start, block.count, chan.mem_type(),
+                &block.records[0]);
     }
-    // Make some temporary space to store the string data
-    size_t len = H5Tget_size(str_type);
-    if (len < 0)
+    catch (...)
     {
-        throw std::runtime_error("Error reading string length for " + set);
+        record_cache_.pop_front();
+        throw;
     }
-    char* temp = new char[len];
-    // Read the string from the dataset
-    if (H5Dread(dset, str_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, temp) < 0)
+    cached_blocks_[key] = record_cache_.begin();
+    record_cache_stats_.bytes += cached_bytes(block.timestamps, block.records);
+    ++record_cache_stats_.blocks;
+
+    // Drop the least recently used blocks to fit the budget, keeping the
+    // block just read even if it alone is over it
+    while (record_cache_stats_.bytes > cache.bytes() &&
+            record_cache_.size() > 1)
     {
-        throw std::runtime_error("Error reading string " + set);
+        CachedBlock const& oldest(record_cache_.back());
+        record_cache_stats_.bytes -= cached_bytes(oldest.timestamps,
+                oldest.records);
+        --record_cache_stats_.blocks;
+        ++record_cache_stats_.evictions;
+        cached_blocks_.erase(BlockKey(oldest.chan, oldest.start));
+        record_cache_.pop_back();
     }
-    std::string result(temp);
-    // Clean up
-    delete[] temp;
-    H5Tclose(str_type);
-    H5Dclose(dset);
-
-    return result;
+    return block;
 }
 
 
-hid_t HDF5R::read_type(hid_t group, std::string set) const
+// Read count elements of a data set from start
+static herr_t read_elements(hid_t set, hid_t space, hid_t type, hsize_t start,
+        hsize_t count, void* const buf)
 {
-    hid_t result = H5Topen(group, set.c_str(), H5P_DEFAULT);
-    if (result < 0)
+    hid_t read_space = H5Screate_simple(1, &count, 0);
+    herr_t status(-1);
+    if (H5Sselect_hyperslab(space, H5S_SELECT_SET, &start, 0, &count, 0) >= 0)
     {
-        throw std::runtime_error("Error reading data type " + set);
+        status = H5Dread(set, type, read_space, space, H5P_DEFAULT, buf);
     }
-    return result;
+    H5Sclose(read_space);
+    return status;
 }
 
 
-unsigned int HDF5R::read_uint(hid_t group, std::string set) const
+void HDF5R::read_timestamps(Channel const& chan, hid_t space, hsize_t start,
+        hsize_t count, uint64_t* const buf) const
 {
-    hid_t dset = H5Dopen(group, set.c_str(), H5P_DEFAULT);
-    if (dset < 0)
+    if (chan.period() > 0)
     {
-        throw std::runtime_error("Failed to open uint " + set);
+        chan.timeline_stamps(start, count, buf);
+        return;
     }
-    unsigned int result(0);
-    if (H5Dread(dset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                &result) < 0)
+    // The records of a ring channel may wrap around the end of its data sets
+    hsize_t run(chan.run(start, count));
+    if (read_elements(chan.ts_set(), space, H5T_NATIVE_UINT64,
+                chan.position(start), run, buf) < 0 ||
+            (run < count && read_elements(chan.ts_set(), space,
+                H5T_NATIVE_UINT64, 0, count - run, buf + run) < 0))
     {
-        throw std::runtime_error("Failed to read uint " + set);
+        throw std::runtime_error("Failed to read time stamps");
     }
-    H5Dclose(dset);
-    return result;
 }
 
 
-void HDF5R::write_string(hid_t group, std::string set, std::string str)
+// The memory type is used for channels with a records data set; columnar
+// channels' records are read whole in their own memory type
+void HDF5R::read_records(Channel const& chan, hsize_t start, hsize_t count,
+        hid_t mem_type, void* const buf) const
 {
-    // Create a string type of the necessary length
-    hid_t str_type = H5Tcopy(H5T_C_S1);
-    if (H5Tset_size(str_type, str.size() + 1) < 0)
+    if (chan.columnar())
     {
-        throw std::runtime_error("Error setting string size for string " + set);
+        read_columns(chan, start, count, 0, buf);
+        return;
     }
-    // Create the dataspace and dataset for the string
-    hid_t dspace = H5Screate(H5S_SCALAR);
-    hid_t dset = H5Dcreate(group, set.c_str(), str_type, dspace, H5P_DEFAULT,
-            H5P_DEFAULT, H5P_DEFAULT);
-    // Write the string to the dataset
-    if (H5Dwrite(dset, str_type, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                str.c_str()) < 0)
+    hsize_t run(chan.run(start, count));
+    char* const rest(static_cast<char*>(buf) + run * H5Tget_size(mem_type));
+    if (read_elements(chan.rec_set(), chan.rec_space(), mem_type,
+                chan.position(start), run, buf) < 0 ||
+            (run < count && read_elements(chan.rec_set(), chan.rec_space(),
+                mem_type, 0, count - run, rest) < 0))
     {
-        throw std::runtime_error("Error writing string " + set);
+        throw std::runtime_error("Failed to read records");
     }
-    // Clean up
-    H5Dclose(dset);
-    H5Sclose(dspace);
-    H5Tclose(str_type);
 }
 
 
-void HDF5R::write_type(hid_t group, std::string set, hid_t type)
+///////////////////////////////////////////////////////////////////////////////
+// Columnar channels
+///////////////////////////////////////////////////////////////////////////////
+
+
+// A column held in a data set, for the field of the same name in memory
+static Channel::Column make_column(std::string const& name, hid_t set,
+        hid_t mem_type)
+{
+    Channel::Column column;
+    column.name = name;
+    column.set.reset(set);
+    column.space.reset(H5Dget_space(set));
+    column.offset = 0;
+    int member(H5Tget_member_index(mem_type, name.c_str()));
+    if (member >= 0)
+    {
+        column.mem_type.reset(H5Tget_member_type(mem_type, member));
+        column.offset = H5Tget_member_offset(mem_type, member);
+    }
+    return column;
+}
+
+
+void HDF5R::create_columns(hid_t group, std::string const& name,
+        hid_t mem_type, hid_t file_type, std::vector<Channel::Column>& columns)
 {
-    // Copy the type temporarily. If this is not done, we will not be able to
-    // commit immutable data types such as H5T_NATIVE_INT.
-    hid_t temp = H5Tcopy(type);
-    if (temp < 0)
+    Handle columns_grp(H5Gcreate(group, COLUMNS_GROUP, H5P_DEFAULT,
+                H5P_DEFAULT, H5P_DEFAULT));
+    if (!columns_grp.valid())
     {
-        throw std::runtime_error("Error copying data type");
+        throw std::runtime_error("Failed to create columns of channel " +
+                name);
     }
-    if (H5Tcommit(group, set.c_str(), temp, H5P_DEFAULT, H5P_DEFAULT,
-                H5P_DEFAULT) < 0)
+    hsize_t dims[1] = {0};
+    hsize_t max_dims[1] = {H5S_UNLIMITED};
+    Handle space(H5Screate_simple(1, dims, max_dims));
+    Handle dapl(profile_.make_dapl(name));
+    int fields(H5Tget_nmembers(file_type));
+    for (int ii(0); ii < fields; ++ii)
     {
-        throw std::runtime_error("Error writing data type " + set);
+        char* field(H5Tget_member_name(file_type, ii));
+        std::string field_name(field);
+        H5free_memory(field);
+        Handle field_type(H5Tget_member_type(file_type, ii));
+        // Chunks hold as many of the field's values as add_channel()'s hold
+        // records
+        hsize_t chunk_size = std::max<hsize_t>(1,
+                CHUNK_BYTES / H5Tget_size(field_type.get()));
+        Handle parms(H5Pcreate(H5P_DATASET_CREATE));
+        H5Pset_chunk(parms.get(), 1, &chunk_size);
+        hid_t set = H5Dcreate(columns_grp.get(), field_name.c_str(),
+                field_type.get(), space.get(), H5P_DEFAULT, parms.get(),
+                dapl.get());
+        if (set < 0)
+        {
+            throw std::runtime_error("Failed to create column " +
+                    field_name + " of channel " + name);
+        }
+        columns.push_back(make_column(field_name, set, mem_type));
     }
-    H5Tclose(temp);
 }
 
 
-void HDF5R::write_uint(hid_t group, std::string set, unsigned int value)
+bool HDF5R::open_columns(hid_t group, std::string const& name,
+        hid_t mem_type, std::vector<Channel::Column>& columns)
 {
-    hid_t dspace = H5Screate(H5S_SCALAR);
-    hid_t dset = H5Dcreate(group, set.c_str(), H5T_STD_U64LE, dspace,
-            H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    if (H5Dwrite(dset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                &value) < 0)
+    Handle columns_grp(H5Gopen(group, COLUMNS_GROUP, H5P_DEFAULT));
+    if (!columns_grp.valid())
     {
-        throw std::runtime_error("Error writing uint " + set);
+        return false;
     }
-    H5Dclose(dset);
-    H5Sclose(dspace);
+    std::vector<std::string> names;
+    H5Literate(columns_grp.get(), H5_INDEX_NAME, H5_ITER_NATIVE, 0,
+            get_child_names, &names);
+    Handle dapl(profile_.make_dapl(name));
+    for (std::vector<std::string>::const_iterator ii(names.begin());
+            ii != names.end(); ++ii)
+    {
+        hid_t set = H5Dopen(columns_grp.get(), ii->c_str(), dapl.get());
+        if (set < 0)
+        {
+            return false;
+        }
+        if (mode_ == SWMR_READ)
+        {
+            // Before the column's space is taken, as in open_channel()
+            H5Drefresh(set);
+        }
+        columns.push_back(make_column(*ii, set, mem_type));
+    }
+    return !columns.empty();
 }
 
 
-typedef struct
-{
-    ChannelID channel;
-    uint64_t record;
-} RawIndexPointer;
-typedef struct
+void HDF5R::extend_columns(Channel& chan, hsize_t size)
 {
-    uint64_t timestamp;
-    hvl_t records;
-} RawIndexEntry;
+    hsize_t extent[1] = {size};
+    hsize_t max_extent[1] = {H5S_UNLIMITED};
+    std::vector<Channel::Column> const& columns(chan.columns());
+    for (size_t ii(0); ii < columns.size(); ++ii)
+    {
+        if (H5Dset_extent(columns[ii].set.get(), extent) < 0)
+        {
+            throw std::runtime_error("Failed to extend columns of channel " +
+                    chan.name());
+        }
+        H5Sset_extent_simple(columns[ii].space.get(), 1, extent, max_extent);
+    }
+}
 
 
-hid_t HDF5R::make_index_ftype() const
+void HDF5R::write_columns(Channel& chan, hsize_t start, hsize_t count,
+        void const* const buf)
 {
-    // Individual record pointer type
-    hid_t index_ptr = H5Tcreate(H5T_COMPOUND, 8 + 8);
-    herr_t s = H5Tinsert(index_ptr, "channel", 0, H5T_STD_U64LE);
-    s = H5Tinsert(index_ptr, "record", 8, H5T_STD_U64LE);
+    std::vector<Channel::Column> const& columns(chan.columns());
+    for (size_t ii(0); ii < columns.size(); ++ii)
+    {
+        if (!columns[ii].mem_type.valid())
+        {
+            throw std::runtime_error("Memory type of channel " +
+                    chan.name() + " has no field " + columns[ii].name);
+        }
+    }
+    extend_columns(chan, start + count);
+    size_t rec_size(H5Tget_size(chan.mem_type()));
+    char const* const records(static_cast<char const*>(buf));
+    Handle mem_space(H5Screate_simple(1, &count, 0));
+    std::vector<char> values;
+    for (size_t ii(0); ii < columns.size(); ++ii)
+    {
+        Channel::Column const& column(columns[ii]);
+        size_t size(H5Tget_size(column.mem_type.get()));
+        values.resize(count * size);
+        for (hsize_t jj(0); jj < count; ++jj)
+        {
+            memcpy(&values[jj * size],
+                    records + jj * rec_size + column.offset, size);
+        }
+        if (H5Sselect_hyperslab(column.space.get(), H5S_SELECT_SET, &start,
+                    0, &count, 0) < 0 ||
+                H5Dwrite(column.set.get(), column.mem_type.get(),
+                    mem_space.get(), column.space.get(), H5P_DEFAULT,
+                    &values[0]) < 0)
+        {
+            throw std::runtime_error("Failed to write field " + column.name +
+                    " of channel " + chan.name());
+        }
+    }
+}
 
-    // Variable-length array of record pointers
-    hid_t rec_ptr_array = H5Tvlen_create(index_ptr);
 
-    // Single index entry type
-    hid_t index_entry = H5Tcreate(H5T_COMPOUND, 8 + sizeof(hvl_t));
-    s = H5Tinsert(index_entry, "timestamp", 0, H5T_STD_U64LE);
-    s = H5Tinsert(index_entry, "records", 8, rec_ptr_array);
-    return index_entry;
+// Fill in the fields named, or all of them if fields is null. Fields the
+// memory type lacks are left alone.
+void HDF5R::read_columns(Channel const& chan, hsize_t start, hsize_t count,
+        std::vector<std::string> const* fields, void* const buf) const
+{
+    size_t rec_size(H5Tget_size(chan.mem_type()));
+    char* const records(static_cast<char*>(buf));
+    std::vector<char> values;
+    std::vector<Channel::Column> const& columns(chan.columns());
+    for (size_t ii(0); ii < columns.size(); ++ii)
+    {
+        Channel::Column const& column(columns[ii]);
+        if (!column.mem_type.valid() || (fields != 0 &&
+                    std::find(fields->begin(), fields->end(), column.name) ==
+                    fields->end()))
+        {
+            continue;
+        }
+        size_t size(H5Tget_size(column.mem_type.get()));
+        values.resize(count * size);
+        if (read_elements(column.set.get(), column.space.get(),
+                    column.mem_type.get(), start, count, &values[0]) < 0)
+        {
+            throw std::runtime_error("Failed to read field " + column.name +
+                    " of channel " + chan.name());
+        }
+        for (hsize_t jj(0); jj < count; ++jj)
+        {
+            memcpy(records + jj * rec_size + column.offset,
+                    &values[jj * size], size);
+        }
+    }
 }
 
 
-hid_t HDF5R::make_index_mtype() const
+///////////////////////////////////////////////////////////////////////////////
+// Fixed-rate channels
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Runs of a timeline as they are in memory or in the file
+static hid_t make_run_type(hid_t field_type)
 {
-    // Individual record pointer type
-    hid_t index_ptr = H5Tcreate(H5T_COMPOUND, sizeof(RawIndexPointer));
-    herr_t s = H5Tinsert(index_ptr, "channel", HOFFSET(RawIndexPointer, channel),
-            H5T_NATIVE_UINT64);
-    s = H5Tinsert(index_ptr, "record", HOFFSET(RawIndexPointer, record),
-            H5T_NATIVE_UINT64);
+    hid_t type = H5Tcreate(H5T_COMPOUND, 2 * H5Tget_size(field_type));
+    H5Tinsert(type, "first", 0, field_type);
+    H5Tinsert(type, "timestamp", H5Tget_size(field_type), field_type);
+    return type;
+}
 
-    // Variable-length array of record pointers
-    hid_t rec_ptr_array = H5Tvlen_create(index_ptr);
 
-    // Single index entry type
-    hid_t index_entry = H5Tcreate(H5T_COMPOUND, sizeof(RawIndexEntry));
-    s = H5Tinsert(index_entry, "timestamp", HOFFSET(RawIndexEntry, timestamp),
-            H5T_NATIVE_UINT64);
-    s = H5Tinsert(index_entry, "records", HOFFSET(RawIndexEntry, records),
-            rec_ptr_array);
-    return index_entry;
+// Runs are only added when a sample is dropped or late, so the timeline's
+// chunks are small
+static hsize_t const TIMELINE_CHUNK = 256;
+
+
+hid_t HDF5R::create_timeline(hid_t group)
+{
+    hsize_t dims[1] = {0};
+    hsize_t max_dims[1] = {H5S_UNLIMITED};
+    hsize_t chunk[1] = {TIMELINE_CHUNK};
+    Handle space(H5Screate_simple(1, dims, max_dims));
+    Handle parms(H5Pcreate(H5P_DATASET_CREATE));
+    H5Pset_chunk(parms.get(), 1, chunk);
+    Handle type(make_run_type(H5T_STD_U64LE));
+    return H5Dcreate(group, TIMELINE_SET, type.get(), space.get(),
+            H5P_DEFAULT, parms.get(), H5P_DEFAULT);
 }
 
 
-void HDF5R::read_index()
+void HDF5R::load_timeline(Channel& chan)
 {
-    // Attempt to open the index, if it exists
-    hid_t index_set = H5Dopen(file_, INDEX_SET, H5P_DEFAULT);
-    if (index_set < 0)
+    Handle space(H5Dget_space(chan.timeline()));
+    hsize_t count(0);
+    H5Sget_simple_extent_dims(space.get(), &count, 0);
+    std::vector<Channel::TimelineRun>& runs(chan.runs());
+    runs.resize(count);
+    Handle type(make_run_type(H5T_NATIVE_UINT64));
+    if (count > 0 && H5Dread(chan.timeline(), type.get(), H5S_ALL, H5S_ALL,
+                H5P_DEFAULT, &runs[0]) < 0)
     {
-        // No index, nothing to do
-        return;
+        throw std::runtime_error("Failed to read timeline of channel " +
+                chan.name());
+    }
+    // Runs of records added after the last checkpoint of a file that was
+    // not closed cleanly are dropped along with the records, and written
+    // over by those added from now on
+    while (!runs.empty() && runs.back().first >= chan.size())
+    {
+        runs.pop_back();
     }
+}
 
-    hid_t mtype = make_index_mtype();
-    hid_t ftype = make_index_ftype();
-    hsize_t read_size[] = {1};
-    hid_t read_space = H5Screate_simple(1, read_size, 0);
-    hid_t index_space = H5Dget_space(index_set);
 
-    hsize_t num_entries(0);
-    H5Sget_simple_extent_dims(index_space, &num_entries, 0);
-    for (hsize_t coords = 0; coords < num_entries; ++coords)
+void HDF5R::append_timeline(Channel& chan, hsize_t start, size_t count,
+        uint64_t const* const timestamps)
+{
+    std::vector<Channel::TimelineRun>& runs(chan.runs());
+    size_t old_runs(runs.size());
+    for (size_t ii(0); ii < count; ++ii)
     {
-        // Select the next index entry
-        if (H5Sselect_elements(index_space, H5S_SELECT_SET, 1, &coords) < 0)
-        {
-            throw std::runtime_error(
-                    "Failed to select index entry for reading");
-        }
-        // Read the entry
-        RawIndexEntry raw_entry;
-        if (H5Dread(index_set, mtype, read_space, index_space, H5P_DEFAULT,
-                    &raw_entry) < 0)
+        hsize_t index(start + ii);
+        if (!runs.empty() && timestamps[ii] == runs.back().timestamp +
+                (index - runs.back().first) * chan.period())
         {
-            throw std::runtime_error("Failed to read index entry");
+            continue;
         }
-        // Copy the data out
-        IndexPointerList index_entry;
-        for (unsigned int ii(0); ii < raw_entry.records.len; ++ii)
-        {
-            RawIndexPointer* ptrs =
-                reinterpret_cast<RawIndexPointer*>(raw_entry.records.p);
-            index_entry.push_back(IndexPointer(ptrs[ii].channel,
-                        ptrs[ii].record));
-        }
-        index_[raw_entry.timestamp] = index_entry;
-        // Clean up the allocated memory
-        H5Dvlen_reclaim(mtype, read_space, H5P_DEFAULT, &raw_entry);
+        Channel::TimelineRun run = {index, timestamps[ii]};
+        runs.push_back(run);
+    }
+    if (runs.size() > old_runs)
+    {
+        write_runs(chan, old_runs);
     }
-    H5Sclose(index_space);
-    H5Sclose(read_space);
-    H5Tclose(ftype);
-    H5Tclose(mtype);
-    H5Dclose(index_set);
 }
 
 
-void HDF5R::write_index()
+// Write runs from first to the end, dropping any in the file after them
+void HDF5R::write_runs(Channel& chan, size_t first)
 {
-    // Can't write the index in read-only mode
-    if (mode_ == RDONLY)
+    std::vector<Channel::TimelineRun> const& runs(chan.runs());
+    hsize_t extent[1] = {runs.size()};
+    hsize_t start[1] = {first};
+    hsize_t count[1] = {runs.size() - first};
+    Handle type(make_run_type(H5T_NATIVE_UINT64));
+    if (H5Dset_extent(chan.timeline(), extent) < 0)
+    {
+        throw std::runtime_error("Failed to extend timeline of channel " +
+                chan.name());
+    }
+    if (count[0] == 0)
     {
         return;
     }
-    // If the file has an index, remove it
-    hid_t index = H5Dopen(file_, INDEX_SET, H5P_DEFAULT);
-    if (index >= 0)
+    Handle space(H5Dget_space(chan.timeline()));
+    Handle mem_space(H5Screate_simple(1, count, 0));
+    if (H5Sselect_hyperslab(space.get(), H5S_SELECT_SET, start, 0, count,
+                0) < 0 ||
+            H5Dwrite(chan.timeline(), type.get(), mem_space.get(),
+                space.get(), H5P_DEFAULT, &runs[first]) < 0)
     {
-        H5Dclose(index);
-        H5Ldelete(file_, INDEX_SET, H5P_DEFAULT);
+        throw std::runtime_error("Failed to write timeline of channel " +
+                chan.name());
     }
-    // If the current index is empty, do nothing
-    if (index_.size() == 0)
+}
+
+
+void HDF5R::write_committed()
+{
+    if (mode_ == RDONLY || mode_ == SWMR_READ)
     {
         return;
     }
-
-    // Create the index dataset
-    hid_t mtype = make_index_mtype();
-    hid_t ftype = make_index_ftype();
-    hsize_t write_size[] = {1};
-    hid_t write_space = H5Screate_simple(1, write_size, 0);
-    hsize_t len(index_.size());
-    hid_t dspace = H5Screate_simple(1, &len, 0);
-    hid_t dset = H5Dcreate(file_, INDEX_SET, ftype, dspace, H5P_DEFAULT,
-            H5P_DEFAULT, H5P_DEFAULT);
-    // Write out each index element one at a time to avoid duplicating a
-    // potentially large amount of memory
-    RawIndexEntry entry;
-    unsigned int offset(0);
-    for(Index::const_iterator ii(index_.begin()); ii != index_.end(); ++ii)
+    for (std::map<ChannelID, Channel>::iterator ii(channels_.begin());
+            ii != channels_.end(); ++ii)
     {
-        // Build the index entry in a memory format suitable for writing
-        entry.timestamp = ii->first;
-        entry.records.len = ii->second.size();
-        RawIndexPointer* ptrs = new RawIndexPointer[entry.records.len];
-        for (unsigned int jj(0); jj < entry.records.len; ++jj)
-        {
-            ptrs[jj].channel = ii->second[jj].first;
-            ptrs[jj].record = ii->second[jj].second;
-        }
-        entry.records.p = ptrs;
-        // Select the entry in the file
-        hsize_t coords[1];
-        coords[0] = offset++;
-        if (H5Sselect_elements(dspace, H5S_SELECT_SET, 1, coords) < 0)
+        Channel& chan(ii->second);
+        if (!chan.is_open() || !chan.unsaved())
         {
-            throw std::runtime_error(
-                    "Failed to select element in index for writing.");
+            continue;
         }
-        // Write the entry
-        if (H5Dwrite(dset, mtype, write_space, dspace, H5P_DEFAULT,
-                    &entry) < 0)
+        // Attributes cannot be written in SWMR mode, and SWMR files do not
+        // need them because their flushed extents are always consistent
+        if (mode_ != SWMR_WRITE)
         {
-            throw std::runtime_error("Failed to write index element.");
+            write_uint_attr(chan.group(), "committed", chan.size());
+            if (chan.capacity() > 0)
+            {
+                write_uint_attr(chan.group(), "head", chan.head());
+            }
         }
-        // Clean up
-        delete[] ptrs;
+        chan.committed(chan.size());
+        chan.committed_head(chan.head());
     }
-    H5Dclose(dset);
-    H5Sclose(dspace);
-    H5Sclose(write_space);
-    H5Tclose(ftype);
-    H5Tclose(mtype);
 }
 
+
+void HDF5R::check_durability(size_t records)
+{
+    uncommitted_ += records;
+    if ((durability_.records() > 0 &&
+                uncommitted_ >= durability_.records()) ||
+            (durability_.interval_ms() > 0 &&
+             monotonic_ms() - last_checkpoint_ >= durability_.interval_ms()))
+    {
+        checkpoint();
+    }
+}
@@ -0,0 +1,264 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Time index over the records of all channels in a file.
+ */
+
+#include <hdf5r/index.h>
+
+#include <algorithm>
+
+using namespace hdf5r;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// IndexView class
+///////////////////////////////////////////////////////////////////////////////
+
+
+size_t IndexView::lower_bound(uint64_t timestamp) const
+{
+    return search(timestamp, false);
+}
+
+
+size_t IndexView::upper_bound(uint64_t timestamp) const
+{
+    return search(timestamp, true);
+}
+
+
+IndexPointerList IndexView::entry(uint64_t timestamp) const
+{
+    IndexPointerList result;
+    for (size_t ii(lower_bound(timestamp));
+            ii < size_ && timestamps_[ii] == timestamp; ++ii)
+    {
+        result.push_back(pointer(ii));
+    }
+    return result;
+}
+
+
+IndexView IndexView::slice(size_t first, size_t last) const
+{
+    last = std::min(last, size_);
+    first = std::min(first, last);
+    return IndexView(timestamps_ + first, channels_ + first, records_ + first,
+            last - first);
+}
+
+
+IndexView IndexView::window(uint64_t start, uint64_t end) const
+{
+    return slice(lower_bound(start), lower_bound(end));
+}
+
+
+size_t IndexView::search(uint64_t timestamp, bool after) const
+{
+    // Log time stamps are usually close to evenly spaced, so a few
+    // interpolation probes narrow the range quickly before a binary search
+    // finishes it off. The result always lies in [lo, hi].
+    size_t lo(0), hi(size_);
+    for (int probes(0); probes < 4 && hi - lo > 64; ++probes)
+    {
+        uint64_t first(timestamps_[lo]), last(timestamps_[hi - 1]);
+        if (after ? timestamp < first : timestamp <= first)
+        {
+            return lo;
+        }
+        if (after ? timestamp >= last : timestamp > last)
+        {
+            return hi;
+        }
+        size_t mid(lo + static_cast<size_t>(
+                    static_cast<double>(timestamp - first) / (last - first) *
+                    (hi - 1 - lo)));
+        if (after ? timestamps_[mid] <= timestamp :
+                timestamps_[mid] < timestamp)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid + 1;
+        }
+    }
+    if (after)
+    {
+        return std::upper_bound(timestamps_ + lo, timestamps_ + hi,
+                timestamp) - timestamps_;
+    }
+    return std::lower_bound(timestamps_ + lo, timestamps_ + hi, timestamp) -
+        timestamps_;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Index class
+///////////////////////////////////////////////////////////////////////////////
+
+
+Index::Index()
+{
+}
+
+
+void Index::append(uint64_t timestamp, ChannelID channel, uint64_t record)
+{
+    if (timestamps_.empty() || timestamps_.back() <= timestamp)
+    {
+        timestamps_.push_back(timestamp);
+        channels_.push_back(channel);
+        records_.push_back(record);
+        return;
+    }
+    // Late records are normally only a little late, so only the tail of
+    // the arrays moves
+    size_t pos(std::upper_bound(timestamps_.begin(), timestamps_.end(),
+                timestamp) - timestamps_.begin());
+    timestamps_.insert(timestamps_.begin() + pos, timestamp);
+    channels_.insert(channels_.begin() + pos, channel);
+    records_.insert(records_.begin() + pos, record);
+}
+
+
+// Orders positions in an index by time stamp
+struct by_timestamp_fun
+{
+    by_timestamp_fun(std::vector<uint64_t> const& timestamps)
+        : timestamps_(timestamps)
+    {}
+
+    bool operator()(size_t lhs, size_t rhs) const
+    {
+        return timestamps_[lhs] < timestamps_[rhs];
+    }
+
+    std::vector<uint64_t> const& timestamps_;
+};
+
+
+void Index::append(size_t count, uint64_t const* timestamps,
+        ChannelID channel, uint64_t first_record)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    size_t old_size(timestamps_.size());
+    uint64_t earliest(timestamps[0]);
+    bool in_order(old_size == 0 || timestamps_.back() <= earliest);
+    for (size_t ii(0); ii < count; ++ii)
+    {
+        if (ii > 0 && timestamps[ii] < timestamps[ii - 1])
+        {
+            in_order = false;
+        }
+        earliest = std::min(earliest, timestamps[ii]);
+    }
+    timestamps_.insert(timestamps_.end(), timestamps, timestamps + count);
+    channels_.insert(channels_.end(), count, channel);
+    records_.reserve(records_.size() + count);
+    for (size_t ii(0); ii < count; ++ii)
+    {
+        records_.push_back(first_record + ii);
+    }
+    if (in_order)
+    {
+        return;
+    }
+    // Sort the new records together with the existing ones from the first
+    // they go before. The sort is stable, so records sharing a time stamp
+    // stay in the order they were added, as with single appends.
+    size_t first(std::upper_bound(timestamps_.begin(),
+                timestamps_.begin() + old_size, earliest) -
+            timestamps_.begin());
+    std::vector<size_t> order(timestamps_.size() - first);
+    for (size_t ii(0); ii < order.size(); ++ii)
+    {
+        order[ii] = first + ii;
+    }
+    std::stable_sort(order.begin(), order.end(),
+            by_timestamp_fun(timestamps_));
+    std::vector<uint64_t> sorted_ts(order.size());
+    std::vector<ChannelID> sorted_channels(order.size());
+    std::vector<uint64_t> sorted_records(order.size());
+    for (size_t ii(0); ii < order.size(); ++ii)
+    {
+        sorted_ts[ii] = timestamps_[order[ii]];
+        sorted_channels[ii] = channels_[order[ii]];
+        sorted_records[ii] = records_[order[ii]];
+    }
+    std::copy(sorted_ts.begin(), sorted_ts.end(), timestamps_.begin() + first);
+    std::copy(sorted_channels.begin(), sorted_channels.end(),
+            channels_.begin() + first);
+    std::copy(sorted_records.begin(), sorted_records.end(),
+            records_.begin() + first);
+}
+
+
+void Index::reserve(size_t size)
+{
+    timestamps_.reserve(size);
+    channels_.reserve(size);
+    records_.reserve(size);
+}
+
+
+void Index::remove_last(uint64_t timestamp, size_t count)
+{
+    // Each went in after any others with the same time stamp, so they are
+    // the last of those
+    size_t end(std::upper_bound(timestamps_.begin(), timestamps_.end(),
+                timestamp) - timestamps_.begin());
+    size_t begin(end - std::min(count, end));
+    timestamps_.erase(timestamps_.begin() + begin,
+            timestamps_.begin() + end);
+    channels_.erase(channels_.begin() + begin, channels_.begin() + end);
+    records_.erase(records_.begin() + begin, records_.begin() + end);
+}
+
+
+void Index::clear()
+{
+    timestamps_.clear();
+    channels_.clear();
+    records_.clear();
+}
+
+
+void Index::swap(Index& rhs)
+{
+    timestamps_.swap(rhs.timestamps_);
+    channels_.swap(rhs.channels_);
+    records_.swap(rhs.records_);
+}
+
+
+IndexView Index::view() const
+{
+    if (timestamps_.empty())
+    {
+        return IndexView();
+    }
+    return IndexView(&timestamps_[0], &channels_[0], &records_[0],
+            timestamps_.size());
+}
+
+
+bool Index::operator==(Index const& rhs) const
+{
+    return timestamps_ == rhs.timestamps_ && channels_ == rhs.channels_ &&
+        records_ == rhs.records_;
+}
@@ -0,0 +1,750 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Logging service for several processes writing to one file.
+ */
+
+#include <hdf5r/logd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace hdf5r;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared memory layout
+///////////////////////////////////////////////////////////////////////////////
+
+
+// The daemon's segment, /hdf5r.<service>, holds a slot for each client. A
+// client claims a free slot, makes its own segment holding its ring, and
+// names it in the slot. The daemon attaches to the ring and unlinks its
+// name, so it goes when both have unmapped it.
+static uint32_t const CONTROL_MAGIC = 0x4844354c;
+static size_t const MAX_CLIENTS = 64;
+static size_t const SEGMENT_NAME_SIZE = 64;
+
+typedef enum { SLOT_FREE, SLOT_CLAIMED, SLOT_READY, SLOT_ATTACHED } SlotState;
+
+
+struct ClientSlot
+{
+    uint32_t state;
+    int32_t pid;
+    char segment[SEGMENT_NAME_SIZE];
+};
+
+
+struct hdf5r::LogControl
+{
+    uint32_t magic;
+    int32_t daemon_pid;
+    ClientSlot slots[MAX_CLIENTS];
+};
+
+
+// A single-producer, single-consumer ring of messages, followed in the
+// segment by size bytes of data. head and tail count bytes written and
+// consumed; each is on its own cache line so the client and daemon do not
+// contend for them.
+struct hdf5r::LogRing
+{
+    uint64_t size;
+    uint32_t closed;
+    int32_t pid;
+    char pad0[48];
+    // Written by the client
+    uint64_t head;
+    uint64_t dropped;
+    uint64_t sent;
+    char pad1[40];
+    // Written by the daemon
+    uint64_t tail;
+    char pad2[56];
+};
+
+
+// Messages are padded to eight bytes and never wrap around the end of the
+// ring; a pad message fills the space left at the end instead.
+typedef enum { MSG_PAD, MSG_CHANNEL, MSG_ENTRY } MessageType;
+
+
+struct MessageHeader
+{
+    uint32_t type;
+    uint32_t size;
+};
+
+
+// Followed by the channel's name, type name and source name, then the
+// encoded memory and file types
+struct ChannelMessage
+{
+    uint32_t type;
+    uint32_t size;
+    uint32_t channel;
+    uint32_t name_size;
+    uint32_t type_name_size;
+    uint32_t source_name_size;
+    uint32_t mem_type_size;
+    uint32_t file_type_size;
+};
+
+
+// Followed by the record
+struct EntryMessage
+{
+    uint32_t type;
+    uint32_t size;
+    uint32_t channel;
+    uint32_t reserved;
+    uint64_t timestamp;
+};
+
+
+static size_t padded(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+
+static std::string control_name(std::string const& service)
+{
+    return "/hdf5r." + service;
+}
+
+
+static char* ring_data(LogRing* ring)
+{
+    return reinterpret_cast<char*>(ring + 1);
+}
+
+
+static bool process_exists(int pid)
+{
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LogClient class
+///////////////////////////////////////////////////////////////////////////////
+
+
+LogClient::LogClient(std::string const& service, size_t ring_bytes)
+    : daemon_pid_(0), ring_(0), mapped_(0), reserved_head_(0)
+{
+    std::string name(control_name(service));
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error("No logging daemon for service " + service);
+    }
+    void* mem = mmap(0, sizeof(LogControl), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map logging service " + service);
+    }
+    LogControl* control(static_cast<LogControl*>(mem));
+    daemon_pid_ = control->daemon_pid;
+    if (__atomic_load_n(&control->magic, __ATOMIC_ACQUIRE) != CONTROL_MAGIC ||
+            !process_exists(daemon_pid_))
+    {
+        munmap(control, sizeof(LogControl));
+        throw std::runtime_error("Logging daemon for service " + service +
+                " is not running");
+    }
+    ClientSlot* slot(0);
+    for (size_t ii(0); ii < MAX_CLIENTS && slot == 0; ++ii)
+    {
+        uint32_t expected(SLOT_FREE);
+        if (__atomic_compare_exchange_n(&control->slots[ii].state, &expected,
+                    SLOT_CLAIMED, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            slot = &control->slots[ii];
+            slot->pid = getpid();
+        }
+    }
+    if (slot == 0)
+    {
+        munmap(control, sizeof(LogControl));
+        throw std::runtime_error("Too many clients of logging service " +
+                service);
+    }
+
+    std::ostringstream seg_name;
+    seg_name << name << '.' << (slot - control->slots) << '.' << getpid();
+    segment_ = seg_name.str();
+    size_t size(4096);
+    while (size < ring_bytes)
+    {
+        size <<= 1;
+    }
+    mapped_ = sizeof(LogRing) + size;
+    std::string error;
+    fd = -1;
+    if (segment_.size() >= SEGMENT_NAME_SIZE)
+    {
+        error = "Logging service name too long: " + service;
+    }
+    else if ((fd = shm_open(segment_.c_str(), O_RDWR | O_CREAT | O_EXCL,
+                    0600)) < 0 || ftruncate(fd, mapped_) < 0 ||
+            (mem = mmap(0, mapped_, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                        0)) == MAP_FAILED)
+    {
+        error = "Failed to make ring for logging service " + service;
+        if (fd >= 0)
+        {
+            shm_unlink(segment_.c_str());
+        }
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (!error.empty())
+    {
+        __atomic_store_n(&slot->state, SLOT_FREE, __ATOMIC_RELEASE);
+        munmap(control, sizeof(LogControl));
+        throw std::runtime_error(error);
+    }
+    // The new segment is zero-filled
+    ring_ = static_cast<LogRing*>(mem);
+    ring_->size = size;
+    ring_->pid = getpid();
+    strncpy(slot->segment, segment_.c_str(), SEGMENT_NAME_SIZE);
+    __atomic_store_n(&slot->state, SLOT_READY, __ATOMIC_RELEASE);
+    munmap(control, sizeof(LogControl));
+}
+
+
+LogClient::~LogClient()
+{
+    __atomic_store_n(&ring_->closed, 1, __ATOMIC_RELEASE);
+    munmap(ring_, mapped_);
+    // The daemon unlinks the ring when it attaches, unless it has gone
+    if (!process_exists(daemon_pid_))
+    {
+        shm_unlink(segment_.c_str());
+    }
+}
+
+
+LogChannel LogClient::add_channel(std::string const& name,
+        std::string const& type_name, std::string const& source_name,
+        hid_t mem_type, hid_t file_type)
+{
+    // Variable-length data would be pointers into this process's memory
+    if (H5Tdetect_class(mem_type, H5T_VLEN) > 0 ||
+            H5Tdetect_class(file_type, H5T_VLEN) > 0)
+    {
+        throw std::runtime_error("Logged records must be of fixed size");
+    }
+    size_t mem_type_size(0), file_type_size(0);
+    if (H5Tencode(mem_type, 0, &mem_type_size) < 0 ||
+            H5Tencode(file_type, 0, &file_type_size) < 0)
+    {
+        throw std::runtime_error("Failed to encode types of channel " + name);
+    }
+    size_t size(padded(sizeof(ChannelMessage) + name.size() +
+                type_name.size() + source_name.size() + mem_type_size +
+                file_type_size));
+    size_t record_size(H5Tget_size(mem_type));
+    if (size > ring_->size / 2 ||
+            padded(sizeof(EntryMessage) + record_size) > ring_->size / 2)
+    {
+        throw std::runtime_error("Logging ring too small for channel " +
+                name);
+    }
+    // Channels must not be dropped, so wait a while for the daemon to make
+    // room
+    char* msg(0);
+    for (int ii(0); ii < 10000 && (msg = reserve_message(size)) == 0; ++ii)
+    {
+        usleep(1000);
+    }
+    if (msg == 0)
+    {
+        throw std::runtime_error("Logging daemon is not taking records");
+    }
+    ChannelMessage header = {MSG_CHANNEL, static_cast<uint32_t>(size),
+        static_cast<uint32_t>(record_sizes_.size()),
+        static_cast<uint32_t>(name.size()),
+        static_cast<uint32_t>(type_name.size()),
+        static_cast<uint32_t>(source_name.size()),
+        static_cast<uint32_t>(mem_type_size),
+        static_cast<uint32_t>(file_type_size)};
+    memcpy(msg, &header, sizeof(header));
+    char* pos(msg + sizeof(header));
+    memcpy(pos, name.data(), name.size());
+    pos += name.size();
+    memcpy(pos, type_name.data(), type_name.size());
+    pos += type_name.size();
+    memcpy(pos, source_name.data(), source_name.size());
+    pos += source_name.size();
+    H5Tencode(mem_type, pos, &mem_type_size);
+    pos += mem_type_size;
+    H5Tencode(file_type, pos, &file_type_size);
+    __atomic_store_n(&ring_->head, reserved_head_, __ATOMIC_RELEASE);
+    record_sizes_.push_back(record_size);
+    return record_sizes_.size() - 1;
+}
+
+
+void* LogClient::reserve(LogChannel chan, uint64_t timestamp)
+{
+    if (chan >= record_sizes_.size())
+    {
+        throw std::runtime_error("Bad logging channel");
+    }
+    size_t size(padded(sizeof(EntryMessage) + record_sizes_[chan]));
+    char* msg(reserve_message(size));
+    if (msg == 0)
+    {
+        __atomic_store_n(&ring_->dropped, ring_->dropped + 1,
+                __ATOMIC_RELAXED);
+        return 0;
+    }
+    EntryMessage header = {MSG_ENTRY, static_cast<uint32_t>(size), chan, 0,
+        timestamp};
+    memcpy(msg, &header, sizeof(header));
+    return msg + sizeof(header);
+}
+
+
+void LogClient::commit()
+{
+    if (reserved_head_ == ring_->head)
+    {
+        return;
+    }
+    __atomic_store_n(&ring_->sent, ring_->sent + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring_->head, reserved_head_, __ATOMIC_RELEASE);
+}
+
+
+bool LogClient::add_entry(LogChannel chan, uint64_t timestamp,
+        void const* const buf)
+{
+    void* dest(reserve(chan, timestamp));
+    if (dest == 0)
+    {
+        return false;
+    }
+    memcpy(dest, buf, record_sizes_[chan]);
+    commit();
+    return true;
+}
+
+
+uint64_t LogClient::sent() const
+{
+    return ring_->sent;
+}
+
+
+uint64_t LogClient::dropped() const
+{
+    return ring_->dropped;
+}
+
+
+char* LogClient::reserve_message(size_t size)
+{
+    uint64_t head(ring_->head);
+    uint64_t tail(__atomic_load_n(&ring_->tail, __ATOMIC_ACQUIRE));
+    size_t offset(head & (ring_->size - 1));
+    size_t to_end(ring_->size - offset);
+    size_t skip(size > to_end ? to_end : 0);
+    if (head + skip + size - tail > ring_->size)
+    {
+        return 0;
+    }
+    if (skip > 0)
+    {
+        MessageHeader pad = {MSG_PAD, static_cast<uint32_t>(skip)};
+        memcpy(ring_data(ring_) + offset, &pad, sizeof(pad));
+        offset = 0;
+    }
+    reserved_head_ = head + skip + size;
+    return ring_data(ring_) + offset;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// LogDaemon class
+///////////////////////////////////////////////////////////////////////////////
+
+
+struct hdf5r::LogBatch
+{
+    std::vector<uint64_t> timestamps;
+    std::vector<char> records;
+};
+
+
+struct hdf5r::LogDaemonClient
+{
+    size_t slot;
+    LogRing* ring;
+    size_t mapped;
+    // The file's channel for each of the client's, and their record sizes
+    std::vector<ChannelID> channels;
+    std::vector<size_t> record_sizes;
+    // Set when the client sent something that made no sense
+    bool broken;
+    LogClientStats stats;
+};
+
+
+LogDaemon::LogDaemon(HDF5R& file, std::string const& service,
+        size_t batch_records)
+    : file_(file), name_(control_name(service)), control_(0),
+    batch_records_(std::max<size_t>(batch_records, 1))
+{
+    int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST)
+    {
+        // A daemon that did not exit cleanly leaves its segment behind
+        fd = shm_open(name_.c_str(), O_RDWR, 0);
+        void* mem(fd < 0 ? MAP_FAILED : mmap(0, sizeof(LogControl),
+                    PROT_READ, MAP_SHARED, fd, 0));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (mem != MAP_FAILED)
+        {
+            LogControl const* old(static_cast<LogControl const*>(mem));
+            bool running(old->magic == CONTROL_MAGIC &&
+                    process_exists(old->daemon_pid));
+            munmap(mem, sizeof(LogControl));
+            if (running)
+            {
+                throw std::runtime_error("Logging service " + service +
+                        " is already being served");
+            }
+        }
+        shm_unlink(name_.c_str());
+        fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    void* mem(MAP_FAILED);
+    if (fd >= 0)
+    {
+        if (ftruncate(fd, sizeof(LogControl)) == 0)
+        {
+            mem = mmap(0, sizeof(LogControl), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (mem == MAP_FAILED)
+    {
+        if (fd >= 0)
+        {
+            shm_unlink(name_.c_str());
+        }
+        throw std::runtime_error("Failed to start logging service " +
+                service);
+    }
+    control_ = static_cast<LogControl*>(mem);
+    control_->daemon_pid = getpid();
+    __atomic_store_n(&control_->magic, CONTROL_MAGIC, __ATOMIC_RELEASE);
+}
+
+
+LogDaemon::~LogDaemon()
+{
+    // Stop new clients connecting before letting go of the current ones
+    __atomic_store_n(&control_->magic, 0, __ATOMIC_RELEASE);
+    shm_unlink(name_.c_str());
+    while (!clients_.empty())
+    {
+        detach(clients_.size() - 1);
+    }
+    munmap(control_, sizeof(LogControl));
+    for (std::map<ChannelID, LogBatch*>::iterator ii(batches_.begin());
+            ii != batches_.end(); ++ii)
+    {
+        delete ii->second;
+    }
+}
+
+
+size_t LogDaemon::drain()
+{
+    attach_clients();
+    size_t taken(0);
+    for (size_t ii(0); ii < clients_.size(); ++ii)
+    {
+        taken += drain_client(*clients_[ii], batch_records_);
+    }
+    // Each channel's records are written together, whichever clients they
+    // came from
+    for (std::map<ChannelID, LogBatch*>::iterator ii(batches_.begin());
+            ii != batches_.end(); ++ii)
+    {
+        LogBatch& batch(*ii->second);
+        if (!batch.timestamps.empty())
+        {
+            file_.add_entries(ii->first, batch.timestamps.size(),
+                    &batch.timestamps[0], &batch.records[0]);
+            batch.timestamps.clear();
+            batch.records.clear();
+        }
+    }
+    // Clients that have gone are detached once their rings are empty
+    for (size_t ii(clients_.size()); ii > 0; --ii)
+    {
+        LogDaemonClient& client(*clients_[ii - 1]);
+        LogRing& ring(*client.ring);
+        // Whether it has gone is checked first, so that the head read after
+        // is its last
+        bool gone(__atomic_load_n(&ring.closed, __ATOMIC_ACQUIRE) != 0 ||
+                !process_exists(ring.pid));
+        if (client.broken || (gone &&
+                    ring.tail == __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE)))
+        {
+            detach(ii - 1);
+        }
+    }
+    return taken;
+}
+
+
+void LogDaemon::run(volatile sig_atomic_t const& stop)
+{
+    while (!stop)
+    {
+        if (drain() == 0)
+        {
+            usleep(1000);
+        }
+    }
+    while (drain() > 0)
+    {
+    }
+}
+
+
+std::vector<LogClientStats> LogDaemon::client_stats() const
+{
+    std::vector<LogClientStats> result(departed_);
+    for (size_t ii(0); ii < clients_.size(); ++ii)
+    {
+        result.push_back(clients_[ii]->stats);
+        result.back().dropped = clients_[ii]->ring->dropped;
+    }
+    return result;
+}
+
+
+void LogDaemon::attach_clients()
+{
+    for (size_t ii(0); ii < MAX_CLIENTS; ++ii)
+    {
+        ClientSlot& slot(control_->slots[ii]);
+        uint32_t state(__atomic_load_n(&slot.state, __ATOMIC_ACQUIRE));
+        if (state == SLOT_CLAIMED && !process_exists(slot.pid))
+        {
+            // The client exited while connecting
+            __atomic_store_n(&slot.state, SLOT_FREE, __ATOMIC_RELEASE);
+            continue;
+        }
+        if (state != SLOT_READY)
+        {
+            continue;
+        }
+        char segment[SEGMENT_NAME_SIZE + 1];
+        memcpy(segment, slot.segment, SEGMENT_NAME_SIZE);
+        segment[SEGMENT_NAME_SIZE] = '\0';
+        int fd = shm_open(segment, O_RDWR, 0);
+        struct stat info;
+        void* mem(MAP_FAILED);
+        if (fd >= 0)
+        {
+            if (fstat(fd, &info) == 0 &&
+                    info.st_size >= static_cast<off_t>(sizeof(LogRing)))
+            {
+                mem = mmap(0, info.st_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            shm_unlink(segment);
+        }
+        LogRing* ring(static_cast<LogRing*>(mem));
+        if (mem == MAP_FAILED ||
+                sizeof(LogRing) + ring->size !=
+                static_cast<uint64_t>(info.st_size))
+        {
+            if (mem != MAP_FAILED)
+            {
+                munmap(mem, info.st_size);
+            }
+            __atomic_store_n(&slot.state, SLOT_FREE, __ATOMIC_RELEASE);
+            continue;
+        }
+        LogDaemonClient* client(new LogDaemonClient);
+        client->slot = ii;
+        client->ring = ring;
+        client->mapped = info.st_size;
+        client->broken = false;
+        client->stats.pid = slot.pid;
+        client->stats.connected = true;
+        clients_.push_back(client);
+        __atomic_store_n(&slot.state, SLOT_ATTACHED, __ATOMIC_RELEASE);
+    }
+}
+
+
+size_t LogDaemon::drain_client(LogDaemonClient& client, size_t budget)
+{
+    LogRing& ring(*client.ring);
+    char const* data(ring_data(&ring));
+    uint64_t mask(ring.size - 1);
+    uint64_t head(__atomic_load_n(&ring.head, __ATOMIC_ACQUIRE));
+    uint64_t tail(ring.tail);
+    size_t taken(0);
+    while (tail < head && taken < budget && !client.broken)
+    {
+        char const* msg(data + (tail & mask));
+        MessageHeader header;
+        memcpy(&header, msg, sizeof(header));
+        if (header.size < sizeof(header) || header.size % 8 != 0 ||
+                header.size > head - tail)
+        {
+            client.broken = true;
+            break;
+        }
+        if (header.type == MSG_CHANNEL)
+        {
+            add_client_channel(client, msg, header.size);
+        }
+        else if (header.type == MSG_ENTRY)
+        {
+            EntryMessage entry;
+            memcpy(&entry, msg, sizeof(entry));
+            if (entry.channel >= client.channels.size() ||
+                    header.size < sizeof(entry) +
+                    client.record_sizes[entry.channel])
+            {
+                client.broken = true;
+                break;
+            }
+            size_t record_size(client.record_sizes[entry.channel]);
+            LogBatch*& batch(batches_[client.channels[entry.channel]]);
+            if (batch == 0)
+            {
+                batch = new LogBatch;
+            }
+            batch->timestamps.push_back(entry.timestamp);
+            batch->records.insert(batch->records.end(), msg + sizeof(entry),
+                    msg + sizeof(entry) + record_size);
+            ++client.stats.records;
+            client.stats.bytes += record_size;
+            ++taken;
+        }
+        tail += header.size;
+    }
+    // The records have been copied out, so their space can be reused
+    __atomic_store_n(&ring.tail, tail, __ATOMIC_RELEASE);
+    return taken;
+}
+
+
+void LogDaemon::add_client_channel(LogDaemonClient& client, char const* msg,
+        size_t size)
+{
+    ChannelMessage header;
+    memcpy(&header, msg, sizeof(header));
+    if (header.channel != client.channels.size() ||
+            sizeof(header) + static_cast<size_t>(header.name_size) +
+            header.type_name_size + header.source_name_size +
+            header.mem_type_size + header.file_type_size > size)
+    {
+        client.broken = true;
+        return;
+    }
+    char const* pos(msg + sizeof(header));
+    std::string name(pos, header.name_size);
+    pos += header.name_size;
+    std::string type_name(pos, header.type_name_size);
+    pos += header.type_name_size;
+    std::string source_name(pos, header.source_name_size);
+    pos += header.source_name_size;
+    hid_t mem_type = H5Tdecode(pos);
+    pos += header.mem_type_size;
+    hid_t file_type = H5Tdecode(pos);
+    try
+    {
+        if (mem_type < 0 || file_type < 0)
+        {
+            throw std::runtime_error("Bad channel types");
+        }
+        ChannelID id(0);
+        if (file_.have_channel(name))
+        {
+            // Another client's, or this one's from before it reconnected;
+            // the records must be the same
+            id = file_.get_channel_id(name);
+            if (H5Tequal(file_.get_channel_info(id).mem_type(),
+                        mem_type) <= 0)
+            {
+                throw std::runtime_error("Channel type mismatch");
+            }
+        }
+        else
+        {
+            id = file_.add_channel(name, type_name, source_name, mem_type,
+                    file_type);
+        }
+        client.channels.push_back(id);
+        client.record_sizes.push_back(H5Tget_size(mem_type));
+    }
+    catch (std::runtime_error const&)
+    {
+        client.broken = true;
+    }
+    if (file_type >= 0)
+    {
+        H5Tclose(file_type);
+    }
+    if (mem_type >= 0)
+    {
+        H5Tclose(mem_type);
+    }
+}
+
+
+void LogDaemon::detach(size_t client)
+{
+    LogDaemonClient* gone(clients_[client]);
+    departed_.push_back(gone->stats);
+    departed_.back().dropped = gone->ring->dropped;
+    departed_.back().connected = false;
+    munmap(gone->ring, gone->mapped);
+    __atomic_store_n(&control_->slots[gone->slot].state, SLOT_FREE,
+            __ATOMIC_RELEASE);
+    delete gone;
+    clients_.erase(clients_.begin() + client);
+}
+
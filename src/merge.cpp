@@ -0,0 +1,100 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Merging of several files into one.
+ */
+
+#include <hdf5r/merge.h>
+
+#include <cstdio>
+#include <set>
+#include <time.h>
+
+using namespace hdf5r;
+
+
+// A name not yet used, made from the given one and the input's number if
+// necessary
+static std::string unique_name(std::set<std::string>& used,
+        std::string const& name, size_t input)
+{
+    std::string result(name);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%u",
+            static_cast<unsigned int>(input + 1));
+    while (used.find(result) != used.end())
+    {
+        result += suffix;
+    }
+    used.insert(result);
+    return result;
+}
+
+
+static void copy_tags(HDF5R& input, HDF5R& output, size_t input_num,
+        std::set<std::string>& used, MergeStats& stats)
+{
+    TagMap tags(input.get_all_tags());
+    for (TagMap::const_iterator ii(tags.begin()); ii != tags.end(); ++ii)
+    {
+        std::string name(unique_name(used, ii->first, input_num));
+        if (ii->second.type == STRING_TAG)
+        {
+            output.set_text_tag(name, ii->second.value);
+        }
+        else
+        {
+            output.set_binary_tag(name, ii->second.value.data(),
+                    ii->second.value.size());
+        }
+        ++stats.tags;
+    }
+}
+
+
+MergeStats hdf5r::merge_files(std::vector<std::string> const& inputs,
+        std::string const& output, FileProfile const& profile)
+{
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    MergeStats stats;
+    HDF5R out(output, TRUNCATE, profile);
+    std::set<std::string> channel_names, tag_names;
+    std::vector<IndexSource> sources;
+    for (size_t ii(0); ii < inputs.size(); ++ii)
+    {
+        HDF5R in(inputs[ii], RDONLY);
+        IndexSource source(inputs[ii], ChannelMap());
+        std::vector<ChannelID> channels(in.channels());
+        for (std::vector<ChannelID>::const_iterator jj(channels.begin());
+                jj != channels.end(); ++jj)
+        {
+            ChannelInfo info(in.get_channel_info(*jj));
+            ChannelMapping mapping = {out.copy_channel(in, *jj,
+                    unique_name(channel_names, info.name(), ii), 0,
+                    info.size(), &stats.copied), 0, info.size()};
+            source.second[*jj] = mapping;
+            ++stats.channels;
+        }
+        copy_tags(in, out, ii, tag_names, stats);
+        sources.push_back(source);
+    }
+    // The inputs are closed again before their indexes are read
+    stats.index_records = out.merge_index(sources);
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    stats.seconds = (finished.tv_sec - started.tv_sec) +
+        (finished.tv_nsec - started.tv_nsec) / 1e9;
+    return stats;
+}
+
@@ -0,0 +1,222 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * File format and layout properties.
+ */
+
+#include <hdf5r/profile.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace hdf5r;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// FileProfile class
+///////////////////////////////////////////////////////////////////////////////
+
+
+FileProfile::FileProfile()
+    : libver_low_(H5F_LIBVER_EARLIEST), libver_high_(H5F_LIBVER_LATEST),
+    fs_strategy_(H5F_FSPACE_STRATEGY_FSM_AGGR), fs_persist_(false),
+    fs_threshold_(1), page_size_(4096), page_buffer_size_(0),
+    align_threshold_(1), alignment_(1), meta_block_size_(2048),
+    small_data_block_size_(2048), mdc_initial_(0), mdc_max_(0),
+    max_open_channels_(0), driver_(SEC2)
+{
+}
+
+
+FileProfile FileProfile::write_heavy_logger()
+{
+    FileProfile result;
+    // The latest format indexes chunks of growing data sets with an
+    // extensible array, which appends in constant time
+    result.libver_bounds(H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+    // Nothing is deleted from a log, so there is no free space worth
+    // persisting. Larger aggregation blocks keep the metadata of many
+    // channels together.
+    result.file_space(H5F_FSPACE_STRATEGY_FSM_AGGR, false, 1);
+    result.meta_block_size(64 * 1024);
+    result.small_data_block_size(64 * 1024);
+    return result;
+}
+
+
+FileProfile FileProfile::archive()
+{
+    FileProfile result;
+    result.libver_bounds(H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+    // Paged aggregation keeps metadata together, so opening the file and
+    // walking its channels touches few pages, all of which the page buffer
+    // can hold
+    result.file_space(H5F_FSPACE_STRATEGY_PAGE, true, 1);
+    result.page_size(64 * 1024);
+    result.page_buffer_size(4 * 1024 * 1024);
+    // Large objects start on file system block boundaries
+    result.alignment(64 * 1024, 4096);
+    return result;
+}
+
+
+FileProfile FileProfile::preset(std::string const& name)
+{
+    if (name == "default")
+    {
+        return FileProfile();
+    }
+    else if (name == "write-heavy logger")
+    {
+        return write_heavy_logger();
+    }
+    else if (name == "archive")
+    {
+        return archive();
+    }
+    throw std::runtime_error("Unknown file profile " + name);
+}
+
+
+ChunkCache FileProfile::chunk_cache(std::string const& channel) const
+{
+    std::map<std::string, ChunkCache>::const_iterator ii(
+            channel_caches_.find(channel));
+    if (ii == channel_caches_.end())
+    {
+        return chunk_cache_;
+    }
+    return ii->second;
+}
+
+
+void FileProfile::access_pattern(AccessPattern pattern)
+{
+    switch (pattern)
+    {
+        case SEQUENTIAL:
+            // Each chunk is finished with once it has been read through
+            chunk_cache_ = ChunkCache(521, 1024 * 1024, 1.0);
+            mdc_initial_ = 0;
+            mdc_max_ = 0;
+            break;
+        case RANDOM:
+            // Hold as much of each channel as is reasonable, and all of the
+            // chunk indices
+            chunk_cache_ = ChunkCache(100003, 64 * 1024 * 1024, 0.75);
+            mdc_initial_ = 16 * 1024 * 1024;
+            mdc_max_ = 128 * 1024 * 1024;
+            break;
+        case REPLAY:
+            // Channels are read a little at a time in turn, so each needs
+            // only its current chunks, but the metadata of all of them is in
+            // use at once
+            chunk_cache_ = ChunkCache(127, 256 * 1024, 1.0);
+            mdc_initial_ = 8 * 1024 * 1024;
+            mdc_max_ = 64 * 1024 * 1024;
+            break;
+    }
+}
+
+
+hid_t FileProfile::make_fapl() const
+{
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    if (H5Pset_libver_bounds(fapl, libver_low_, libver_high_) < 0 ||
+            H5Pset_alignment(fapl, align_threshold_, alignment_) < 0 ||
+            H5Pset_meta_block_size(fapl, meta_block_size_) < 0 ||
+            H5Pset_small_data_block_size(fapl, small_data_block_size_) < 0 ||
+            (page_buffer_size_ > 0 &&
+             H5Pset_page_buffer_size(fapl, page_buffer_size_, 0, 0) < 0) ||
+            H5Pset_cache(fapl, 0, chunk_cache_.slots(), chunk_cache_.bytes(),
+                chunk_cache_.w0()) < 0)
+    {
+        H5Pclose(fapl);
+        throw std::runtime_error("Invalid file access profile");
+    }
+    if (driver_ == WRITE_BEHIND)
+    {
+        try
+        {
+            set_fapl_write_behind(fapl, write_behind_);
+        }
+        catch (...)
+        {
+            H5Pclose(fapl);
+            throw;
+        }
+    }
+    else if (driver_ == CORE)
+    {
+        if (H5Pset_fapl_core(fapl, core_image_.size(),
+                    core_image_.persist()) < 0 ||
+                (core_image_.write_page() > 0 &&
+                 H5Pset_core_write_tracking(fapl, true,
+                     core_image_.write_page()) < 0))
+        {
+            H5Pclose(fapl);
+            throw std::runtime_error("Invalid core image settings");
+        }
+    }
+    if (mdc_initial_ > 0 || mdc_max_ > 0)
+    {
+        H5AC_cache_config_t config;
+        config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+        H5Pget_mdc_config(fapl, &config);
+        if (mdc_max_ > 0)
+        {
+            config.max_size = mdc_max_;
+            config.min_size = std::min(config.min_size, mdc_max_);
+        }
+        if (mdc_initial_ > 0)
+        {
+            config.set_initial_size = 1;
+            config.initial_size = mdc_initial_;
+            config.max_size = std::max(config.max_size, mdc_initial_);
+        }
+        if (H5Pset_mdc_config(fapl, &config) < 0)
+        {
+            H5Pclose(fapl);
+            throw std::runtime_error("Invalid metadata cache size");
+        }
+    }
+    return fapl;
+}
+
+
+hid_t FileProfile::make_fcpl() const
+{
+    hid_t fcpl = H5Pcreate(H5P_FILE_CREATE);
+    if (H5Pset_file_space_strategy(fcpl, fs_strategy_, fs_persist_,
+                fs_threshold_) < 0 ||
+            H5Pset_file_space_page_size(fcpl, page_size_) < 0)
+    {
+        H5Pclose(fcpl);
+        throw std::runtime_error("Invalid file creation profile");
+    }
+    return fcpl;
+}
+
+
+hid_t FileProfile::make_dapl(std::string const& channel) const
+{
+    ChunkCache cache(chunk_cache(channel));
+    hid_t dapl = H5Pcreate(H5P_DATASET_ACCESS);
+    if (H5Pset_chunk_cache(dapl, cache.slots(), cache.bytes(),
+                cache.w0()) < 0)
+    {
+        H5Pclose(dapl);
+        throw std::runtime_error("Invalid chunk cache for channel " +
+                channel);
+    }
+    return dapl;
+}
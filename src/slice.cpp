@@ -0,0 +1,85 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Extraction of a time window of a file into a new file.
+ */
+
+#include <hdf5r/slice.h>
+
+#include <algorithm>
+#include <time.h>
+
+using namespace hdf5r;
+
+
+SliceStats hdf5r::slice_file(HDF5R& input, std::string const& output,
+        uint64_t start, uint64_t end, std::vector<std::string> const& channels,
+        FileProfile const& profile, bool align_chunks)
+{
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    std::vector<ChannelID> ids;
+    if (channels.empty())
+    {
+        ids = input.channels();
+    }
+    for (std::vector<std::string>::const_iterator ii(channels.begin());
+            ii != channels.end(); ++ii)
+    {
+        ids.push_back(input.get_channel_id(*ii));
+    }
+
+    SliceStats stats;
+    HDF5R out(output, TRUNCATE, profile);
+    for (std::vector<ChannelID>::const_iterator ii(ids.begin());
+            ii != ids.end(); ++ii)
+    {
+        hsize_t first(input.find_entry(*ii, start));
+        hsize_t last(std::max(first, input.find_entry(*ii, end)));
+        if (align_chunks && first < last)
+        {
+            hsize_t aligned(input.chunk_start(*ii, first));
+            stats.leading_records += first - aligned;
+            first = aligned;
+        }
+        ChannelInfo info(input.get_channel_info(*ii));
+        out.copy_channel(input, *ii, info.name(), first, last,
+                &stats.copied);
+        ++stats.channels;
+    }
+
+    TagMap tags(input.get_all_tags());
+    for (TagMap::const_iterator ii(tags.begin()); ii != tags.end(); ++ii)
+    {
+        if (ii->second.type == STRING_TAG)
+        {
+            out.set_text_tag(ii->first, ii->second.value);
+        }
+        else
+        {
+            out.set_binary_tag(ii->first, ii->second.value.data(),
+                    ii->second.value.size());
+        }
+    }
+
+    // Index the copied records from their time stamps, which costs time in
+    // proportion to the window rather than to the whole of the input's index
+    out.rebuild_index();
+    stats.index_records = out.index().size();
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    stats.seconds = (finished.tv_sec - started.tv_sec) +
+        (finished.tv_nsec - started.tv_nsec) / 1e9;
+    return stats;
+}
+
@@ -0,0 +1,1095 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Write-behind file driver.
+ */
+
+#include <hdf5r/vfd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+#if defined(HDF5R_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace hdf5r;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Driver state
+///////////////////////////////////////////////////////////////////////////////
+
+
+// The driver's options as stored in a file access property list
+struct WriteBehindConfig
+{
+    size_t buffer_size;
+    size_t buffers;
+    size_t alignment;
+    hbool_t direct;
+    hbool_t io_uring;
+};
+
+
+struct WriteBuffer;
+
+
+// One background write of part of a buffer
+struct WriteOp
+{
+    WriteBuffer* buf;
+    int fd;
+    struct iovec iov;
+    haddr_t addr;
+};
+
+
+// Writes to a contiguous range of the file. The buffer's memory starts at a
+// file address that is a multiple of the alignment, so that the aligned part
+// of the range can be written directly.
+struct WriteBuffer
+{
+    char* mem;
+    haddr_t base;
+    // Offsets into mem of the bytes that have been written
+    size_t lo, hi;
+    // Background writes of the buffer that have not finished
+    unsigned int pending;
+    // A buffer is written in at most three parts: an unaligned head and tail
+    // through the page cache, and the aligned middle directly
+    WriteOp ops[3];
+};
+
+
+class Ring;
+
+
+// Buffers are only filled and submitted by the thread calling into the
+// driver. The lock protects the pending counts and the error, which the
+// writer thread changes.
+struct WriteBehindFile
+{
+    H5FD_t pub;
+    WriteBehindConfig config;
+    int fd;
+    // Opened with O_DIRECT, or -1
+    int direct_fd;
+    dev_t device;
+    ino_t inode;
+    haddr_t eoa, eof;
+    std::vector<WriteBuffer> buffers;
+    WriteBuffer* current;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    // The errno of the first background write that failed
+    int error;
+    Ring* ring;
+    // Writer thread, used when there is no ring
+    bool writer;
+    pthread_t thread;
+    pthread_cond_t queued;
+    std::deque<WriteOp*> queue;
+    bool stop;
+};
+
+
+// Write all of a range, returning zero or an errno
+static int write_all(int fd, char const* data, size_t size, haddr_t addr)
+{
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, data, size, addr);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        if (n == 0)
+        {
+            return EIO;
+        }
+        data += n;
+        size -= n;
+        addr += n;
+    }
+    return 0;
+}
+
+
+// Mark a background write finished. The caller holds the lock.
+static void finish_op(WriteBehindFile* file, WriteOp* op, int error)
+{
+    if (error != 0 && file->error == 0)
+    {
+        file->error = error;
+    }
+    --op->buf->pending;
+    pthread_cond_broadcast(&file->done);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// io_uring submission
+///////////////////////////////////////////////////////////////////////////////
+
+
+// A minimal io_uring, used through the system calls directly so as not to
+// depend on liburing. Only the calling thread touches it.
+class Ring
+{
+    public:
+        Ring() : fd_(-1) {}
+        ~Ring() { close(); }
+
+        // False if the kernel doesn't support io_uring
+        bool open(unsigned int entries);
+        void close();
+        // False if the submission queue is full
+        bool submit(WriteOp* op);
+        // Finish completed writes, first waiting for one if wait is set.
+        // Returns the number finished.
+        unsigned int reap(WriteBehindFile* file, bool wait);
+
+    private:
+        int fd_;
+#if defined(HDF5R_HAVE_IO_URING)
+        void* sq_ptr_;
+        size_t sq_size_;
+        void* cq_ptr_;
+        size_t cq_size_;
+        struct io_uring_sqe* sqes_;
+        size_t sqes_size_;
+        unsigned int* sq_head_;
+        unsigned int* sq_tail_;
+        unsigned int sq_mask_;
+        unsigned int* sq_array_;
+        unsigned int* cq_head_;
+        unsigned int* cq_tail_;
+        unsigned int cq_mask_;
+        struct io_uring_cqe* cqes_;
+#endif
+};
+
+
+#if defined(HDF5R_HAVE_IO_URING)
+
+bool Ring::open(unsigned int entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size_ = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single(params.features & IORING_FEAT_SINGLE_MMAP);
+    if (single)
+    {
+        sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = mmap(0, sq_size_, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+    {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    cq_ptr_ = sq_ptr_;
+    if (!single)
+    {
+        cq_ptr_ = mmap(0, cq_size_, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED)
+        {
+            munmap(sq_ptr_, sq_size_);
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(0, sqes_size_, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        if (cq_ptr_ != sq_ptr_)
+        {
+            munmap(cq_ptr_, cq_size_);
+        }
+        munmap(sq_ptr_, sq_size_);
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+    char* sq(static_cast<char*>(sq_ptr_));
+    sq_head_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned int*>(sq +
+            params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    char* cq(static_cast<char*>(cq_ptr_));
+    cq_head_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned int*>(cq +
+            params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+
+void Ring::close()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    munmap(sqes_, sqes_size_);
+    if (cq_ptr_ != sq_ptr_)
+    {
+        munmap(cq_ptr_, cq_size_);
+    }
+    munmap(sq_ptr_, sq_size_);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+
+bool Ring::submit(WriteOp* op)
+{
+    unsigned int tail(*sq_tail_);
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) > sq_mask_)
+    {
+        return false;
+    }
+    unsigned int index(tail & sq_mask_);
+    struct io_uring_sqe* sqe(&sqes_[index]);
+    memset(sqe, 0, sizeof(*sqe));
+    // Vectored writes are the oldest write operation io_uring has
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = op->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&op->iov);
+    sqe->len = 1;
+    sqe->off = op->addr;
+    sqe->user_data = reinterpret_cast<uint64_t>(op);
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, fd_, 1, 0, 0, 0, 0) < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            // The entry stays queued and goes with the next submission
+            return true;
+        }
+    }
+    return true;
+}
+
+
+unsigned int Ring::reap(WriteBehindFile* file, bool wait)
+{
+    unsigned int head(*cq_head_);
+    if (wait && head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+    {
+        // Also submits anything left queued by an interrupted enter
+        unsigned int queued(*sq_tail_ -
+                __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE));
+        syscall(__NR_io_uring_enter, fd_, queued, 1,
+                IORING_ENTER_GETEVENTS, 0, 0);
+    }
+    unsigned int tail(__atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE));
+    unsigned int count(0);
+    pthread_mutex_lock(&file->lock);
+    for (; head != tail; ++head, ++count)
+    {
+        struct io_uring_cqe* cqe(&cqes_[head & cq_mask_]);
+        WriteOp* op(reinterpret_cast<WriteOp*>(cqe->user_data));
+        int error(0);
+        if (cqe->res < 0)
+        {
+            error = -cqe->res;
+        }
+        else if (static_cast<size_t>(cqe->res) < op->iov.iov_len)
+        {
+            // Finish a short write here rather than queueing the rest
+            size_t done(cqe->res);
+            error = write_all(op->fd,
+                    static_cast<char const*>(op->iov.iov_base) + done,
+                    op->iov.iov_len - done, op->addr + done);
+        }
+        finish_op(file, op, error);
+    }
+    pthread_mutex_unlock(&file->lock);
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+#else // defined(HDF5R_HAVE_IO_URING)
+
+bool Ring::open(unsigned int entries)
+{
+    return false;
+}
+
+
+void Ring::close()
+{
+}
+
+
+bool Ring::submit(WriteOp* op)
+{
+    return false;
+}
+
+
+unsigned int Ring::reap(WriteBehindFile* file, bool wait)
+{
+    return 0;
+}
+
+#endif // defined(HDF5R_HAVE_IO_URING)
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Writer thread submission
+///////////////////////////////////////////////////////////////////////////////
+
+
+static void* writer_main(void* arg)
+{
+    WriteBehindFile* file(static_cast<WriteBehindFile*>(arg));
+    pthread_mutex_lock(&file->lock);
+    while (true)
+    {
+        while (file->queue.empty() && !file->stop)
+        {
+            pthread_cond_wait(&file->queued, &file->lock);
+        }
+        if (file->queue.empty())
+        {
+            break;
+        }
+        WriteOp* op(file->queue.front());
+        file->queue.pop_front();
+        pthread_mutex_unlock(&file->lock);
+        int error(write_all(op->fd, static_cast<char const*>(op->iov.iov_base),
+                    op->iov.iov_len, op->addr));
+        pthread_mutex_lock(&file->lock);
+        finish_op(file, op, error);
+    }
+    pthread_mutex_unlock(&file->lock);
+    return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Buffer management
+///////////////////////////////////////////////////////////////////////////////
+
+
+// Size of each buffer's memory: the buffer size rounded up to the alignment
+static size_t capacity(WriteBehindFile const* file)
+{
+    size_t align(file->config.alignment);
+    return (file->config.buffer_size + align - 1) / align * align;
+}
+
+
+static bool in_flight(WriteBehindFile* file, WriteBuffer const& buf)
+{
+    pthread_mutex_lock(&file->lock);
+    bool result(buf.pending > 0);
+    pthread_mutex_unlock(&file->lock);
+    return result;
+}
+
+
+// Total of the buffers' pending writes. The caller holds the lock.
+static unsigned int pending_ops(WriteBehindFile const* file)
+{
+    unsigned int result(0);
+    for (size_t ii(0); ii < file->buffers.size(); ++ii)
+    {
+        result += file->buffers[ii].pending;
+    }
+    return result;
+}
+
+
+// Wait for at least one background write to finish. Returns false if none
+// are in progress.
+static bool wait_any(WriteBehindFile* file)
+{
+    pthread_mutex_lock(&file->lock);
+    unsigned int before(pending_ops(file));
+    if (before == 0)
+    {
+        pthread_mutex_unlock(&file->lock);
+        return false;
+    }
+    if (file->ring)
+    {
+        // Completions are only handled by this thread, in reap()
+        pthread_mutex_unlock(&file->lock);
+        file->ring->reap(file, true);
+        return true;
+    }
+    while (pending_ops(file) >= before)
+    {
+        pthread_cond_wait(&file->done, &file->lock);
+    }
+    pthread_mutex_unlock(&file->lock);
+    return true;
+}
+
+
+// Wait for all background writes to finish
+static void drain(WriteBehindFile* file)
+{
+    while (wait_any(file))
+    {
+    }
+}
+
+
+static void queue_op(WriteBehindFile* file, WriteOp* op)
+{
+    if (file->ring)
+    {
+        while (!file->ring->submit(op))
+        {
+            file->ring->reap(file, true);
+        }
+        // Keep the completion queue short
+        file->ring->reap(file, false);
+    }
+    else
+    {
+        pthread_mutex_lock(&file->lock);
+        file->queue.push_back(op);
+        pthread_cond_signal(&file->queued);
+        pthread_mutex_unlock(&file->lock);
+    }
+}
+
+
+static void set_op(WriteOp& op, WriteBuffer* buf, int fd, size_t start,
+        size_t end)
+{
+    op.buf = buf;
+    op.fd = fd;
+    op.iov.iov_base = buf->mem + start;
+    op.iov.iov_len = end - start;
+    op.addr = buf->base + start;
+}
+
+
+// Start writing the current buffer in the background
+static void submit_current(WriteBehindFile* file)
+{
+    WriteBuffer* buf(file->current);
+    file->current = 0;
+    if (!buf || buf->hi == buf->lo)
+    {
+        return;
+    }
+    // Writes of the same bytes must reach the file in order, which the
+    // background writes don't guarantee
+    haddr_t start(buf->base + buf->lo), end(buf->base + buf->hi);
+    size_t cap(capacity(file));
+    for (size_t ii(0); ii < file->buffers.size(); ++ii)
+    {
+        WriteBuffer const& other(file->buffers[ii]);
+        if (&other != buf && in_flight(file, other) &&
+                other.base < end && start < other.base + cap)
+        {
+            drain(file);
+            break;
+        }
+    }
+
+    unsigned int count(0);
+    size_t align(file->config.alignment);
+    size_t lo(buf->lo), hi(buf->hi);
+    size_t mid_lo((lo + align - 1) / align * align);
+    size_t mid_hi(hi / align * align);
+    if (file->direct_fd >= 0 && mid_lo < mid_hi)
+    {
+        if (lo < mid_lo)
+        {
+            set_op(buf->ops[count++], buf, file->fd, lo, mid_lo);
+        }
+        set_op(buf->ops[count++], buf, file->direct_fd, mid_lo, mid_hi);
+        if (mid_hi < hi)
+        {
+            set_op(buf->ops[count++], buf, file->fd, mid_hi, hi);
+        }
+    }
+    else
+    {
+        set_op(buf->ops[count++], buf, file->fd, lo, hi);
+    }
+    pthread_mutex_lock(&file->lock);
+    buf->pending = count;
+    pthread_mutex_unlock(&file->lock);
+    for (unsigned int ii(0); ii < count; ++ii)
+    {
+        queue_op(file, &buf->ops[ii]);
+    }
+}
+
+
+// Make a free buffer the current one, starting at addr
+static void start_buffer(WriteBehindFile* file, haddr_t addr)
+{
+    while (true)
+    {
+        for (size_t ii(0); ii < file->buffers.size(); ++ii)
+        {
+            WriteBuffer& buf(file->buffers[ii]);
+            if (!in_flight(file, buf))
+            {
+                buf.base = addr / file->config.alignment *
+                    file->config.alignment;
+                buf.lo = buf.hi = addr - buf.base;
+                file->current = &buf;
+                return;
+            }
+        }
+        wait_any(file);
+    }
+}
+
+
+static herr_t take_error(WriteBehindFile* file)
+{
+    pthread_mutex_lock(&file->lock);
+    int error(file->error);
+    file->error = 0;
+    pthread_mutex_unlock(&file->lock);
+    if (error != 0)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Driver callbacks
+///////////////////////////////////////////////////////////////////////////////
+
+
+static hid_t driver_id(-1);
+static pthread_mutex_t driver_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static WriteBehindConfig to_config(WriteBehind const& options)
+{
+    WriteBehindConfig config;
+    config.buffer_size = std::max<size_t>(options.buffer_size(), 1);
+    config.buffers = std::max<size_t>(options.buffers(), 1);
+    config.alignment = std::max<size_t>(options.alignment(), 1);
+    config.direct = options.direct();
+    config.io_uring = options.io_uring();
+    return config;
+}
+
+
+static herr_t wb_terminate()
+{
+    pthread_mutex_lock(&driver_lock);
+    driver_id = -1;
+    pthread_mutex_unlock(&driver_lock);
+    return 0;
+}
+
+
+static void* wb_fapl_get(H5FD_t* _file)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    // The library frees this with free()
+    WriteBehindConfig* config(static_cast<WriteBehindConfig*>(
+                malloc(sizeof(WriteBehindConfig))));
+    if (config)
+    {
+        *config = file->config;
+    }
+    return config;
+}
+
+
+static herr_t wb_flush(H5FD_t* _file, hid_t dxpl, hbool_t closing);
+
+
+static void close_file(WriteBehindFile* file)
+{
+    if (file->writer)
+    {
+        pthread_mutex_lock(&file->lock);
+        file->stop = true;
+        pthread_cond_signal(&file->queued);
+        pthread_mutex_unlock(&file->lock);
+        pthread_join(file->thread, 0);
+        pthread_cond_destroy(&file->queued);
+    }
+    delete file->ring;
+    for (size_t ii(0); ii < file->buffers.size(); ++ii)
+    {
+        free(file->buffers[ii].mem);
+    }
+    if (file->direct_fd >= 0)
+    {
+        close(file->direct_fd);
+    }
+    close(file->fd);
+    pthread_cond_destroy(&file->done);
+    pthread_mutex_destroy(&file->lock);
+    delete file;
+}
+
+
+static H5FD_t* wb_open(char const* name, unsigned int flags, hid_t fapl,
+        haddr_t maxaddr)
+{
+    WriteBehindConfig config(to_config(WriteBehind()));
+    void const* info(H5Pget_driver_info(fapl));
+    if (info)
+    {
+        config = *static_cast<WriteBehindConfig const*>(info);
+    }
+
+    bool rdwr(flags & H5F_ACC_RDWR);
+    int o_flags(rdwr ? O_RDWR : O_RDONLY);
+    if (flags & H5F_ACC_TRUNC)
+    {
+        o_flags |= O_TRUNC;
+    }
+    if (flags & H5F_ACC_CREAT)
+    {
+        o_flags |= O_CREAT;
+    }
+    if (flags & H5F_ACC_EXCL)
+    {
+        o_flags |= O_EXCL;
+    }
+    int fd(open(name, o_flags, 0666));
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    WriteBehindFile* file(new WriteBehindFile);
+    memset(&file->pub, 0, sizeof(file->pub));
+    file->config = config;
+    file->fd = fd;
+    file->direct_fd = -1;
+    file->device = st.st_dev;
+    file->inode = st.st_ino;
+    file->eoa = 0;
+    file->eof = st.st_size;
+    file->current = 0;
+    pthread_mutex_init(&file->lock, 0);
+    pthread_cond_init(&file->done, 0);
+    file->error = 0;
+    file->ring = 0;
+    file->writer = false;
+    file->stop = false;
+    if (!rdwr)
+    {
+        // Nothing will be written, so no buffers are needed
+        return &file->pub;
+    }
+
+#if defined(O_DIRECT)
+    if (config.direct)
+    {
+        // Without direct I/O, writes go through the page cache instead
+        file->direct_fd = open(name, O_WRONLY | O_DIRECT);
+    }
+#endif
+    size_t cap(capacity(file));
+    size_t mem_align(std::max<size_t>(config.alignment, sizeof(void*)));
+    file->buffers.resize(config.buffers);
+    for (size_t ii(0); ii < file->buffers.size(); ++ii)
+    {
+        WriteBuffer& buf(file->buffers[ii]);
+        buf.pending = 0;
+        if (posix_memalign(reinterpret_cast<void**>(&buf.mem), mem_align,
+                    cap) != 0)
+        {
+            buf.mem = 0;
+            close_file(file);
+            return 0;
+        }
+    }
+    if (config.io_uring)
+    {
+        file->ring = new Ring;
+        unsigned int entries(1);
+        while (entries < 3 * config.buffers)
+        {
+            entries *= 2;
+        }
+        if (!file->ring->open(entries))
+        {
+            delete file->ring;
+            file->ring = 0;
+        }
+    }
+    if (!file->ring)
+    {
+        pthread_cond_init(&file->queued, 0);
+        if (pthread_create(&file->thread, 0, writer_main, file) != 0)
+        {
+            pthread_cond_destroy(&file->queued);
+            close_file(file);
+            return 0;
+        }
+        file->writer = true;
+    }
+    return &file->pub;
+}
+
+
+static herr_t wb_close(H5FD_t* _file)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    herr_t result(wb_flush(_file, H5P_DEFAULT, true));
+    close_file(file);
+    return result;
+}
+
+
+static int wb_cmp(H5FD_t const* _f1, H5FD_t const* _f2)
+{
+    WriteBehindFile const* f1(reinterpret_cast<WriteBehindFile const*>(_f1));
+    WriteBehindFile const* f2(reinterpret_cast<WriteBehindFile const*>(_f2));
+    if (f1->device != f2->device)
+    {
+        return f1->device < f2->device ? -1 : 1;
+    }
+    if (f1->inode != f2->inode)
+    {
+        return f1->inode < f2->inode ? -1 : 1;
+    }
+    return 0;
+}
+
+
+static herr_t wb_query(H5FD_t const* file, unsigned long* flags)
+{
+    if (flags)
+    {
+        *flags = H5FD_FEAT_AGGREGATE_METADATA |
+            H5FD_FEAT_ACCUMULATE_METADATA | H5FD_FEAT_DATA_SIEVE |
+            H5FD_FEAT_AGGREGATE_SMALLDATA |
+            H5FD_FEAT_DEFAULT_VFD_COMPATIBLE;
+    }
+    return 0;
+}
+
+
+static haddr_t wb_get_eoa(H5FD_t const* _file, H5FD_mem_t type)
+{
+    return reinterpret_cast<WriteBehindFile const*>(_file)->eoa;
+}
+
+
+static herr_t wb_set_eoa(H5FD_t* _file, H5FD_mem_t type, haddr_t addr)
+{
+    reinterpret_cast<WriteBehindFile*>(_file)->eoa = addr;
+    return 0;
+}
+
+
+static haddr_t wb_get_eof(H5FD_t const* _file, H5FD_mem_t type)
+{
+    return reinterpret_cast<WriteBehindFile const*>(_file)->eof;
+}
+
+
+static herr_t wb_get_handle(H5FD_t* _file, hid_t fapl, void** handle)
+{
+    if (!handle)
+    {
+        return -1;
+    }
+    *handle = &reinterpret_cast<WriteBehindFile*>(_file)->fd;
+    return 0;
+}
+
+
+static herr_t wb_read(H5FD_t* _file, H5FD_mem_t type, hid_t dxpl,
+        haddr_t addr, size_t size, void* _buf)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    char* buf(static_cast<char*>(_buf));
+    haddr_t end(addr + size);
+    // Recent writes are read back from the buffers holding them. Only the
+    // current buffer and those being written hold the latest bytes. Buffers
+    // being written never overlap each other, but the current buffer may
+    // hold newer bytes than any of them, so they are only used for ranges
+    // it doesn't touch.
+    WriteBuffer const* cur(file->current);
+    bool in_current(cur && addr < cur->base + cur->hi &&
+            cur->base + cur->lo < end);
+    for (size_t ii(0); ii < file->buffers.size(); ++ii)
+    {
+        WriteBuffer const& wb(file->buffers[ii]);
+        if ((&wb == cur || (!in_current && in_flight(file, wb))) &&
+                addr >= wb.base + wb.lo && end <= wb.base + wb.hi)
+        {
+            memcpy(buf, wb.mem + (addr - wb.base), size);
+            return 0;
+        }
+    }
+    // Anything else must be in the file before it is read
+    bool overlaps(false);
+    for (size_t ii(0); ii < file->buffers.size(); ++ii)
+    {
+        WriteBuffer const& wb(file->buffers[ii]);
+        if ((&wb == file->current || in_flight(file, wb)) &&
+                addr < wb.base + wb.hi && wb.base + wb.lo < end)
+        {
+            overlaps = true;
+            break;
+        }
+    }
+    if (overlaps)
+    {
+        submit_current(file);
+        drain(file);
+        if (take_error(file) < 0)
+        {
+            return -1;
+        }
+    }
+
+    while (size > 0)
+    {
+        ssize_t n = pread(file->fd, buf, size, addr);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0)
+        {
+            // Past the end of the file reads as zeroes
+            memset(buf, 0, size);
+            break;
+        }
+        buf += n;
+        size -= n;
+        addr += n;
+    }
+    return 0;
+}
+
+
+static herr_t wb_write(H5FD_t* _file, H5FD_mem_t type, hid_t dxpl,
+        haddr_t addr, size_t size, void const* _buf)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    if (take_error(file) < 0)
+    {
+        return -1;
+    }
+    char const* buf(static_cast<char const*>(_buf));
+    size_t cap(capacity(file));
+    haddr_t end(addr + size);
+    while (size > 0)
+    {
+        WriteBuffer* cur(file->current);
+        // Writes that continue or overwrite the current buffer's range join
+        // it; anything else starts a new buffer
+        if (cur && addr >= cur->base + cur->lo &&
+                addr <= cur->base + cur->hi && addr < cur->base + cap)
+        {
+            size_t offset(addr - cur->base);
+            size_t n(std::min<size_t>(size, cap - offset));
+            memcpy(cur->mem + offset, buf, n);
+            cur->hi = std::max(cur->hi, offset + n);
+            buf += n;
+            size -= n;
+            addr += n;
+        }
+        else
+        {
+            submit_current(file);
+            start_buffer(file, addr);
+        }
+    }
+    file->eof = std::max(file->eof, end);
+    return 0;
+}
+
+
+static herr_t wb_flush(H5FD_t* _file, hid_t dxpl, hbool_t closing)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    submit_current(file);
+    drain(file);
+    return take_error(file);
+}
+
+
+static herr_t wb_truncate(H5FD_t* _file, hid_t dxpl, hbool_t closing)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    if (wb_flush(_file, dxpl, closing) < 0)
+    {
+        return -1;
+    }
+    if (file->eoa != file->eof)
+    {
+        if (ftruncate(file->fd, file->eoa) < 0)
+        {
+            return -1;
+        }
+        file->eof = file->eoa;
+    }
+    return 0;
+}
+
+
+static herr_t wb_lock(H5FD_t* _file, hbool_t rw)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    if (flock(file->fd, (rw ? LOCK_EX : LOCK_SH) | LOCK_NB) < 0 &&
+            errno != ENOSYS)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+static herr_t wb_unlock(H5FD_t* _file)
+{
+    WriteBehindFile* file(reinterpret_cast<WriteBehindFile*>(_file));
+    if (flock(file->fd, LOCK_UN) < 0 && errno != ENOSYS)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+
+static H5FD_class_t const write_behind_class = {
+    "hdf5r_write_behind",       // name
+    (haddr_t)1 << 62,           // maxaddr
+    H5F_CLOSE_WEAK,             // fc_degree
+    wb_terminate,               // terminate
+    0,                          // sb_size
+    0,                          // sb_encode
+    0,                          // sb_decode
+    sizeof(WriteBehindConfig),  // fapl_size
+    wb_fapl_get,                // fapl_get
+    0,                          // fapl_copy
+    0,                          // fapl_free
+    0,                          // dxpl_size
+    0,                          // dxpl_copy
+    0,                          // dxpl_free
+    wb_open,                    // open
+    wb_close,                   // close
+    wb_cmp,                     // cmp
+    wb_query,                   // query
+    0,                          // get_type_map
+    0,                          // alloc
+    0,                          // free
+    wb_get_eoa,                 // get_eoa
+    wb_set_eoa,                 // set_eoa
+    wb_get_eof,                 // get_eof
+    wb_get_handle,              // get_handle
+    wb_read,                    // read
+    wb_write,                   // write
+    wb_flush,                   // flush
+    wb_truncate,                // truncate
+    wb_lock,                    // lock
+    wb_unlock,                  // unlock
+    H5FD_FLMAP_DICHOTOMY        // fl_map
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Public functions
+///////////////////////////////////////////////////////////////////////////////
+
+
+hid_t hdf5r::write_behind_driver()
+{
+    pthread_mutex_lock(&driver_lock);
+    if (driver_id < 0 || H5Iis_valid(driver_id) <= 0)
+    {
+        driver_id = H5FDregister(&write_behind_class);
+    }
+    hid_t result(driver_id);
+    pthread_mutex_unlock(&driver_lock);
+    if (result < 0)
+    {
+        throw std::runtime_error("Failed to register write-behind driver");
+    }
+    return result;
+}
+
+
+void hdf5r::set_fapl_write_behind(hid_t fapl, WriteBehind const& options)
+{
+    WriteBehindConfig config(to_config(options));
+    if (H5Pset_driver(fapl, write_behind_driver(), &config) < 0)
+    {
+        throw std::runtime_error("Failed to set write-behind driver");
+    }
+}
+
+
+bool hdf5r::have_io_uring()
+{
+    Ring ring;
+    return ring.open(4);
+}
+
@@ -0,0 +1,172 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Catalog the HDF5R files under directories and find which hold what.
+ */
+
+#include <cstdlib>
+#include <hdf5r/catalog.h>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+static void usage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [-u dir]... [-j workers] "
+        "[-x suffix] [-l] [-c channel] [-s start] [-e end] [-t tag[=value]] "
+        "catalog\n"
+        "  -u  Bring the catalog up to date with the files under a directory\n"
+        "  -j  Processes to read files with (default one per processor)\n"
+        "  -x  Suffix of the names of files to catalog (default .h5)\n"
+        "  -l  List the catalogued files\n"
+        "  -c  Find the files holding a channel\n"
+        "  -s  Find channels with records from this time stamp (inclusive)\n"
+        "  -e  Find channels with records up to this time stamp (exclusive)\n"
+        "  -t  Find the files holding a tag, of the given value if any\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> roots;
+    unsigned int workers(0);
+    std::string suffix(".h5");
+    bool list(false), find(false);
+    std::string channel, tag;
+    uint64_t start(0), end(static_cast<uint64_t>(-1));
+    int opt;
+    while ((opt = getopt(argc, argv, "u:j:x:lc:s:e:t:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'u':
+                roots.push_back(optarg);
+                break;
+            case 'j':
+                workers = strtoul(optarg, 0, 0);
+                break;
+            case 'x':
+                suffix = optarg;
+                break;
+            case 'l':
+                list = true;
+                break;
+            case 'c':
+                channel = optarg;
+                find = true;
+                break;
+            case 's':
+                start = strtoull(optarg, 0, 0);
+                find = true;
+                break;
+            case 'e':
+                end = strtoull(optarg, 0, 0);
+                find = true;
+                break;
+            case 't':
+                tag = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string path(argv[optind]);
+
+    // The library probes for optional objects; don't report those misses
+    H5Eset_auto(H5E_DEFAULT, 0, 0);
+    try
+    {
+        hdf5r::Catalog catalog;
+        // A catalog being made for the first time doesn't exist yet
+        if (roots.empty() || access(path.c_str(), F_OK) == 0)
+        {
+            catalog.load(path);
+        }
+        for (std::vector<std::string>::const_iterator ii(roots.begin());
+                ii != roots.end(); ++ii)
+        {
+            hdf5r::CatalogStats stats(catalog.update(*ii, suffix, workers));
+            for (std::vector<std::string>::const_iterator jj(
+                        stats.errors.begin()); jj != stats.errors.end(); ++jj)
+            {
+                std::cerr << argv[0] << ": " << *jj << '\n';
+            }
+            std::cerr << "Catalogued " << stats.files << " files under " <<
+                *ii << ": " << stats.scanned << " read, " <<
+                stats.unchanged << " unchanged, " << stats.removed <<
+                " removed, " << stats.failed << " failed in " << std::fixed <<
+                std::setprecision(3) << stats.seconds << " s\n";
+        }
+        if (!roots.empty())
+        {
+            catalog.save(path);
+        }
+
+        if (list)
+        {
+            std::vector<hdf5r::CatalogFile> const& files(catalog.files());
+            for (std::vector<hdf5r::CatalogFile>::const_iterator ii(
+                        files.begin()); ii != files.end(); ++ii)
+            {
+                uint64_t records(0);
+                for (size_t jj(0); jj < ii->channels.size(); ++jj)
+                {
+                    records += ii->channels[jj].size;
+                }
+                std::cout << ii->path << '\t' << ii->channels.size() <<
+                    '\t' << records << '\t' << ii->start_time << '\t' <<
+                    ii->end_time << '\n';
+            }
+        }
+        if (find)
+        {
+            std::vector<hdf5r::CatalogMatch> matches(catalog.find(channel,
+                        start, end));
+            for (std::vector<hdf5r::CatalogMatch>::const_iterator ii(
+                        matches.begin()); ii != matches.end(); ++ii)
+            {
+                std::cout << ii->path << '\t' << ii->channel.name << '\t' <<
+                    ii->channel.size << '\t' << ii->channel.start_time <<
+                    '\t' << ii->channel.end_time << '\n';
+            }
+        }
+        if (!tag.empty())
+        {
+            std::string::size_type equals(tag.find('='));
+            std::vector<std::string> paths(catalog.find_tag(
+                        tag.substr(0, equals), equals == std::string::npos ?
+                        std::string() : tag.substr(equals + 1)));
+            for (std::vector<std::string>::const_iterator ii(paths.begin());
+                    ii != paths.end(); ++ii)
+            {
+                std::cout << *ii << '\n';
+            }
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
@@ -0,0 +1,131 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Export channels of an HDF5R file to flat binary or CSV files.
+ */
+
+#include <cstdlib>
+#include <hdf5r/export.h>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+static void usage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [-f binary|csv] [-c channel,...] "
+        "[-s start] [-e end] [-t threads] [-b block_records] input outdir\n"
+        "  -f  Output format (default binary)\n"
+        "  -c  Channels to export (default all)\n"
+        "  -s  Export records with time stamps from this one (inclusive)\n"
+        "  -e  Export records with time stamps up to this one (exclusive)\n"
+        "  -t  Conversion threads (default one per processor)\n"
+        "  -b  Records per block (default 65536)\n";
+}
+
+
+static std::vector<std::string> split(std::string const& str)
+{
+    std::vector<std::string> result;
+    std::string::size_type start(0);
+    while (start <= str.size())
+    {
+        std::string::size_type end(str.find(',', start));
+        if (end == std::string::npos)
+        {
+            end = str.size();
+        }
+        if (end > start)
+        {
+            result.push_back(str.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+
+int main(int argc, char** argv)
+{
+    hdf5r::ExportOptions options;
+    uint64_t start(options.start()), end(options.end());
+    int opt;
+    while ((opt = getopt(argc, argv, "f:c:s:e:t:b:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                if (std::string(optarg) == "binary")
+                {
+                    options.format(hdf5r::EXPORT_BINARY);
+                }
+                else if (std::string(optarg) == "csv")
+                {
+                    options.format(hdf5r::EXPORT_CSV);
+                }
+                else
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'c':
+                options.channels(split(optarg));
+                break;
+            case 's':
+                start = strtoull(optarg, 0, 0);
+                break;
+            case 'e':
+                end = strtoull(optarg, 0, 0);
+                break;
+            case 't':
+                options.threads(strtoul(optarg, 0, 0));
+                break;
+            case 'b':
+                options.block_records(strtoul(optarg, 0, 0));
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    options.window(start, end);
+
+    // The library probes for optional objects; don't report those misses
+    H5Eset_auto(H5E_DEFAULT, 0, 0);
+    try
+    {
+        hdf5r::HDF5R file(argv[optind], hdf5r::RDONLY);
+        hdf5r::ExportStats stats(hdf5r::export_channels(file,
+                    argv[optind + 1], options));
+        std::cout << "Exported " << stats.records << " records, " <<
+            stats.bytes_read << " bytes read, " << stats.bytes_written <<
+            " bytes written in " << std::fixed << std::setprecision(3) <<
+            stats.seconds << " s (" << stats.read_rate() << " GB/s read, " <<
+            stats.write_rate() << " GB/s written)\n";
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
@@ -0,0 +1,107 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Logging daemon recording the records of several processes to one file.
+ */
+
+#include <cstdlib>
+#include <hdf5r/logd.h>
+#include <iostream>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+static volatile sig_atomic_t stop(0);
+
+
+static void handle_signal(int)
+{
+    stop = 1;
+}
+
+
+static void usage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [-s service] [-p profile] "
+        "[-b batch_records] [-c checkpoint_ms] output\n"
+        "  -s  Service the clients connect to (default hdf5r)\n"
+        "  -p  File profile: default, \"write-heavy logger\" or archive\n"
+        "  -b  Most records to take from each client at a time "
+        "(default 65536)\n"
+        "  -c  Checkpoint interval in milliseconds (default 1000)\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string service("hdf5r");
+    std::string profile("default");
+    size_t batch(65536);
+    uint64_t interval(1000);
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:b:c:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                service = optarg;
+                break;
+            case 'p':
+                profile = optarg;
+                break;
+            case 'b':
+                batch = strtoul(optarg, 0, 0);
+                break;
+            case 'c':
+                interval = strtoull(optarg, 0, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // The library probes for optional objects; don't report those misses
+    H5Eset_auto(H5E_DEFAULT, 0, 0);
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    try
+    {
+        hdf5r::HDF5R file(argv[optind], hdf5r::TRUNCATE,
+                hdf5r::FileProfile::preset(profile));
+        file.durability(hdf5r::Durability(0, interval));
+        hdf5r::LogDaemon daemon(file, service, batch);
+        daemon.run(stop);
+        std::vector<hdf5r::LogClientStats> stats(daemon.client_stats());
+        for (std::vector<hdf5r::LogClientStats>::const_iterator ii(
+                    stats.begin()); ii != stats.end(); ++ii)
+        {
+            std::cout << "Client " << ii->pid << ": " << ii->records <<
+                " records, " << ii->bytes << " bytes written, " <<
+                ii->dropped << " dropped\n";
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Merge several HDF5R files into one.
+ */
+
+#include <hdf5r/merge.h>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+static void usage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [-p profile] output input...\n"
+        "  -p  File profile for the output: default, \"write-heavy logger\" "
+        "or archive\n";
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string profile("default");
+    int opt;
+    while ((opt = getopt(argc, argv, "p:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                profile = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<std::string> inputs(argv + optind + 1, argv + argc);
+
+    // The library probes for optional objects; don't report those misses
+    H5Eset_auto(H5E_DEFAULT, 0, 0);
+    try
+    {
+        hdf5r::MergeStats stats(hdf5r::merge_files(inputs, argv[optind],
+                    hdf5r::FileProfile::preset(profile)));
+        std::cout << "Merged " << inputs.size() << " files: " <<
+            stats.channels << " channels, " << stats.copied.records <<
+            " records (" << stats.copied.raw_chunks <<
+            " chunks copied raw), " << stats.tags << " tags, " <<
+            stats.index_records << " index records in " << std::fixed <<
+            std::setprecision(3) << stats.seconds << " s\n";
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
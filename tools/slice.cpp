@@ -0,0 +1,123 @@
+/* HDF5R
+ *
+ * Copyright (C) 2011
+ *     Geoffrey Biggs and contributors
+ *     RT-Synthesis Research Group
+ *     Intelligent Systems Research Institute,
+ *     National Institute of Advanced Industrial Science and Technology (AIST),
+ *     Japan
+ *     All rights reserved.
+ * Licensed under the Eclipse Public License -v 1.0 (EPL)
+ * http://www.opensource.org/licenses/eclipse-1.0.txt
+ *
+ * Extract a time window of an HDF5R file into a new file.
+ */
+
+#include <cstdlib>
+#include <hdf5r/slice.h>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+static void usage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [-c channel,...] [-p profile] [-x] "
+        "-s start -e end input output\n"
+        "  -c  Channels to extract (default all)\n"
+        "  -p  File profile for the output: default, \"write-heavy logger\" "
+        "or archive\n"
+        "  -s  Extract records with time stamps from this one (inclusive)\n"
+        "  -e  Extract records with time stamps up to this one (exclusive)\n"
+        "  -x  Extract exactly the window, rather than from the start of the "
+        "chunk\n      holding each channel's first record in it\n";
+}
+
+
+static std::vector<std::string> split(std::string const& str)
+{
+    std::vector<std::string> result;
+    std::string::size_type start(0);
+    while (start <= str.size())
+    {
+        std::string::size_type end(str.find(',', start));
+        if (end == std::string::npos)
+        {
+            end = str.size();
+        }
+        if (end > start)
+        {
+            result.push_back(str.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> channels;
+    std::string profile("default");
+    uint64_t start(0), end(0);
+    bool have_start(false), have_end(false), align(true);
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:s:e:xh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                channels = split(optarg);
+                break;
+            case 'p':
+                profile = optarg;
+                break;
+            case 's':
+                start = strtoull(optarg, 0, 0);
+                have_start = true;
+                break;
+            case 'e':
+                end = strtoull(optarg, 0, 0);
+                have_end = true;
+                break;
+            case 'x':
+                align = false;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 2 || !have_start || !have_end)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // The library probes for optional objects; don't report those misses
+    H5Eset_auto(H5E_DEFAULT, 0, 0);
+    try
+    {
+        hdf5r::HDF5R input(argv[optind], hdf5r::RDONLY);
+        hdf5r::SliceStats stats(hdf5r::slice_file(input, argv[optind + 1],
+                    start, end, channels,
+                    hdf5r::FileProfile::preset(profile), align));
+        std::cout << "Extracted " << stats.channels << " channels, " <<
+            stats.copied.records << " records (" <<
+            stats.leading_records << " before the window, " <<
+            stats.copied.raw_chunks << " chunks or " <<
+            stats.copied.raw_bytes << " bytes copied raw), " <<
+            stats.index_records << " index records in " << std::fixed <<
+            std::setprecision(3) << stats.seconds << " s\n";
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+